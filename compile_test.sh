@@ -12,6 +12,69 @@ g++ -std=c++20 -c src/FileOperations.cpp -o FileOperations.o -Isrc || exit 1
 echo "Compiling DisplayFormatter..."
 g++ -std=c++20 -c src/DisplayFormatter.cpp -o DisplayFormatter.o -Isrc || exit 1
 
+echo "Compiling DisplayWidth..."
+g++ -std=c++20 -c src/DisplayWidth.cpp -o DisplayWidth.o -Isrc || exit 1
+
+echo "Compiling ColorEmitter..."
+g++ -std=c++20 -c src/ColorEmitter.cpp -o ColorEmitter.o -Isrc || exit 1
+
+echo "Compiling LsColors..."
+g++ -std=c++20 -c src/LsColors.cpp -o LsColors.o -Isrc || exit 1
+
+echo "Compiling ThemeCache..."
+g++ -std=c++20 -c src/ThemeCache.cpp -o ThemeCache.o -Isrc || exit 1
+
+echo "Compiling EntryTable..."
+g++ -std=c++20 -c src/EntryTable.cpp -o EntryTable.o -Isrc || exit 1
+
+echo "Compiling ListingCache..."
+g++ -std=c++20 -c src/ListingCache.cpp -o ListingCache.o -Isrc || exit 1
+
+echo "Compiling MemoryListingCache..."
+g++ -std=c++20 -c src/MemoryListingCache.cpp -o MemoryListingCache.o -Isrc || exit 1
+
+echo "Compiling ListingServer..."
+g++ -std=c++20 -c src/ListingServer.cpp -o ListingServer.o -Isrc || exit 1
+
+echo "Compiling WatchView..."
+g++ -std=c++20 -c src/WatchView.cpp -o WatchView.o -Isrc || exit 1
+
+echo "Compiling RecordWriter..."
+g++ -std=c++20 -c src/RecordWriter.cpp -o RecordWriter.o -Isrc || exit 1
+
+echo "Compiling ListingSnapshot..."
+g++ -std=c++20 -c src/ListingSnapshot.cpp -o ListingSnapshot.o -Isrc || exit 1
+
+echo "Compiling ListingDiff..."
+g++ -std=c++20 -c src/ListingDiff.cpp -o ListingDiff.o -Isrc || exit 1
+
+echo "Compiling DirectorySizer..."
+g++ -std=c++20 -c src/DirectorySizer.cpp -o DirectorySizer.o -Isrc || exit 1
+
+echo "Compiling ListingSummary..."
+g++ -std=c++20 -c src/ListingSummary.cpp -o ListingSummary.o -Isrc || exit 1
+
+echo "Compiling EntryFilter..."
+g++ -std=c++20 -c src/EntryFilter.cpp -o EntryFilter.o -Isrc || exit 1
+
+echo "Compiling IoWatchdog..."
+g++ -std=c++20 -c src/IoWatchdog.cpp -o IoWatchdog.o -Isrc || exit 1
+
+echo "Compiling Diagnostics..."
+g++ -std=c++20 -c src/Diagnostics.cpp -o Diagnostics.o -Isrc || exit 1
+
+echo "Compiling TargetCache..."
+g++ -std=c++20 -c src/TargetCache.cpp -o TargetCache.o -Isrc || exit 1
+
+echo "Compiling ExtendedAttributes..."
+g++ -std=c++20 -c src/ExtendedAttributes.cpp -o ExtendedAttributes.o -Isrc || exit 1
+
+echo "Compiling FlatListing..."
+g++ -std=c++20 -c src/FlatListing.cpp -o FlatListing.o -Isrc || exit 1
+
+echo "Compiling ListingSpill..."
+g++ -std=c++20 -c src/ListingSpill.cpp -o ListingSpill.o -Isrc || exit 1
+
 echo "Compiling lspp..."
 g++ -std=c++20 -c src/lspp.cpp -o lspp.o -Isrc || exit 1
 
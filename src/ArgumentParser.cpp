@@ -1,4 +1,6 @@
 #include "ArgumentParser.hpp"
+#include "IoWatchdog.hpp"
+#include "ListingSummary.hpp"
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
@@ -26,11 +28,18 @@ ArgumentParser::ArgumentParser() {
         "numeric-uid-gid", "no-dereference", "indicator-style", "hide-control-chars",
         "show-control-chars", "quote-name", "quoting-style", "reverse", "recursive",
         "size", "sort", "time", "time-style", "tabsize", "time", "version",
-        "width", "context", "help", "version", "color", "hyperlink", "zero", "long"
+        "width", "context", "help", "version", "color", "hyperlink", "zero", "long",
+        "cache", "serve", "client", "watch", "snapshot", "from-snapshot", "diff", "total-size", "summary", "newer", "older", "min-size", "max-size",
+        "type", "owner", "perm", "empty", "max-depth", "one-file-system", "timeout", "acl", "xattr",
+        "from-file", "files0-from", "stat-order", "flat", "max-memory"
     };
 }
 
 LsOptions ArgumentParser::parse(int argc, char** argv) {
+    return parse(argc, argv, isatty(STDOUT_FILENO));
+}
+
+LsOptions ArgumentParser::parse(int argc, char** argv, bool output_is_terminal) {
     LsOptions options;
     
     for (int i = 1; i < argc; ++i) {
@@ -54,8 +63,46 @@ LsOptions ArgumentParser::parse(int argc, char** argv) {
         }
     }
     
+    // Paths come either from the command line or from --from-file/--files0-from
+    if (!options.paths_from.empty() && !options.paths.empty()) {
+        std::cerr << "ls++: extra operand '" << options.paths.front() << "'\n";
+        std::cerr << "file operands cannot be combined with --from-file or --files0-from\n";
+        std::exit(2);
+    }
+    if (!options.paths_from.empty() && (options.summary != 0 || options.diff || options.watch)) {
+        std::cerr << "ls++: --from-file and --files0-from only apply to listings\n";
+        std::exit(2);
+    }
+    
+    // These walk whole directories without a deadline; under --timeout a
+    // hung mount would stall them anyway
+    if (options.timeout_ms > 0 && (options.total_size || (options.filter.needs() & EntryFilter::CONTENTS))) {
+        std::cerr << "ls++: --timeout cannot be combined with " << (options.total_size ? "--total-size" : "--empty") << "\n";
+        std::exit(2);
+    }
+    
+    // These hold whole listings in memory (or read them in one go), so
+    // --max-memory could not keep its bound
+    if (options.max_memory > 0) {
+        const char* other = options.use_cache ? "--cache"
+                          : options.serve ? "--serve"
+                          : options.use_server ? "--client"
+                          : options.timeout_ms > 0 ? "--timeout"
+                          : options.show_directory_entries ? "-d"
+                          : options.flat ? "--flat"
+                          : options.watch ? "--watch"
+                          : options.diff ? "--diff"
+                          : !options.snapshot_path.empty() ? "--snapshot"
+                          : !options.from_snapshot_path.empty() ? "--from-snapshot"
+                          : nullptr;
+        if (other) {
+            std::cerr << "ls++: --max-memory cannot be combined with " << other << "\n";
+            std::exit(2);
+        }
+    }
+    
     // If no paths specified, use current directory
-    if (options.paths.empty()) {
+    if (options.paths.empty() && options.paths_from.empty()) {
         options.paths.push_back(".");
     }
     
@@ -65,10 +112,23 @@ LsOptions ArgumentParser::parse(int argc, char** argv) {
     }
     
     // Set default format based on output
-    if (options.format == ListFormat::COLUMNS && !isatty(STDOUT_FILENO)) {
+    if (options.format == ListFormat::COLUMNS && !output_is_terminal) {
         options.format = ListFormat::ONE_PER_LINE;
     }
     
+    // Never write escape sequences into pipes unless explicitly asked to
+    options.use_color = options.color_mode == ColorMode::ALWAYS ||
+                        (options.color_mode == ColorMode::AUTO && output_is_terminal);
+    
+    // NUL-terminated output is for programs: one plain name per record
+    if (options.zero) {
+        options.use_color = false;
+        options.literal_names = true;
+        if (options.format != ListFormat::LONG && !isRecordFormat(options.format)) {
+            options.format = ListFormat::ONE_PER_LINE;
+        }
+    }
+    
     return options;
 }
 
@@ -112,7 +172,7 @@ void ArgumentParser::parseShortOption(const std::string& arg, LsOptions& options
                 // Don't show owner in long format
                 break;
             case 'G':
-                options.use_color = false;
+                options.color_mode = ColorMode::NEVER;
                 break;
             case 'h':
                 options.human_readable = true;
@@ -319,6 +379,110 @@ void ArgumentParser::parseLongOption(const std::string& arg, LsOptions& options)
         }
     } else if (option == "context") {
         options.show_context = true;
+    } else if (option == "from-file" || option == "files0-from") {
+        if (value.empty()) {
+            std::cerr << "ls++: option '--" << option << "' requires an argument\n";
+            std::cerr << "Try 'ls++ --help' for more information.\n";
+            std::exit(1);
+        }
+        options.paths_from = value;
+        options.paths_separator = option == "files0-from" ? '\0' : '\n';
+    } else if (option == "flat") {
+        options.flat = true;
+    } else if (option == "acl") {
+        options.show_acl = true;
+    } else if (option == "xattr") {
+        options.show_xattrs = true;
+    } else if (option == "watch") {
+        options.watch = true;
+    } else if (option == "zero") {
+        options.zero = true;
+    } else if (option == "diff") {
+        options.diff = true;
+    } else if (EntryFilter::isFilterOption(option)) {
+        std::string error;
+        if (!options.filter.add(option, value, error)) {
+            std::cerr << "ls++: " << error << "\n";
+            std::cerr << "Try 'ls++ --help' for more information.\n";
+            std::exit(1);
+        }
+    } else if (option == "max-depth") {
+        if (value.empty()) {
+            std::cerr << "ls++: option '--max-depth' requires an argument\n";
+            std::cerr << "Try 'ls++ --help' for more information.\n";
+            std::exit(1);
+        }
+        options.max_depth = std::stoi(value);
+    } else if (option == "one-file-system") {
+        options.one_file_system = true;
+    } else if (option == "timeout") {
+        std::chrono::milliseconds timeout;
+        if (value.empty()) {
+            std::cerr << "ls++: option '--timeout' requires an argument\n";
+            std::cerr << "Try 'ls++ --help' for more information.\n";
+            std::exit(1);
+        }
+        if (!IoWatchdog::parseTimeout(value, timeout)) {
+            std::cerr << "ls++: invalid argument '" << value << "' for '--timeout'\n";
+            std::cerr << "Valid arguments are durations such as 500ms, 2s or 1.5 (seconds)\n";
+            std::exit(1);
+        }
+        options.timeout_ms = static_cast<long>(timeout.count());
+    } else if (option == "max-memory") {
+        int64_t bytes;
+        if (!EntryFilter::parseSize(value, bytes)) {
+            std::cerr << "ls++: invalid argument '" << value << "' for '--max-memory'\n";
+            std::cerr << "Valid arguments are sizes such as 512M or 4G\n";
+            std::exit(1);
+        }
+        // Below this, runs would hold too few entries to be worth a file each
+        if (bytes < MIN_MAX_MEMORY) {
+            std::cerr << "ls++: --max-memory must be at least 1M\n";
+            std::exit(1);
+        }
+        options.max_memory = static_cast<size_t>(bytes);
+    } else if (option == "stat-order") {
+        if (value == "auto") {
+            options.stat_order = StatOrder::AUTO;
+        } else if (value == "inode") {
+            options.stat_order = StatOrder::INODE;
+        } else if (value == "directory") {
+            options.stat_order = StatOrder::DIRECTORY;
+        } else {
+            std::cerr << "ls++: invalid argument '" << value << "' for '--stat-order'\n";
+            std::cerr << "Valid arguments are: auto, inode, directory\n";
+            std::exit(1);
+        }
+    } else if (option == "summary") {
+        options.summary = ListingSummary::parseAggregates(value);
+        if (options.summary == 0) {
+            std::cerr << "ls++: invalid argument '" << value << "' for '--summary'\n";
+            std::cerr << "Valid arguments are: types, extensions, sizes, times, owners, all\n";
+            std::exit(1);
+        }
+    } else if (option == "total-size") {
+        options.total_size = true;
+        if (!value.empty()) {
+            options.total_size_depth = std::stoi(value);
+        }
+    } else if (option == "snapshot" || option == "from-snapshot") {
+        if (value.empty()) {
+            std::cerr << "ls++: option '--" << option << "' requires an argument\n";
+            std::cerr << "Try 'ls++ --help' for more information.\n";
+            std::exit(1);
+        }
+        (option == "snapshot" ? options.snapshot_path : options.from_snapshot_path) = value;
+    } else if (option == "serve") {
+        options.serve = true;
+        options.socket_path = value;
+    } else if (option == "client") {
+        options.use_server = true;
+        options.socket_path = value;
+    } else if (option == "cache") {
+        options.use_cache = true;
+        if (!value.empty()) {
+            options.cache_ttl = std::stoi(value);
+        }
     } else {
         std::cerr << "ls++: unrecognized option '--" << option << "'\n";
         std::cerr << "Try 'ls++ --help' for more information.\n";
@@ -327,12 +491,12 @@ void ArgumentParser::parseLongOption(const std::string& arg, LsOptions& options)
 }
 
 void ArgumentParser::handleColorOption(const std::string& value, LsOptions& options) {
-    if (value.empty() || value == "auto") {
-        options.use_color = isatty(STDOUT_FILENO);
-    } else if (value == "always" || value == "yes") {
-        options.use_color = true;
-    } else if (value == "never" || value == "no") {
-        options.use_color = false;
+    if (value.empty() || value == "auto" || value == "tty" || value == "if-tty") {
+        options.color_mode = ColorMode::AUTO;
+    } else if (value == "always" || value == "yes" || value == "force") {
+        options.color_mode = ColorMode::ALWAYS;
+    } else if (value == "never" || value == "no" || value == "none") {
+        options.color_mode = ColorMode::NEVER;
     }
 }
 
@@ -369,6 +533,12 @@ void ArgumentParser::handleFormatOption(const std::string& value, LsOptions& opt
         options.format = ListFormat::ONE_PER_LINE;
     } else if (value == "vertical") {
         options.format = ListFormat::VERTICAL;
+    } else if (value == "json") {
+        options.format = ListFormat::JSON;
+    } else if (value == "ndjson") {
+        options.format = ListFormat::NDJSON;
+    } else if (value == "csv") {
+        options.format = ListFormat::CSV;
     }
 }
 
@@ -384,21 +554,37 @@ void ArgumentParser::printHelp() const {
     std::cout << "Mandatory arguments to long options are mandatory for short options too.\n";
     std::cout << "  -a, --all                  do not ignore entries starting with .\n";
     std::cout << "  -A, --almost-all           do not list implied . and ..\n";
+    std::cout << "      --acl                  with -l, mark files that have an ACL with +\n";
     std::cout << "      --author               with -l, print the author of each file\n";
     std::cout << "  -b, --escape               print C-style escapes for nongraphic characters\n";
     std::cout << "      --block-size=SIZE      scale sizes by SIZE before printing them\n";
     std::cout << "  -B, --ignore-backups       do not list implied entries ending with ~\n";
+    std::cout << "      --cache[=SECONDS]      reuse on-disk listings of unchanged directories;\n";
+    std::cout << "                               re-stat cached entries older than SECONDS (30)\n";
     std::cout << "  -c                         with -lt: sort by, and show, ctime\n";
+    std::cout << "      --client[=SOCKET]      have a running --serve daemon do the listing,\n";
+    std::cout << "                               listing locally if none is running\n";
     std::cout << "  -C                         list entries by columns\n";
     std::cout << "      --color[=WHEN]         colorize the output; WHEN can be 'always',\n";
-    std::cout << "                               'auto', or 'never' (default)\n";
+    std::cout << "                               'auto' (default), or 'never'\n";
     std::cout << "  -d, --directory            list directories themselves, not their contents\n";
+    std::cout << "      --diff A B             report entries added, removed, modified or renamed\n";
+    std::cout << "                               between A and B (directories or snapshots)\n";
+    std::cout << "      --empty                only list empty files and empty directories\n";
     std::cout << "  -f                         do not sort, enable -aU, disable -ls --color\n";
     std::cout << "  -F, --classify             append indicator (one of */=>@|) to entries\n";
     std::cout << "      --file-type            likewise, except do not append '*'\n";
+    std::cout << "      --files0-from=FILE     list the NUL-terminated paths read from FILE\n";
+    std::cout << "                               (- for stdin) in one run, in input order\n";
+    std::cout << "      --flat                 list all entries (with -R, of the whole tree) in\n";
+    std::cout << "                               one listing by path, sorted across directories\n";
     std::cout << "      --format=WORD          across -x, commas -m, horizontal -x,\n";
     std::cout << "                               long -l, single-column -1, verbose -l,\n";
-    std::cout << "                               vertical -C\n";
+    std::cout << "                               vertical -C; json, ndjson or csv write\n";
+    std::cout << "                               every attribute of each entry as a record\n";
+    std::cout << "      --from-file=FILE       like --files0-from, with one path per line\n";
+    std::cout << "      --from-snapshot=FILE   list the entries saved in FILE by --snapshot\n";
+    std::cout << "                               instead of reading the filesystem\n";
     std::cout << "      --full-time            like -l --time-style=full-iso\n";
     std::cout << "  -g                         like -l, but do not list owner\n";
     std::cout << "  -j, --group-directories-first\n";
@@ -417,34 +603,71 @@ void ArgumentParser::printHelp() const {
     std::cout << "                               link, show information for the file the link\n";
     std::cout << "                               references rather than for the link itself\n";
     std::cout << "  -m                         fill width with a comma separated list of entries\n";
+    std::cout << "      --max-depth=N          with -R, descend at most N levels below each\n";
+    std::cout << "                               listed directory\n";
+    std::cout << "      --max-memory=SIZE      keep the entries of a directory within SIZE\n";
+    std::cout << "                               bytes, merging sorted runs from temporary files\n";
+    std::cout << "                               (not with --cache, --serve, --timeout, -d, --flat\n";
+    std::cout << "                               or the snapshot and watch modes)\n";
+    std::cout << "      --max-size=SIZE        only list entries of at most SIZE bytes (K, M, G, T)\n";
+    std::cout << "      --min-size=SIZE        only list entries of at least SIZE bytes\n";
     std::cout << "  -n, --numeric-uid-gid      like -l, but list numeric user and group IDs\n";
     std::cout << "  -N, --literal              print raw entry names (don't treat e.g. control\n";
     std::cout << "                               characters specially)\n";
+    std::cout << "      --newer=TIME           only list entries modified after TIME: an age\n";
+    std::cout << "                               (30m, 12h, 7d, 2w), a date (YYYY-MM-DD[ HH:MM])\n";
+    std::cout << "                               or a file whose mtime to use\n";
     std::cout << "  -o                         like -l, but do not list group information\n";
+    std::cout << "      --older=TIME           only list entries modified before TIME\n";
+    std::cout << "      --one-file-system      with -R, --summary or --total-size, do not enter\n";
+    std::cout << "                               directories on other file systems\n";
+    std::cout << "      --owner=USER           only list entries owned by USER (name or uid)\n";
     std::cout << "  -p, --indicator-style=slash\n";
     std::cout << "                             append / indicator to directories\n";
+    std::cout << "      --perm=MODE            only list entries whose permission bits are MODE\n";
+    std::cout << "                               (octal); -MODE: all of them set, /MODE: any\n";
     std::cout << "  -q, --hide-control-chars   print ? instead of nongraphic characters\n";
     std::cout << "  -Q, --quote-name           enclose entry names in double quotes\n";
     std::cout << "      --quoting-style=WORD   use quoting style WORD for entry names\n";
     std::cout << "  -r, --reverse              reverse order while sorting\n";
     std::cout << "  -R, --recursive            list subdirectories recursively\n";
+    std::cout << "      --serve[=SOCKET]       run as a daemon answering --client requests and\n";
+    std::cout << "                               keeping listings cached in memory\n";
     std::cout << "  -s, --size                 print the allocated size of each file, in blocks\n";
     std::cout << "  -S                         sort by file size, largest first\n";
+    std::cout << "      --summary[=WHAT]       print totals instead of entries: a comma list of\n";
+    std::cout << "                               types, extensions, sizes, times, owners (all);\n";
+    std::cout << "                               as JSON with --format=json\n";
+    std::cout << "      --snapshot=FILE        save the listing (all of it with -R) to FILE\n";
+    std::cout << "                               instead of printing it\n";
     std::cout << "      --sort=WORD            sort by WORD instead of name: none (-U),\n";
     std::cout << "                               size (-S), time (-t), version (-v), extension (-X)\n";
+    std::cout << "      --stat-order=WHEN      stat entries in inode order: auto (for large\n";
+    std::cout << "                               directories), inode (always), directory (never)\n";
     std::cout << "      --time=WORD            with -l, show time as WORD instead of default\n";
     std::cout << "                               modification time: atime or access or use (-u),\n";
     std::cout << "                               ctime or status (-c), birth, creation\n";
     std::cout << "      --time-style=STYLE     with -l, show times using style STYLE\n";
     std::cout << "  -t                         sort by modification time, newest first\n";
+    std::cout << "      --total-size[=DEPTH]   show (and sort by) the disk usage of everything\n";
+    std::cout << "                               in each directory, DEPTH levels down at most\n";
     std::cout << "  -T, --tabsize=COLS         assume tab stops at each COLS instead of 8\n";
+    std::cout << "      --timeout=DURATION     give up on a directory's I/O after DURATION\n";
+    std::cout << "                               (500ms, 2s), showing unread attributes as ?\n";
+    std::cout << "                               (not with --total-size or --empty)\n";
+    std::cout << "      --type=TYPES           only list entries of these types: f (file),\n";
+    std::cout << "                               d, l, p, s, b, c, separated by commas\n";
     std::cout << "  -u                         with -lt: sort by, and show, access time\n";
     std::cout << "  -U                         do not sort; list entries in directory order\n";
     std::cout << "  -v                         natural sort of (version) numbers within text\n";
+    std::cout << "      --watch                keep the listing of a directory on screen and\n";
+    std::cout << "                               update it as entries change\n";
     std::cout << "  -w, --width=COLS           set output width to COLS. 0 means no limit\n";
     std::cout << "  -x                         list entries by lines instead of by columns\n";
     std::cout << "  -X                         sort alphabetically by entry extension\n";
+    std::cout << "      --xattr                list the extended attribute names of each file\n";
     std::cout << "  -Z, --context              print any security context of each file\n";
+    std::cout << "      --zero                 end each output line with NUL, not newline\n";
     std::cout << "  -1                         list one file per line\n";
     std::cout << "      --help                 display this help and exit\n";
     std::cout << "      --version              output version information and exit\n\n";
@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <unordered_set>
+#include "EntryFilter.hpp"
 
 enum class SortOrder {
     NAME,
@@ -26,7 +27,27 @@ enum class ListFormat {
     ONE_PER_LINE, // -1 format
     COMMAS,      // -m format
     ACROSS,      // -x format
-    VERTICAL     // -C format (explicit)
+    VERTICAL,    // -C format (explicit)
+    JSON,        // --format=json, one array of records
+    NDJSON,      // --format=ndjson, one JSON record per line
+    CSV          // --format=csv, header row then one record per line
+};
+
+// Formats that write every field of each entry instead of a rendered listing
+inline bool isRecordFormat(ListFormat format) {
+    return format == ListFormat::JSON || format == ListFormat::NDJSON || format == ListFormat::CSV;
+}
+
+enum class StatOrder {
+    AUTO,       // by inode number for large directories (default)
+    INODE,      // --stat-order=inode
+    DIRECTORY   // --stat-order=directory, as readdir returns them
+};
+
+enum class ColorMode {
+    AUTO,    // color only when stdout is a terminal (default)
+    ALWAYS,  // --color=always
+    NEVER    // --color=never, -G
 };
 
 struct LsOptions {
@@ -34,7 +55,8 @@ struct LsOptions {
     bool show_all = false;              // -a, --all
     bool show_almost_all = false;       // -A, --almost-all
     bool ignore_backups = false;        // -B, --ignore-backups
-    bool use_color = true;              // --color=auto/always/never
+    bool use_color = true;              // resolved from color_mode after parsing
+    ColorMode color_mode = ColorMode::AUTO; // --color=auto/always/never
     bool show_control_chars = false;    // -q, --hide-control-chars
     bool show_directory_entries = false; // -d, --directory
     bool escape_names = false;          // -b, --escape
@@ -54,11 +76,34 @@ struct LsOptions {
     bool si_units = false;              // --si
     bool block_size_1024 = false;       // -k, --kibibytes
     bool recursive = false;             // -R, --recursive
+    bool flat = false;                  // --flat, one listing of every entry by path, sorted across directories
     bool reverse_order = false;         // -r, --reverse
     bool ignore_case = false;           // ignore case in sorting
     bool show_author = false;           // --author
     bool full_time = false;             // --full-time
     bool show_context = false;          // -Z, --context (SELinux)
+    bool show_acl = false;              // --acl, mark entries with an ACL by + after the permissions
+    bool show_xattrs = false;           // --xattr, list extended attribute names after each name
+    bool use_cache = false;             // --cache, reuse on-disk directory listings
+    int cache_ttl = 30;                 // --cache=SECONDS, trust cached entry attributes this long
+    bool serve = false;                 // --serve, run the listing daemon
+    bool use_server = false;            // --client, forward the request to the daemon
+    std::string socket_path;            // --serve=SOCKET / --client=SOCKET, empty for the default
+    bool watch = false;                 // --watch, keep the listing live
+    bool zero = false;                  // --zero, end each output line with NUL
+    std::string snapshot_path;          // --snapshot=FILE, save the listing instead of showing it
+    std::string from_snapshot_path;     // --from-snapshot=FILE, show a saved listing
+    bool diff = false;                  // --diff A B, compare two listings or snapshots
+    bool total_size = false;            // --total-size, show directories with the size of their contents
+    int total_size_depth = -1;          // --total-size=DEPTH, levels below each directory to count
+    int max_depth = -1;                 // --max-depth=N, levels -R descends below each directory
+    bool one_file_system = false;       // --one-file-system, -R stays on each directory's file system
+    long timeout_ms = 0;                // --timeout=DURATION, I/O deadline per directory, 0 for none
+    StatOrder stat_order = StatOrder::AUTO; // --stat-order=WHEN, order of the stats within a directory
+    size_t max_memory = 0;              // --max-memory=SIZE, bytes of entries a directory listing holds, 0 for no limit
+    unsigned summary = 0;               // --summary[=WHAT], ListingSummary::Aggregate bits to print
+    std::string paths_from;             // --from-file=FILE / --files0-from=FILE, "-" for stdin
+    char paths_separator = '\n';        // '\0' for --files0-from
     
     // Sorting options
     SortOrder sort_order = SortOrder::NAME;
@@ -71,6 +116,7 @@ struct LsOptions {
     // Filter options
     std::vector<std::string> ignore_patterns;  // --ignore
     std::vector<std::string> hide_patterns;    // --hide
+    EntryFilter filter;                        // --newer, --min-size, --type, ...
     
     // Size and formatting
     int tab_size = 8;                   // -T, --tabsize
@@ -87,10 +133,14 @@ public:
     ArgumentParser();
     
     LsOptions parse(int argc, char** argv);
+    // As above, deciding format and color for an output that may not be our stdout
+    LsOptions parse(int argc, char** argv, bool output_is_terminal);
     void printHelp() const;
     void printVersion() const;
     
 private:
+    static constexpr int64_t MIN_MAX_MEMORY = 1 << 20;
+    
     void parseShortOption(const std::string& arg, LsOptions& options, size_t& pos);
     void parseLongOption(const std::string& arg, LsOptions& options);
     bool isOption(const std::string& arg) const;
@@ -0,0 +1,222 @@
+#include "ColorEmitter.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include <climits>
+
+ColorEmitter::ColorEmitter(ColorDepth depth) : m_depth(depth), m_current(nullptr) {
+}
+
+void ColorEmitter::setColor(std::ostream& out, const std::string& sgr) {
+    if (sgr.empty()) {
+        reset(out);
+        return;
+    }
+
+    const Style& style = lookup(sgr);
+    if (m_current == &style) {
+        return;
+    }
+    if (m_current && m_current->params == style.params) {
+        // Different source sequence, same attributes after downsampling
+        m_current = &style;
+        return;
+    }
+
+    if (!m_current || (m_current->foreground_only && style.sets_foreground)) {
+        // Nothing to undo: the new color simply replaces the old one
+        out << "\033[" << style.params << 'm';
+    } else {
+        out << "\033[0;" << style.params << 'm';
+    }
+    m_current = &style;
+}
+
+void ColorEmitter::endCell(std::ostream& out) {
+    if (m_current && m_current->visible_on_spaces) {
+        reset(out);
+    }
+}
+
+void ColorEmitter::reset(std::ostream& out) {
+    if (m_current) {
+        out << "\033[m";
+        m_current = nullptr;
+    }
+}
+
+ColorDepth ColorEmitter::detectColorDepth() {
+    const char* colorterm = std::getenv("COLORTERM");
+    if (colorterm) {
+        std::string value = colorterm;
+        if (value == "truecolor" || value == "24bit") {
+            return ColorDepth::TRUECOLOR;
+        }
+    }
+
+    const char* term = std::getenv("TERM");
+    if (term) {
+        std::string value = term;
+        if (value.find("truecolor") != std::string::npos || value.find("24bit") != std::string::npos ||
+            value.find("direct") != std::string::npos) {
+            return ColorDepth::TRUECOLOR;
+        }
+        if (value.find("256color") != std::string::npos) {
+            return ColorDepth::ANSI256;
+        }
+    }
+
+    return ColorDepth::ANSI16;
+}
+
+const ColorEmitter::Style& ColorEmitter::lookup(const std::string& sgr) {
+    auto it = m_styles.find(sgr);
+    if (it != m_styles.end()) {
+        return it->second;
+    }
+
+    // Accept both full sequences ("\033[01;34m") and bare parameters ("01;34")
+    std::string params = sgr;
+    if (params.size() >= 3 && params.compare(0, 2, "\033[") == 0 && params.back() == 'm') {
+        params = params.substr(2, params.size() - 3);
+    }
+    params = downsample(params);
+
+    Style style{params, false, true, false};
+
+    std::vector<int> codes;
+    size_t start = 0;
+    while (start <= params.size()) {
+        size_t end = params.find(';', start);
+        if (end == std::string::npos) {
+            end = params.size();
+        }
+        codes.push_back(end > start ? std::atoi(params.c_str() + start) : 0);
+        start = end + 1;
+    }
+
+    for (size_t i = 0; i < codes.size(); ++i) {
+        int code = codes[i];
+        if (code == 38 || code == 48) {
+            // Extended color: 5;n or 2;r;g;b
+            bool background = code == 48;
+            size_t skip = (i + 1 < codes.size() && codes[i + 1] == 2) ? 4 : 2;
+            i += skip;
+            if (background) {
+                style.visible_on_spaces = true;
+                style.foreground_only = false;
+            } else {
+                style.sets_foreground = true;
+            }
+        } else if ((code >= 30 && code <= 37) || code == 39 || (code >= 90 && code <= 97)) {
+            style.sets_foreground = true;
+        } else if ((code >= 40 && code <= 49) || (code >= 100 && code <= 107) ||
+                   code == 4 || code == 7 || code == 9 || code == 21 || code == 53) {
+            style.visible_on_spaces = true;
+            style.foreground_only = false;
+        } else {
+            style.foreground_only = false;
+        }
+    }
+    style.foreground_only = style.foreground_only && style.sets_foreground;
+
+    return m_styles.emplace(sgr, std::move(style)).first->second;
+}
+
+std::string ColorEmitter::downsample(const std::string& params) const {
+    if (m_depth == ColorDepth::TRUECOLOR || params.find("8;2;") == std::string::npos) {
+        return params;
+    }
+
+    std::vector<std::string> tokens;
+    size_t start = 0;
+    while (start <= params.size()) {
+        size_t end = params.find(';', start);
+        if (end == std::string::npos) {
+            end = params.size();
+        }
+        tokens.push_back(params.substr(start, end - start));
+        start = end + 1;
+    }
+
+    std::string result;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (!result.empty()) {
+            result += ';';
+        }
+
+        bool extended = (tokens[i] == "38" || tokens[i] == "48") &&
+                        i + 4 < tokens.size() && tokens[i + 1] == "2";
+        if (!extended) {
+            result += tokens[i];
+            continue;
+        }
+
+        bool background = tokens[i] == "48";
+        int r = std::atoi(tokens[i + 2].c_str());
+        int g = std::atoi(tokens[i + 3].c_str());
+        int b = std::atoi(tokens[i + 4].c_str());
+        i += 4;
+
+        if (m_depth == ColorDepth::ANSI256) {
+            result += background ? "48;5;" : "38;5;";
+            result += std::to_string(rgbTo256(r, g, b));
+        } else {
+            int index = rgbTo16(r, g, b);
+            int base = index < 8 ? (background ? 40 : 30) : (background ? 100 : 90);
+            result += std::to_string(base + index % 8);
+        }
+    }
+
+    return result;
+}
+
+int ColorEmitter::rgbTo256(int r, int g, int b) {
+    // Nearest entry of the 6x6x6 cube or of the 24-step grey ramp
+    static const int levels[] = {0, 95, 135, 175, 215, 255};
+    auto nearest_level = [](int value) {
+        int best = 0;
+        for (int i = 1; i < 6; ++i) {
+            if (std::abs(levels[i] - value) < std::abs(levels[best] - value)) {
+                best = i;
+            }
+        }
+        return best;
+    };
+    auto distance = [&](int cr, int cg, int cb) {
+        return (cr - r) * (cr - r) + (cg - g) * (cg - g) + (cb - b) * (cb - b);
+    };
+
+    int ri = nearest_level(r), gi = nearest_level(g), bi = nearest_level(b);
+    int cube_index = 16 + 36 * ri + 6 * gi + bi;
+    int cube_distance = distance(levels[ri], levels[gi], levels[bi]);
+
+    int average = (r + g + b) / 3;
+    int grey_step = average < 8 ? 0 : std::min(23, (average - 8 + 5) / 10);
+    int grey_value = 8 + 10 * grey_step;
+    int grey_distance = distance(grey_value, grey_value, grey_value);
+
+    return grey_distance < cube_distance ? 232 + grey_step : cube_index;
+}
+
+int ColorEmitter::rgbTo16(int r, int g, int b) {
+    // xterm's default palette
+    static const int palette[16][3] = {
+        {0, 0, 0}, {205, 0, 0}, {0, 205, 0}, {205, 205, 0},
+        {0, 0, 238}, {205, 0, 205}, {0, 205, 205}, {229, 229, 229},
+        {127, 127, 127}, {255, 0, 0}, {0, 255, 0}, {255, 255, 0},
+        {92, 92, 255}, {255, 0, 255}, {0, 255, 255}, {255, 255, 255},
+    };
+
+    int best = 0;
+    int best_distance = INT_MAX;
+    for (int i = 0; i < 16; ++i) {
+        int dr = palette[i][0] - r, dg = palette[i][1] - g, db = palette[i][2] - b;
+        int d = dr * dr + dg * dg + db * db;
+        if (d < best_distance) {
+            best_distance = d;
+            best = i;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <iostream>
+
+enum class ColorDepth {
+    ANSI16,     // 8 normal + 8 bright colors
+    ANSI256,    // xterm 256-color palette
+    TRUECOLOR   // 24-bit RGB
+};
+
+// Writes SGR (color) escape sequences while tracking the terminal's current
+// attributes, so that a transition is only emitted when the style actually
+// changes. 24-bit colors are downsampled to what the terminal supports.
+class ColorEmitter {
+public:
+    explicit ColorEmitter(ColorDepth depth = detectColorDepth());
+
+    // Switch to the given SGR sequence; an empty string means default attributes
+    void setColor(std::ostream& out, const std::string& sgr);
+
+    // Called after a styled cell: keeps the current state unless it would
+    // show on the padding that follows (background, underline, reverse)
+    void endCell(std::ostream& out);
+
+    // Return to default attributes if anything is active
+    void reset(std::ostream& out);
+
+    ColorDepth depth() const { return m_depth; }
+
+    // Guess terminal capabilities from COLORTERM and TERM
+    static ColorDepth detectColorDepth();
+
+private:
+    struct Style {
+        std::string params;     // SGR parameters without "\033[" and "m"
+        bool sets_foreground;   // replaces the foreground color
+        bool foreground_only;   // only sets the foreground color
+        bool visible_on_spaces; // background, underline, reverse, ...
+    };
+
+    ColorDepth m_depth;
+    const Style* m_current;
+    std::unordered_map<std::string, Style> m_styles;
+
+    const Style& lookup(const std::string& sgr);
+    std::string downsample(const std::string& params) const;
+
+    static int rgbTo256(int r, int g, int b);
+    static int rgbTo16(int r, int g, int b);
+};
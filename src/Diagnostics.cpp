@@ -0,0 +1,35 @@
+#include "Diagnostics.hpp"
+#include <algorithm>
+
+void Diagnostics::report(Severity severity, const char* action, const std::string& path, std::error_code error) {
+    std::string message = action;
+    message += " '";
+    message += path;
+    message += "': ";
+    message += error.message();
+    report(severity, message);
+}
+
+void Diagnostics::report(Severity severity, const std::string& message) {
+    m_status = std::max(m_status, static_cast<int>(severity));
+    if (m_count++ < MAX_MESSAGES) {
+        m_buffer += "ls++: ";
+        m_buffer += message;
+        m_buffer += '\n';
+    }
+}
+
+void Diagnostics::flush(std::ostream& out, std::ostream& err) {
+    if (m_count == 0) {
+        return;
+    }
+    out.flush();
+    err << m_buffer;
+    if (m_count > MAX_MESSAGES) {
+        err << "ls++: " << (m_count - MAX_MESSAGES) << " more errors not shown\n";
+    }
+    err.flush();
+    m_buffer.clear();
+    m_count = 0;
+    m_status = 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <system_error>
+
+// Error messages gathered while a listing is read, written to stderr in one
+// block after its output so they never land in the middle of stdout lines
+// when both streams share a terminal or log. Failing entries are reported
+// here and listed anyway, so an error costs a string append rather than an
+// exception unwinding the rest of the directory. At most MAX_MESSAGES are
+// kept; the rest are only counted.
+class Diagnostics {
+public:
+    // How bad a failure is, as ls exit statuses: a problem with an entry
+    // (1) or with a command-line argument (2)
+    enum Severity { MINOR = 1, SERIOUS = 2 };
+
+    static constexpr size_t MAX_MESSAGES = 10000;
+
+    // "ls++: <action> '<path>': <error>"
+    void report(Severity severity, const char* action, const std::string& path, std::error_code error);
+    void report(Severity severity, const std::string& message);
+
+    bool empty() const { return m_count == 0; }
+    // 0 when nothing was reported, otherwise the worst severity seen
+    int exitStatus() const { return m_status; }
+
+    // Writes the batch (after flushing out, which it must follow) and starts
+    // a new one; read exitStatus() first
+    void flush(std::ostream& out, std::ostream& err);
+
+private:
+    std::string m_buffer;
+    size_t m_count = 0;
+    int m_status = 0;
+};
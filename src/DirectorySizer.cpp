@@ -0,0 +1,138 @@
+#include "DirectorySizer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+DirectorySizer::DirectorySizer(int max_depth, bool one_file_system)
+    : m_max_depth(max_depth), m_one_file_system(one_file_system), m_busy(0) {
+}
+
+std::vector<uint64_t> DirectorySizer::measure(const std::vector<fs::path>& roots, std::vector<Failure>& failures) {
+    std::vector<uint64_t> totals(roots.size(), 0);
+    m_root_devices.assign(roots.size(), 0);
+    m_failures.clear();
+
+    for (size_t i = 0; i < roots.size(); ++i) {
+        struct stat st;
+        if (lstat(roots[i].c_str(), &st) != 0) {
+            m_failures.push_back({roots[i].native(), errno});
+            continue;
+        }
+        m_root_devices[i] = st.st_dev;
+        if (st.st_nlink <= 1 || S_ISDIR(st.st_mode) || firstLink(st.st_dev, st.st_ino)) {
+            totals[i] += static_cast<uint64_t>(st.st_blocks) * 512;
+        }
+        if (S_ISDIR(st.st_mode) && m_max_depth != 0) {
+            m_queue.push_back({roots[i].native(), i, 0});
+        }
+    }
+
+    if (m_queue.empty()) {
+        failures = std::move(m_failures);
+        return totals;
+    }
+
+    unsigned count = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    workers.reserve(count);
+    for (unsigned i = 0; i < count; ++i) {
+        workers.emplace_back([this, &totals] { worker(totals); });
+    }
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    failures = std::move(m_failures);
+    return totals;
+}
+
+void DirectorySizer::worker(std::vector<uint64_t>& totals) {
+    // Sums stay local until the walk is over
+    std::vector<uint64_t> local(totals.size(), 0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_work_ready.wait(lock, [this] { return !m_queue.empty() || m_busy == 0; });
+        if (m_queue.empty()) {
+            // Nothing queued and nobody left to queue more
+            break;
+        }
+
+        Task task = std::move(m_queue.front());
+        m_queue.pop_front();
+        ++m_busy;
+        lock.unlock();
+
+        local[task.root] += scan(task);
+
+        lock.lock();
+        --m_busy;
+        if (m_busy == 0 && m_queue.empty()) {
+            m_work_ready.notify_all();
+        }
+    }
+
+    for (size_t i = 0; i < totals.size(); ++i) {
+        totals[i] += local[i];
+    }
+    lock.unlock();
+    m_work_ready.notify_all();
+}
+
+uint64_t DirectorySizer::scan(const Task& task) {
+    int fd = open(task.path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR* dir = fd >= 0 ? fdopendir(fd) : nullptr;
+    if (!dir) {
+        int error = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_failures.push_back({task.path, error});
+        return 0;
+    }
+
+    uint64_t total = 0;
+    std::vector<Task> subdirectories;
+    bool descend = m_max_depth < 0 || task.depth + 1 < m_max_depth;
+
+    while (struct dirent* entry = readdir(dir)) {
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+
+        struct stat st;
+        if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            continue;
+        }
+        if (!S_ISDIR(st.st_mode) && st.st_nlink > 1 && !firstLink(st.st_dev, st.st_ino)) {
+            continue;
+        }
+        total += static_cast<uint64_t>(st.st_blocks) * 512;
+
+        if (S_ISDIR(st.st_mode) && descend &&
+            (!m_one_file_system || st.st_dev == m_root_devices[task.root])) {
+            subdirectories.push_back({task.path + "/" + name, task.root, task.depth + 1});
+        }
+    }
+    closedir(dir);
+
+    if (!subdirectories.empty()) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& subdirectory : subdirectories) {
+            m_queue.push_back(std::move(subdirectory));
+        }
+        m_work_ready.notify_all();
+    }
+    return total;
+}
+
+bool DirectorySizer::firstLink(uint64_t device, uint64_t inode) {
+    LinkShard& shard = m_links[(inode ^ device) % LINK_SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.seen.insert({device, inode}).second;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <sys/types.h>
+
+namespace fs = std::filesystem;
+
+// du-style totals for --total-size: the allocated size (st_blocks) of
+// everything below each root, the root itself included. Directories are
+// read by a pool of worker threads sharing one queue; files with more than
+// one link are counted once per run, through a set of (st_dev, st_ino)
+// split into shards to keep workers from contending on one lock.
+class DirectorySizer {
+public:
+    // max_depth < 0 walks whole trees; 0 counts only the roots themselves.
+    // With one_file_system, directories on another device than their root are skipped
+    explicit DirectorySizer(int max_depth = -1, bool one_file_system = false);
+
+    // A directory that could not be read; what lies below it is left out of the total
+    struct Failure {
+        std::string path;
+        int error;
+    };
+
+    // Totals in the order of roots; failures gets every directory that was skipped
+    std::vector<uint64_t> measure(const std::vector<fs::path>& roots, std::vector<Failure>& failures);
+
+private:
+    struct Task {
+        std::string path;
+        size_t root;
+        int depth;
+    };
+
+    struct Identity {
+        uint64_t device;
+        uint64_t inode;
+        bool operator==(const Identity& other) const {
+            return device == other.device && inode == other.inode;
+        }
+    };
+
+    struct IdentityHash {
+        size_t operator()(const Identity& id) const {
+            return static_cast<size_t>(id.inode * 0x9E3779B97F4A7C15ULL ^ id.device);
+        }
+    };
+
+    struct LinkShard {
+        std::mutex mutex;
+        std::unordered_set<Identity, IdentityHash> seen;
+    };
+
+    static constexpr size_t LINK_SHARDS = 16;
+
+    int m_max_depth;
+    bool m_one_file_system;
+    std::vector<dev_t> m_root_devices;
+
+    std::mutex m_mutex;
+    std::condition_variable m_work_ready;
+    std::deque<Task> m_queue;
+    size_t m_busy;                      // workers holding a task
+    std::vector<Failure> m_failures;    // guarded by m_mutex
+    LinkShard m_links[LINK_SHARDS];
+
+    void worker(std::vector<uint64_t>& totals);
+    // Allocated size below one directory; subdirectories are queued, not walked
+    uint64_t scan(const Task& task);
+    bool firstLink(uint64_t device, uint64_t inode);
+};
@@ -1,20 +1,38 @@
 #include "DisplayFormatter.hpp"
+#include "DisplayWidth.hpp"
+#include "ColorEmitter.hpp"
+#include "RecordWriter.hpp"
 #include <algorithm>
 #include <iomanip>
 #include <sstream>
 #include <cmath>
 #include <sys/ioctl.h>
+// <sys/ttydefaults.h>, pulled in by <sys/ioctl.h>, defines CTIME as a macro
+#undef CTIME
 #include <unistd.h>
 #include <clocale>
-#include <cwchar>
 
 DisplayFormatter::DisplayFormatter(const LsOptions& options) 
-    : m_options(options), m_icon_provider() {
+    : m_options(options),
+      m_owned_icon_provider(std::make_unique<IconProvider>()),
+      m_icon_provider(*m_owned_icon_provider) {
+    m_icon_provider.setColorEnabled(options.use_color);
+    setlocale(LC_ALL, "");
+}
+
+DisplayFormatter::DisplayFormatter(const LsOptions& options, IconProvider& icon_provider)
+    : m_options(options), m_icon_provider(icon_provider) {
     m_icon_provider.setColorEnabled(options.use_color);
     setlocale(LC_ALL, "");
 }
 
 void DisplayFormatter::displayFiles(const std::vector<FileInfo>& files, std::ostream& out) {
+    // Records are written even for an empty listing (an empty JSON array, a CSV header)
+    if (isRecordFormat(m_options.format)) {
+        displayRecords(files, out);
+        return;
+    }
+    
     if (files.empty()) {
         return;
     }
@@ -38,6 +56,8 @@ void DisplayFormatter::displayFiles(const std::vector<FileInfo>& files, std::ost
             displayColumnar(files, out);
             break;
     }
+    
+    resetColor(out);
 }
 
 void DisplayFormatter::displayLongFormat(const std::vector<FileInfo>& files, std::ostream& out) {
@@ -49,16 +69,24 @@ void DisplayFormatter::displayLongFormat(const std::vector<FileInfo>& files, std
         for (const auto& file : files) {
             total_blocks += (file.size + 1023) / 1024; // Convert to 1K blocks
         }
-        out << "total " << total_blocks << "\n";
+        out << "total " << total_blocks << lineEnd();
     }
     
     for (const auto& file : files) {
         displaySingleFileLong(file, widths, out);
-        out << "\n";
+        out << lineEnd();
     }
 }
 
 void DisplayFormatter::displaySingleFileLong(const FileInfo& file, const LongFormatWidths& widths, std::ostream& out) const {
+    // Leading columns are never colored
+    resetColor(out);
+    
+    if (file.attributesUnknown()) {
+        displayUnknownLong(file, widths, out);
+        return;
+    }
+    
     // Inode number
     if (m_options.show_inode) {
         out << std::setw(widths.inode_width) << std::right << file.inode << " ";
@@ -72,30 +100,28 @@ void DisplayFormatter::displaySingleFileLong(const FileInfo& file, const LongFor
     
     // File permissions
     if (m_options.use_color) {
-        out << formatColoredPermissions(file.mode) << " ";
+        writeColoredPermissions(file.mode, out);
     } else {
-        out << formatPermissions(file.mode) << " ";
+        out << formatPermissions(file.mode);
+    }
+    if (widths.acl_marks) {
+        out << (file.has_acl ? '+' : ' ');
     }
+    out << " ";
     
     // Number of hard links
     out << std::setw(widths.links_width) << std::right << file.hard_links << " ";
     
     // Owner
     if (m_options.numeric_uid_gid) {
-        struct stat st;
-        if (stat(file.path.c_str(), &st) == 0) {
-            out << std::setw(widths.owner_width) << std::left << st.st_uid << " ";
-        }
+        out << std::setw(widths.owner_width) << std::left << file.uid << " ";
     } else {
         out << std::setw(widths.owner_width) << std::left << file.owner << " ";
     }
     
     // Group (unless -G option)
     if (m_options.numeric_uid_gid) {
-        struct stat st;
-        if (stat(file.path.c_str(), &st) == 0) {
-            out << std::setw(widths.group_width) << std::left << st.st_gid << " ";
-        }
+        out << std::setw(widths.group_width) << std::left << file.gid << " ";
     } else {
         out << std::setw(widths.group_width) << std::left << file.group << " ";
     }
@@ -128,50 +154,86 @@ void DisplayFormatter::displaySingleFileLong(const FileInfo& file, const LongFor
     out << formatTime(time_to_show, m_options.time_style) << " ";
     
     // File name with icon and color
-    out << getIconAndColor(file) << formatFileName(file);
+    writeIconAndName(file, formatFileName(file), out);
     
     // SELinux context
     if (m_options.show_context && !file.selinux_context.empty()) {
         out << " " << file.selinux_context;
     }
     
-    resetColor(out);
+    // Extended attribute names
+    if (m_options.show_xattrs && !file.xattr_names.empty()) {
+        out << " [";
+        for (size_t i = 0; i < file.xattr_names.size(); ++i) {
+            out << (i ? "," : "") << file.xattr_names[i];
+        }
+        out << "]";
+    }
+}
+
+void DisplayFormatter::displayUnknownLong(const FileInfo& file, const LongFormatWidths& widths, std::ostream& out) const {
+    // Same columns as displaySingleFileLong, with ? for every attribute
+    if (m_options.show_inode) {
+        out << std::setw(widths.inode_width) << std::right << "?" << " ";
+    }
+    if (m_options.show_size) {
+        out << std::setw(widths.blocks_width) << std::right << "?" << " ";
+    }
+    out << formatPermissions(file.mode) << (widths.acl_marks ? "  " : " ");
+    out << std::setw(widths.links_width) << std::right << "?" << " ";
+    out << std::setw(widths.owner_width) << std::left << "?" << " ";
+    out << std::setw(widths.group_width) << std::left << "?" << " ";
+    out << std::setw(widths.size_width) << std::right << "?" << " ";
+    size_t time_width = formatTime(std::chrono::system_clock::now(), m_options.time_style).length();
+    out << std::setw(time_width) << std::left << "?" << " ";
+    
+    writeIconAndName(file, formatFileName(file), out);
 }
 
 void DisplayFormatter::displayColumnar(const std::vector<FileInfo>& files, std::ostream& out) {
+    displayGrid(files, true, out);
+}
+
+void DisplayFormatter::displayGrid(const std::vector<FileInfo>& files, bool by_columns, std::ostream& out) {
     if (files.empty()) return;
     
     int terminal_width = m_options.width > 0 ? m_options.width : getTerminalWidth();
-    ColumnLayout layout = calculateLayout(files, terminal_width);
-    
-    std::vector<std::string> formatted_names = formatFilesForLayout(files);
+    std::vector<FormattedName> formatted_names = formatFilesForLayout(files);
+    ColumnLayout layout = calculateLayout(formatted_names, terminal_width, by_columns);
+    size_t prefix_width = entryPrefixWidth();
     
     for (size_t row = 0; row < layout.rows; ++row) {
+        size_t pos = 0;
+        size_t col_start = 0;
+        
         for (size_t col = 0; col < layout.cols; ++col) {
-            size_t index = col * layout.rows + row;
+            size_t index = by_columns ? col * layout.rows + row : row * layout.cols + col;
+            if (index >= files.size()) {
+                break;
+            }
             
-            if (index < files.size()) {
-                // Show inode if requested
-                if (m_options.show_inode) {
-                    out << std::setw(8) << files[index].inode << " ";
-                }
-                
-                // Show block size if requested
-                if (m_options.show_size) {
-                    off_t blocks = (files[index].size + 1023) / 1024;
-                    out << std::setw(6) << blocks << " ";
-                }
-                
-                out << getIconAndColor(files[index]) << formatted_names[index];
+            if (col > 0) {
+                indent(pos, col_start, out);
+                pos = col_start;
+            }
+            
+            // Show inode if requested
+            if (m_options.show_inode) {
                 resetColor(out);
-                
-                // Add padding except for last column
-                if (col < layout.cols - 1) {
-                    size_t name_width = getDisplayWidth(formatted_names[index]);
-                    size_t padding = layout.col_widths[col] + 2 - name_width;
-                    out << std::string(padding, ' ');
-                }
+                out << std::setw(8) << files[index].inode << " ";
             }
+            
+            // Show block size if requested
+            if (m_options.show_size) {
+                resetColor(out);
+                off_t blocks = (files[index].size + 1023) / 1024;
+                out << std::setw(6) << blocks << " ";
+            }
+            
+            writeIconAndName(files[index], formatted_names[index].text, out);
+            
+            pos += prefix_width + formatted_names[index].width;
+            col_start += layout.col_widths[col] + COLUMN_SEPARATOR_WIDTH;
         }
         out << "\n";
     }
@@ -179,21 +241,169 @@ void DisplayFormatter::displayColumnar(const std::vector<FileInfo>& files, std::
 
 void DisplayFormatter::displayOnePerLine(const std::vector<FileInfo>& files, std::ostream& out) {
     for (const auto& file : files) {
-        // Show inode if requested
-        if (m_options.show_inode) {
-            out << std::setw(8) << file.inode << " ";
+        displayOneLine(file, out);
+    }
+}
+
+void DisplayFormatter::displayOneLine(const FileInfo& file, std::ostream& out) const {
+    // Show inode if requested
+    if (m_options.show_inode) {
+        resetColor(out);
+        out << std::setw(8) << file.inode << " ";
+    }
+    
+    // Show block size if requested
+    if (m_options.show_size) {
+        resetColor(out);
+        off_t blocks = (file.size + 1023) / 1024;
+        out << std::setw(6) << blocks << " ";
+    }
+    
+    writeIconAndName(file, formatFileName(file), out);
+    out << lineEnd();
+}
+
+void DisplayFormatter::displayRecords(const std::vector<FileInfo>& files, std::ostream& out) const {
+    RecordWriter writer(out, m_options.format, lineEnd(), RecordWriter::extras(m_options));
+    writer.begin();
+    for (const auto& file : files) {
+        writer.write(file);
+    }
+    writer.end();
+}
+
+void DisplayFormatter::beginStream(std::ostream& out) {
+    m_stream_widths = LongFormatWidths();
+    m_stream_blocks = 0;
+    m_streamed = 0;
+    m_stream_measured = 0;
+    m_stream_cell = 0;
+    m_stream_cols = 0;
+    m_stream_pos = 0;
+    m_stream_records.reset();
+    if (isRecordFormat(m_options.format)) {
+        m_stream_records = std::make_unique<RecordWriter>(out, m_options.format, lineEnd(),
+                                                          RecordWriter::extras(m_options));
+        m_stream_records->begin();
+    }
+}
+
+bool DisplayFormatter::isGridFormat() const {
+    return m_options.format == ListFormat::COLUMNS || m_options.format == ListFormat::VERTICAL ||
+           m_options.format == ListFormat::ACROSS;
+}
+
+bool DisplayFormatter::streamNeedsMeasure() const {
+    return m_options.format == ListFormat::LONG || isGridFormat();
+}
+
+void DisplayFormatter::measure(const std::vector<FileInfo>& files) {
+    if (isGridFormat()) {
+        for (const auto& name : formatFilesForLayout(files)) {
+            m_stream_cell = std::max(m_stream_cell, name.width);
         }
-        
-        // Show block size if requested
-        if (m_options.show_size) {
-            off_t blocks = (file.size + 1023) / 1024;
-            out << std::setw(6) << blocks << " ";
+        m_stream_measured += files.size();
+        return;
+    }
+    for (const auto& file : files) {
+        widenFor(file, m_stream_widths);
+        m_stream_blocks += (file.size + 1023) / 1024;
+    }
+}
+
+void DisplayFormatter::streamFiles(const std::vector<FileInfo>& files, std::ostream& out) {
+    for (const auto& file : files) {
+        if (m_stream_records) {
+            m_stream_records->write(file);
+        } else if (m_options.format == ListFormat::LONG) {
+            // As displayLongFormat, the total comes first
+            if (m_streamed == 0 && m_options.show_size) {
+                out << "total " << m_stream_blocks << lineEnd();
+            }
+            displaySingleFileLong(file, m_stream_widths, out);
+            out << lineEnd();
+        } else if (m_options.format == ListFormat::COMMAS) {
+            if (m_streamed > 0) {
+                out << ", ";
+            }
+            writeIconAndName(file, formatFileName(file), out);
+        } else if (isGridFormat() && m_stream_measured > 0) {
+            streamGridEntry(file, out);
+        } else {
+            displayOneLine(file, out);
         }
-        
-        out << getIconAndColor(file) << formatFileName(file);
+        ++m_streamed;
+    }
+}
+
+void DisplayFormatter::streamGridEntry(const FileInfo& file, std::ostream& out) {
+    size_t prefix_width = entryPrefixWidth();
+    size_t column_width = prefix_width + m_stream_cell;
+    if (m_stream_cols == 0) {
+        // As many columns of the widest entry as fit, separators included
+        int terminal_width = m_options.width > 0 ? m_options.width : getTerminalWidth();
+        size_t line_width = terminal_width > 0 ? static_cast<size_t>(terminal_width) : 1;
+        m_stream_cols = std::max<size_t>(1, (line_width + COLUMN_SEPARATOR_WIDTH) /
+                                                (column_width + COLUMN_SEPARATOR_WIDTH));
+        m_stream_cols = std::min(m_stream_cols, m_stream_measured);
+    }
+    
+    size_t col = m_streamed % m_stream_cols;
+    if (col > 0) {
+        size_t col_start = col * (column_width + COLUMN_SEPARATOR_WIDTH);
+        indent(m_stream_pos, col_start, out);
+        m_stream_pos = col_start;
+    }
+    if (m_options.show_inode) {
         resetColor(out);
+        out << std::setw(8) << file.inode << " ";
+    }
+    if (m_options.show_size) {
+        resetColor(out);
+        off_t blocks = (file.size + 1023) / 1024;
+        out << std::setw(6) << blocks << " ";
+    }
+    std::string text = formatFileName(file);
+    writeIconAndName(file, text, out);
+    m_stream_pos += prefix_width + DisplayWidth::measure(m_icon_provider.getIconAndColor(file).first) + 1 +
+                    DisplayWidth::measure(text);
+    
+    if (col + 1 == m_stream_cols) {
+        out << "\n";
+        m_stream_pos = 0;
+    }
+}
+
+void DisplayFormatter::streamEntry(const FileInfo& file, std::ostream& out) {
+    std::ostringstream line;
+    if (m_options.format == ListFormat::LONG) {
+        displaySingleFileLong(file, m_stream_widths, line);
+    } else {
+        displayOneLine(file, line);
+    }
+    // Ends with the attributes reset, so the line can be drawn anywhere
+    resetColor(line);
+    
+    std::string text = line.str();
+    if (!text.empty() && text.back() == lineEnd()) {
+        text.pop_back();
+    }
+    out << text;
+}
+
+void DisplayFormatter::endStream(std::ostream& out) {
+    if (m_stream_records) {
+        m_stream_records->end();
+        m_stream_records.reset();
+        return;
+    }
+    if (m_options.format == ListFormat::COMMAS && m_streamed > 0) {
+        out << "\n";
+    }
+    if (m_stream_cols > 0 && m_streamed % m_stream_cols != 0) {
         out << "\n";
     }
+    resetColor(out);
 }
 
 void DisplayFormatter::displayCommaSeparated(const std::vector<FileInfo>& files, std::ostream& out) {
@@ -202,52 +412,13 @@ void DisplayFormatter::displayCommaSeparated(const std::vector<FileInfo>& files,
             out << ", ";
         }
         
-        out << getIconAndColor(files[i]) << formatFileName(files[i]);
-        resetColor(out);
+        writeIconAndName(files[i], formatFileName(files[i]), out);
     }
     out << "\n";
 }
 
 void DisplayFormatter::displayAcross(const std::vector<FileInfo>& files, std::ostream& out) {
-    if (files.empty()) return;
-    
-    int terminal_width = m_options.width > 0 ? m_options.width : getTerminalWidth();
-    std::vector<std::string> formatted_names = formatFilesForLayout(files);
-    
-    // Calculate maximum width needed
-    size_t max_width = 0;
-    for (const auto& name : formatted_names) {
-        max_width = std::max<size_t>(max_width, getDisplayWidth(name));
-    }
-    
-    size_t cols_per_row = std::max<size_t>(1, terminal_width / (max_width + 2));
-    
-    for (size_t i = 0; i < files.size(); ++i) {
-        if (i > 0 && i % cols_per_row == 0) {
-            out << "\n";
-        }
-        
-        // Show inode if requested
-        if (m_options.show_inode) {
-            out << std::setw(8) << files[i].inode << " ";
-        }
-        
-        // Show block size if requested
-        if (m_options.show_size) {
-            off_t blocks = (files[i].size + 1023) / 1024;
-            out << std::setw(6) << blocks << " ";
-        }
-        
-        out << getIconAndColor(files[i]) << formatted_names[i];
-        resetColor(out);
-        
-        // Add padding except for last item in row
-        if ((i + 1) % cols_per_row != 0 && i + 1 < files.size()) {
-            size_t padding = max_width + 2 - getDisplayWidth(formatted_names[i]);
-            out << std::string(padding, ' ');
-        }
-    }
-    out << "\n";
+    displayGrid(files, false, out);
 }
 
 std::string DisplayFormatter::formatFileName(const FileInfo& file) const {
@@ -354,7 +525,11 @@ std::string DisplayFormatter::formatTime(const std::chrono::system_clock::time_p
     return ss.str();
 }
 
-std::string DisplayFormatter::formatPermissions(mode_t mode) const {
+std::string DisplayFormatter::formatPermissions(mode_t mode) {
+    // No file type: the entry could not be stat'ed
+    if ((mode & S_IFMT) == 0) {
+        return "-?????????";
+    }
     std::string perms(10, '-');
     
     // File type
@@ -394,83 +569,58 @@ std::string DisplayFormatter::formatPermissions(mode_t mode) const {
     return perms;
 }
 
-std::string DisplayFormatter::formatColoredPermissions(mode_t mode) const {
-    std::string perms(10, '-');
-    std::string result;
-    
+void DisplayFormatter::writeColoredPermissions(mode_t mode, std::ostream& out) const {
     // Color codes for permissions
-    const std::string GREEN = "\033[32m";   // Green for read
-    const std::string YELLOW = "\033[33m";  // Yellow for write
-    const std::string RED = "\033[31m";     // Red for execute
-    const std::string RESET = "\033[m";     // Reset color
-    
-    // File type (no color)
-    if (S_ISDIR(mode)) perms[0] = 'd';
-    else if (S_ISLNK(mode)) perms[0] = 'l';
-    else if (S_ISBLK(mode)) perms[0] = 'b';
-    else if (S_ISCHR(mode)) perms[0] = 'c';
-    else if (S_ISFIFO(mode)) perms[0] = 'p';
-    else if (S_ISSOCK(mode)) perms[0] = 's';
-    
-    // Owner permissions
-    perms[1] = (mode & S_IRUSR) ? 'r' : '-';
-    perms[2] = (mode & S_IWUSR) ? 'w' : '-';
-    perms[3] = (mode & S_IXUSR) ? 'x' : '-';
-    
-    // Group permissions
-    perms[4] = (mode & S_IRGRP) ? 'r' : '-';
-    perms[5] = (mode & S_IWGRP) ? 'w' : '-';
-    perms[6] = (mode & S_IXGRP) ? 'x' : '-';
-    
-    // Other permissions
-    perms[7] = (mode & S_IROTH) ? 'r' : '-';
-    perms[8] = (mode & S_IWOTH) ? 'w' : '-';
-    perms[9] = (mode & S_IXOTH) ? 'x' : '-';
-    
-    // Special bits
-    if (mode & S_ISUID) {
-        perms[3] = (mode & S_IXUSR) ? 's' : 'S';
-    }
-    if (mode & S_ISGID) {
-        perms[6] = (mode & S_IXGRP) ? 's' : 'S';
+    static const std::string GREEN = "\033[32m";   // Green for read
+    static const std::string YELLOW = "\033[33m";  // Yellow for write
+    static const std::string RED = "\033[31m";     // Red for execute
+    static const std::string NONE;
+    
+    std::string perms = formatPermissions(mode);
+    
+    // Only color transitions are written, so runs like "--" or two adjacent
+    // read bits share a single sequence
+    for (size_t i = 0; i < perms.size(); ++i) {
+        char c = perms[i];
+        const std::string* color = &NONE;
+        
+        if (i > 0 && c != '-') {
+            switch (i % 3) {
+                case 1: color = &GREEN; break;
+                case 2: color = &YELLOW; break;
+                case 0: color = (c == 'S' || c == 'T') ? &NONE : &RED; break;
+            }
+        }
+        
+        m_emitter.setColor(out, *color);
+        out << c;
     }
-    if (mode & S_ISVTX) {
-        perms[9] = (mode & S_IXOTH) ? 't' : 'T';
+}
+
+void DisplayFormatter::writeIconAndName(const FileInfo& file, const std::string& name, std::ostream& out) const {
+    // NUL-terminated names are read by programs, which want them bare
+    if (m_options.zero) {
+        out << name;
+        return;
     }
     
-    // Apply colors to each character
-    result += perms[0]; // File type without color
-    
-    // Owner permissions
-    result += (perms[1] != '-') ? GREEN + perms[1] + RESET : std::string(1, perms[1]);
-    result += (perms[2] != '-') ? YELLOW + perms[2] + RESET : std::string(1, perms[2]);
-    result += (perms[3] != '-' && perms[3] != 'S') ? RED + perms[3] + RESET : std::string(1, perms[3]);
+    const auto& [icon, color] = m_icon_provider.getIconAndColor(file);
     
-    // Group permissions
-    result += (perms[4] != '-') ? GREEN + perms[4] + RESET : std::string(1, perms[4]);
-    result += (perms[5] != '-') ? YELLOW + perms[5] + RESET : std::string(1, perms[5]);
-    result += (perms[6] != '-' && perms[6] != 'S') ? RED + perms[6] + RESET : std::string(1, perms[6]);
-    
-    // Other permissions
-    result += (perms[7] != '-') ? GREEN + perms[7] + RESET : std::string(1, perms[7]);
-    result += (perms[8] != '-') ? YELLOW + perms[8] + RESET : std::string(1, perms[8]);
-    result += (perms[9] != '-' && perms[9] != 'T') ? RED + perms[9] + RESET : std::string(1, perms[9]);
-    
-    return result;
-}
-
-std::string DisplayFormatter::getIconAndColor(const FileInfo& file) const {
-    if (!m_options.use_color) {
-        return m_icon_provider.getIcon(file) + " ";
+    if (m_options.use_color) {
+        m_emitter.setColor(out, color);
     }
+    out << icon << ' ' << name;
     
-    auto [icon, color] = m_icon_provider.getIconAndColor(file);
-    return color + icon + " ";
+    // Keep the color active across padding when it does not show on spaces,
+    // so the next entry of the same color needs no new sequence
+    if (m_options.use_color) {
+        m_emitter.endCell(out);
+    }
 }
 
 void DisplayFormatter::resetColor(std::ostream& out) const {
     if (m_options.use_color) {
-        out << IconProvider::RESET_COLOR;
+        m_emitter.reset(out);
     }
 }
 
@@ -502,56 +652,116 @@ std::string DisplayFormatter::quoteFileName(const std::string& name) const {
     return "\"" + name + "\"";
 }
 
-DisplayFormatter::ColumnLayout DisplayFormatter::calculateLayout(const std::vector<FileInfo>& files, int terminal_width) const {
-    if (files.empty()) {
+DisplayFormatter::ColumnLayout DisplayFormatter::calculateLayout(const std::vector<FormattedName>& names, int terminal_width, bool by_columns) const {
+    if (names.empty()) {
         return {0, 0, {}, 0};
     }
     
-    std::vector<std::string> formatted_names = formatFilesForLayout(files);
-    std::vector<size_t> name_widths;
+    // Track every candidate column count at once, in a single pass over the
+    // precomputed widths (the approach GNU ls takes). No layout can have more
+    // columns than fit at the minimum column width, which bounds the work to
+    // O(names * max_cols).
+    size_t line_width = terminal_width > 0 ? static_cast<size_t>(terminal_width) : 1;
+    size_t prefix_width = entryPrefixWidth();
+    size_t min_col_width = MIN_COLUMN_WIDTH + prefix_width;
+    size_t total_files = names.size();
+    size_t max_cols = std::max<size_t>(1, line_width / min_col_width + (line_width % min_col_width != 0));
+    max_cols = std::min(max_cols, total_files);
+    
+    struct Candidate {
+        bool valid;
+        size_t line_len;
+        std::vector<size_t> col_arr;  // column widths including separators
+    };
+    
+    std::vector<Candidate> candidates(max_cols);
+    for (size_t i = 0; i < max_cols; ++i) {
+        candidates[i].valid = true;
+        candidates[i].line_len = (i + 1) * min_col_width;
+        candidates[i].col_arr.assign(i + 1, min_col_width);
+    }
+    
+    for (size_t file_index = 0; file_index < total_files; ++file_index) {
+        size_t name_length = names[file_index].width + prefix_width;
+        
+        for (size_t i = 0; i < max_cols; ++i) {
+            Candidate& candidate = candidates[i];
+            if (!candidate.valid) {
+                continue;
+            }
+            
+            size_t cols = i + 1;
+            size_t rows = (total_files + cols - 1) / cols;
+            size_t idx = by_columns ? file_index / rows : file_index % cols;
+            size_t real_length = name_length + (idx == i ? 0 : COLUMN_SEPARATOR_WIDTH);
+            
+            if (candidate.col_arr[idx] < real_length) {
+                candidate.line_len += real_length - candidate.col_arr[idx];
+                candidate.col_arr[idx] = real_length;
+                candidate.valid = candidate.line_len <= line_width;
+            }
+        }
+    }
+    
+    // Widest layout that still fits; a single column always "fits"
+    size_t cols = max_cols;
+    while (cols > 1 && !candidates[cols - 1].valid) {
+        --cols;
+    }
+    size_t rows = (total_files + cols - 1) / cols;
     
-    for (const auto& name : formatted_names) {
-        name_widths.push_back(getDisplayWidth(name));
+    // Real column widths, without the minimum-width seeding
+    std::vector<size_t> col_widths(cols, 0);
+    for (size_t file_index = 0; file_index < total_files; ++file_index) {
+        size_t col = by_columns ? file_index / rows : file_index % cols;
+        col_widths[col] = std::max(col_widths[col], names[file_index].width + prefix_width);
     }
     
-    size_t total_files = files.size();
-    ColumnLayout best_layout = {total_files, 1, {*std::max_element(name_widths.begin(), name_widths.end())}, 0};
+    size_t total_width = 0;
+    for (size_t w : col_widths) {
+        total_width += w + COLUMN_SEPARATOR_WIDTH;
+    }
+    total_width -= COLUMN_SEPARATOR_WIDTH;
     
-    // Try different numbers of rows
-    for (size_t rows = 1; rows <= total_files; ++rows) {
-        size_t cols = (total_files + rows - 1) / rows;
-        std::vector<size_t> col_widths(cols, 0);
-        
-        // Calculate column widths
-        for (size_t i = 0; i < total_files; ++i) {
-            size_t col = i / rows;
-            if (col < cols) {
-                col_widths[col] = std::max(col_widths[col], name_widths[i]);
-            }
-        }
-        
-        // Calculate total width
-        size_t total_width = 0;
-        for (size_t w : col_widths) {
-            total_width += w + 2; // 2 spaces between columns
-        }
-        total_width -= 2; // No trailing spaces
-        
-        if (total_width <= static_cast<size_t>(terminal_width)) {
-            best_layout = {rows, cols, col_widths, total_width};
-            break;
+    return {rows, cols, col_widths, total_width};
+}
+
+size_t DisplayFormatter::entryPrefixWidth() const {
+    size_t width = 0;
+    if (m_options.show_inode) {
+        width += 9;
+    }
+    if (m_options.show_size) {
+        width += 7;
+    }
+    return width;
+}
+
+void DisplayFormatter::indent(size_t from, size_t to, std::ostream& out) const {
+    // Pad with tabs where a tab stop lies in the gap, as ls -T does
+    size_t tab_size = m_options.tab_size > 0 ? static_cast<size_t>(m_options.tab_size) : 0;
+    
+    while (from < to) {
+        if (tab_size != 0 && to / tab_size > (from + 1) / tab_size) {
+            out << '\t';
+            from += tab_size - from % tab_size;
+        } else {
+            out << ' ';
+            from++;
         }
     }
-    
-    return best_layout;
 }
 
-std::vector<std::string> DisplayFormatter::formatFilesForLayout(const std::vector<FileInfo>& files) const {
-    std::vector<std::string> formatted_names;
+std::vector<DisplayFormatter::FormattedName> DisplayFormatter::formatFilesForLayout(const std::vector<FileInfo>& files) const {
+    std::vector<FormattedName> formatted_names;
     formatted_names.reserve(files.size());
     
     for (const auto& file : files) {
-        formatted_names.push_back(formatFileName(file));
+        // Icon, separating space, then the name, all measured before coloring
+        std::string text = formatFileName(file);
+        size_t width = DisplayWidth::measure(m_icon_provider.getIconAndColor(file).first) + 1 +
+                       DisplayWidth::measure(text);
+        formatted_names.push_back({std::move(text), width});
     }
     
     return formatted_names;
@@ -559,33 +769,36 @@ std::vector<std::string> DisplayFormatter::formatFilesForLayout(const std::vecto
 
 DisplayFormatter::LongFormatWidths DisplayFormatter::calculateLongFormatWidths(const std::vector<FileInfo>& files) const {
     LongFormatWidths widths;
-    
     for (const auto& file : files) {
-        if (m_options.show_inode) {
-            widths.inode_width = std::max(widths.inode_width, std::to_string(file.inode).length());
-        }
-        
-        if (m_options.show_size) {
-            off_t blocks = (file.size + 1023) / 1024;
-            widths.blocks_width = std::max(widths.blocks_width, std::to_string(blocks).length());
-        }
-        
-        widths.links_width = std::max(widths.links_width, std::to_string(file.hard_links).length());
-        widths.owner_width = std::max(widths.owner_width, file.owner.length());
-        widths.group_width = std::max(widths.group_width, file.group.length());
-        
-        std::string size_str;
-        if (m_options.human_readable) {
-            size_str = formatFileSize(file.size, true, m_options.si_units);
-        } else {
-            size_str = std::to_string(file.size);
-        }
-        widths.size_width = std::max(widths.size_width, size_str.length());
+        widenFor(file, widths);
     }
-    
     return widths;
 }
 
+void DisplayFormatter::widenFor(const FileInfo& file, LongFormatWidths& widths) const {
+    if (m_options.show_inode) {
+        widths.inode_width = std::max(widths.inode_width, std::to_string(file.inode).length());
+    }
+    
+    if (m_options.show_size) {
+        off_t blocks = (file.size + 1023) / 1024;
+        widths.blocks_width = std::max(widths.blocks_width, std::to_string(blocks).length());
+    }
+    
+    widths.links_width = std::max(widths.links_width, std::to_string(file.hard_links).length());
+    widths.acl_marks = widths.acl_marks || (m_options.show_acl && file.has_acl);
+    widths.owner_width = std::max(widths.owner_width, file.owner.length());
+    widths.group_width = std::max(widths.group_width, file.group.length());
+    
+    std::string size_str;
+    if (m_options.human_readable) {
+        size_str = formatFileSize(file.size, true, m_options.si_units);
+    } else {
+        size_str = std::to_string(file.size);
+    }
+    widths.size_width = std::max(widths.size_width, size_str.length());
+}
+
 int DisplayFormatter::getTerminalWidth() {
     struct winsize w;
     if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0 && w.ws_col > 0) {
@@ -595,43 +808,5 @@ int DisplayFormatter::getTerminalWidth() {
 }
 
 size_t DisplayFormatter::getDisplayWidth(const std::string& str) {
-    // First, remove ANSI escape sequences
-    std::string clean_str = str;
-    size_t pos = 0;
-    while ((pos = clean_str.find("\033[", pos)) != std::string::npos) {
-        size_t end_pos = clean_str.find('m', pos);
-        if (end_pos != std::string::npos) {
-            clean_str.erase(pos, end_pos - pos + 1);
-        } else {
-            // If we can't find the end of the escape sequence, remove everything from pos to the end
-            clean_str.erase(pos);
-            break;
-        }
-    }
-    
-    // Now calculate the width of the cleaned string
-    size_t width = 0;
-    const char* ptr = clean_str.c_str();
-    size_t remaining = clean_str.size();
-    std::mbstate_t state = std::mbstate_t();
-    
-    while (remaining > 0) {
-        wchar_t wc;
-        size_t len = std::mbrtowc(&wc, ptr, remaining, &state);
-        
-        if (len == static_cast<size_t>(-1) || len == static_cast<size_t>(-2)) {
-            // Invalid sequence, count as 1
-            width += remaining;
-            break;
-        } else if (len == 0) {
-            len = 1;
-        }
-        
-        int w = wcwidth(wc);
-        width += (w >= 0) ? static_cast<size_t>(w) : 1;
-        ptr += len;
-        remaining -= len;
-    }
-    
-    return width;
+    return DisplayWidth::measureStyled(str);
 }
\ No newline at end of file
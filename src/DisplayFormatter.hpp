@@ -3,13 +3,18 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <memory>
 #include "ArgumentParser.hpp"
 #include "FileOperations.hpp"
 #include "IconProvider.hpp"
+#include "ColorEmitter.hpp"
+#include "RecordWriter.hpp"
 
 class DisplayFormatter {
 public:
     DisplayFormatter(const LsOptions& options);
+    // Shares an already built icon table (and its classification memo)
+    DisplayFormatter(const LsOptions& options, IconProvider& icon_provider);
     
     void displayFiles(const std::vector<FileInfo>& files, std::ostream& out = std::cout);
     void displayLongFormat(const std::vector<FileInfo>& files, std::ostream& out = std::cout);
@@ -18,24 +23,61 @@ public:
     void displayCommaSeparated(const std::vector<FileInfo>& files, std::ostream& out = std::cout);
     void displayAcross(const std::vector<FileInfo>& files, std::ostream& out = std::cout);
     
+    // A listing handed over in batches rather than as one vector (record
+    // formats across groups, --max-memory): -l columns are sized by
+    // measure()ing every entry before the first streamFiles(). Grids are
+    // measured too and laid out across (as -x) in columns of one width,
+    // since a layout down the columns needs every entry at once
+    void beginStream(std::ostream& out = std::cout);
+    bool streamNeedsMeasure() const;
+    void measure(const std::vector<FileInfo>& files);
+    void streamFiles(const std::vector<FileInfo>& files, std::ostream& out = std::cout);
+    void endStream(std::ostream& out = std::cout);
+    
+    // Column widths of -l, from every entry measured
+    struct LongFormatWidths {
+        size_t inode_width = 0;
+        size_t blocks_width = 0;
+        size_t links_width = 0;
+        size_t owner_width = 0;
+        size_t group_width = 0;
+        size_t size_width = 0;
+        size_t date_width = 0;
+        bool acl_marks = false;     // some entry has an ACL: permissions get a 11th column
+        
+        bool operator==(const LongFormatWidths&) const = default;
+    };
+    
+    // One entry of the stream as a line of its own, with neither the -l
+    // total nor a line end, so --watch can redraw entries one at a time;
+    // such lines stay valid while streamWidths() does
+    void streamEntry(const FileInfo& file, std::ostream& out);
+    const LongFormatWidths& streamWidths() const { return m_stream_widths; }
+    off_t streamBlocks() const { return m_stream_blocks; }
+    
     static int getTerminalWidth();
     static size_t getDisplayWidth(const std::string& str);
+    static std::string formatPermissions(mode_t mode);
     
 private:
     const LsOptions& m_options;
-    IconProvider m_icon_provider;
+    std::unique_ptr<IconProvider> m_owned_icon_provider;
+    IconProvider& m_icon_provider;
+    mutable ColorEmitter m_emitter;
     
     std::string formatFileName(const FileInfo& file) const;
     std::string formatFileSize(off_t size, bool human_readable = false, bool si_units = false) const;
     std::string formatTime(const std::chrono::system_clock::time_point& time, const std::string& style = "locale") const;
-    std::string formatPermissions(mode_t mode) const;
-    std::string formatColoredPermissions(mode_t mode) const;
+    void writeColoredPermissions(mode_t mode, std::ostream& out) const;
     std::string formatInode(ino_t inode) const;
     std::string formatBlockSize(off_t size, const std::string& block_size = "1024") const;
     
     std::string getColorCode(const FileInfo& file) const;
-    std::string getIconAndColor(const FileInfo& file) const;
+    void writeIconAndName(const FileInfo& file, const std::string& name, std::ostream& out) const;
     void resetColor(std::ostream& out) const;
+    void displayRecords(const std::vector<FileInfo>& files, std::ostream& out) const;
+    char lineEnd() const { return m_options.zero ? '\0' : '\n'; }
+    void displayOneLine(const FileInfo& file, std::ostream& out) const;
     
     std::string escapeFileName(const std::string& name) const;
     std::string quoteFileName(const std::string& name) const;
@@ -48,23 +90,43 @@ private:
         size_t total_width;
     };
     
-    ColumnLayout calculateLayout(const std::vector<FileInfo>& files, int terminal_width) const;
-    std::vector<std::string> formatFilesForLayout(const std::vector<FileInfo>& files) const;
+    // A formatted name together with its measured cell width (icon included),
+    // computed once per entry and shared by layout and rendering
+    struct FormattedName {
+        std::string text;
+        size_t width;
+    };
+    
+    // Smallest column: one-cell icon, space, one-cell name, then the separator
+    static constexpr size_t COLUMN_SEPARATOR_WIDTH = 2;
+    static constexpr size_t MIN_COLUMN_WIDTH = 3 + COLUMN_SEPARATOR_WIDTH;
+    
+    ColumnLayout calculateLayout(const std::vector<FormattedName>& names, int terminal_width, bool by_columns = true) const;
+    std::vector<FormattedName> formatFilesForLayout(const std::vector<FileInfo>& files) const;
+    void displayGrid(const std::vector<FileInfo>& files, bool by_columns, std::ostream& out);
+    size_t entryPrefixWidth() const;
+    void indent(size_t from, size_t to, std::ostream& out) const;
     
     // Long format helpers
     void displayLongHeader(const std::vector<FileInfo>& files, std::ostream& out) const;
     size_t calculateMaxWidths(const std::vector<FileInfo>& files) const;
     
-    struct LongFormatWidths {
-        size_t inode_width = 0;
-        size_t blocks_width = 0;
-        size_t links_width = 0;
-        size_t owner_width = 0;
-        size_t group_width = 0;
-        size_t size_width = 0;
-        size_t date_width = 0;
-    };
-    
     LongFormatWidths calculateLongFormatWidths(const std::vector<FileInfo>& files) const;
+    void widenFor(const FileInfo& file, LongFormatWidths& widths) const;
     void displaySingleFileLong(const FileInfo& file, const LongFormatWidths& widths, std::ostream& out) const;
+    // An entry --timeout gave up on: name only, ? in the other columns
+    void displayUnknownLong(const FileInfo& file, const LongFormatWidths& widths, std::ostream& out) const;
+    
+    // State of the current stream
+    LongFormatWidths m_stream_widths;
+    off_t m_stream_blocks = 0;
+    size_t m_streamed = 0;
+    size_t m_stream_measured = 0;
+    size_t m_stream_cell = 0;       // grids: widest icon and name measured
+    size_t m_stream_cols = 0;       // grids: columns per line, set by the first entry
+    size_t m_stream_pos = 0;        // grids: width written on the current line
+    std::unique_ptr<RecordWriter> m_stream_records;
+    
+    bool isGridFormat() const;
+    void streamGridEntry(const FileInfo& file, std::ostream& out);
 };
\ No newline at end of file
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// Terminal cell width of UTF-8 text, independent of the process locale.
+// Pure-ASCII runs are counted with a vectorized scan; everything else is
+// decoded and looked up in a built-in East Asian Width / emoji table.
+class DisplayWidth {
+public:
+    // Width of plain text (no escape sequences)
+    static size_t measure(std::string_view text);
+
+    // Width of text that may contain ANSI SGR sequences, which take no cells
+    static size_t measureStyled(std::string_view text);
+
+    // Cells taken by a single code point: 0, 1 or 2
+    static int codepointWidth(char32_t cp);
+
+    // Nerd Font icons live in the private use areas and render one cell wide
+    static constexpr int ICON_WIDTH = 1;
+
+private:
+    static size_t asciiPrefix(const char* data, size_t size);
+    static size_t decodeUtf8(const char* data, size_t size, char32_t& cp);
+};
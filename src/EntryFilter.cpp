@@ -0,0 +1,307 @@
+#include "EntryFilter.hpp"
+#include "FileOperations.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <pwd.h>
+#include <sys/stat.h>
+
+namespace {
+
+int64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Parses all of text as a non-negative integer in the given base
+bool parseNumber(const std::string& text, int base, int64_t& value) {
+    if (text.empty()) {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    long long parsed = std::strtoll(text.c_str(), &end, base);
+    if (errno != 0 || *end != '\0' || parsed < 0 || text[0] == '-' || text[0] == '+') {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+} // namespace
+
+bool EntryFilter::isFilterOption(const std::string& option) {
+    return option == "newer" || option == "older" || option == "min-size" || option == "max-size" ||
+           option == "type" || option == "owner" || option == "perm" || option == "empty";
+}
+
+bool EntryFilter::add(const std::string& option, const std::string& value, std::string& error) {
+    error.clear();
+
+    if (option == "empty") {
+        append(Op::EMPTY, 0);
+        return true;
+    }
+    if (value.empty()) {
+        error = "option '--" + option + "' requires an argument";
+        return false;
+    }
+
+    if (option == "newer" || option == "older") {
+        int64_t nsec;
+        if (!parseTime(value, nsec)) {
+            error = "invalid time '" + value + "' for '--" + option + "'";
+            return false;
+        }
+        append(option == "newer" ? Op::NEWER_THAN : Op::OLDER_THAN, nsec);
+    } else if (option == "min-size" || option == "max-size") {
+        int64_t bytes;
+        if (!parseSize(value, bytes)) {
+            error = "invalid size '" + value + "' for '--" + option + "'";
+            return false;
+        }
+        append(option == "min-size" ? Op::SIZE_AT_LEAST : Op::SIZE_AT_MOST, bytes);
+    } else if (option == "type") {
+        int64_t types = 0;
+        for (size_t i = 0; i < value.size(); ++i) {
+            mode_t format;
+            switch (value[i]) {
+                case 'f': format = S_IFREG; break;
+                case 'd': format = S_IFDIR; break;
+                case 'l': format = S_IFLNK; break;
+                case 'p': format = S_IFIFO; break;
+                case 's': format = S_IFSOCK; break;
+                case 'b': format = S_IFBLK; break;
+                case 'c': format = S_IFCHR; break;
+                case ',': continue;
+                default:
+                    error = "invalid type '" + value + "' for '--type' (use f, d, l, p, s, b, c)";
+                    return false;
+            }
+            types |= int64_t(1) << (format >> 12);
+        }
+        append(Op::TYPE_IN, types);
+    } else if (option == "owner") {
+        int64_t uid;
+        if (!parseNumber(value, 10, uid)) {
+            struct passwd* pw = getpwnam(value.c_str());
+            if (!pw) {
+                error = "invalid user '" + value + "' for '--owner'";
+                return false;
+            }
+            uid = pw->pw_uid;
+        }
+        append(Op::OWNED_BY, uid);
+    } else if (option == "perm") {
+        // As find -perm: MODE exactly, -MODE all of these bits, /MODE any of them
+        Op op = Op::PERM_EXACT;
+        std::string digits = value;
+        if (value[0] == '-' || value[0] == '/') {
+            op = value[0] == '-' ? Op::PERM_ALL : Op::PERM_ANY;
+            digits = value.substr(1);
+        }
+        int64_t bits;
+        if (!parseNumber(digits, 8, bits) || bits > 07777) {
+            error = "invalid mode '" + value + "' for '--perm' (octal, optionally after - or /)";
+            return false;
+        }
+        append(op, bits);
+    } else {
+        error = "unrecognized filter '--" + option + "'";
+        return false;
+    }
+    return true;
+}
+
+void EntryFilter::append(Op op, int64_t a) {
+    Instruction instruction{op, a};
+    // Keep the program ordered by cost; equal costs stay in command-line order
+    auto position = std::upper_bound(m_program.begin(), m_program.end(), instruction,
+                                     [](const Instruction& x, const Instruction& y) {
+                                         return fieldOf(x.op) < fieldOf(y.op);
+                                     });
+    m_program.insert(position, instruction);
+    m_needs |= fieldOf(op);
+    if (op == Op::EMPTY) {
+        // An empty file is one of size 0
+        m_needs |= TYPE | SIZE;
+    }
+}
+
+unsigned EntryFilter::fieldOf(Op op) {
+    switch (op) {
+        case Op::TYPE_IN: return TYPE;
+        case Op::SIZE_AT_LEAST:
+        case Op::SIZE_AT_MOST: return SIZE;
+        case Op::NEWER_THAN:
+        case Op::OLDER_THAN: return MTIME;
+        case Op::OWNED_BY: return OWNER;
+        case Op::PERM_EXACT:
+        case Op::PERM_ALL:
+        case Op::PERM_ANY: return PERMISSIONS;
+        case Op::EMPTY: return CONTENTS;
+    }
+    return CONTENTS;
+}
+
+bool EntryFilter::matches(const Subject& subject) const {
+    for (const auto& instruction : m_program) {
+        int64_t a = instruction.a;
+        bool pass;
+        switch (instruction.op) {
+            case Op::TYPE_IN:
+                pass = (a >> ((subject.mode & S_IFMT) >> 12)) & 1;
+                break;
+            case Op::SIZE_AT_LEAST:
+                pass = subject.size >= a;
+                break;
+            case Op::SIZE_AT_MOST:
+                pass = subject.size <= a;
+                break;
+            case Op::NEWER_THAN:
+                pass = subject.mtime_nsec > a;
+                break;
+            case Op::OLDER_THAN:
+                pass = subject.mtime_nsec < a;
+                break;
+            case Op::OWNED_BY:
+                pass = static_cast<int64_t>(subject.uid) == a;
+                break;
+            case Op::PERM_EXACT:
+                pass = static_cast<int64_t>(subject.mode & 07777) == a;
+                break;
+            case Op::PERM_ALL:
+                pass = (subject.mode & a) == a;
+                break;
+            case Op::PERM_ANY:
+                pass = a == 0 || (subject.mode & a) != 0;
+                break;
+            case Op::EMPTY:
+                pass = isEmpty(subject);
+                break;
+            default:
+                pass = false;
+                break;
+        }
+        if (!pass) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool EntryFilter::matches(const FileInfo& file) const {
+    Subject subject;
+    subject.mode = file.mode;
+    subject.size = file.size;
+    subject.mtime_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(file.mtime.time_since_epoch()).count();
+    subject.uid = file.uid;
+    subject.path = file.path.c_str();
+    return matches(subject);
+}
+
+bool EntryFilter::matches(const struct stat& st, const char* path) const {
+    Subject subject;
+    subject.mode = st.st_mode;
+    subject.size = st.st_size;
+    subject.mtime_nsec = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    subject.uid = st.st_uid;
+    subject.path = path;
+    return matches(subject);
+}
+
+bool EntryFilter::isEmpty(const Subject& subject) {
+    if (S_ISREG(subject.mode)) {
+        return subject.size == 0;
+    }
+    if (!S_ISDIR(subject.mode) || !subject.path) {
+        return false;
+    }
+
+    DIR* dir = opendir(subject.path);
+    if (!dir) {
+        return false;
+    }
+    bool empty = true;
+    while (struct dirent* entry = readdir(dir)) {
+        const char* name = entry->d_name;
+        if (!(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))) {
+            empty = false;
+            break;
+        }
+    }
+    closedir(dir);
+    return empty;
+}
+
+bool EntryFilter::parseTime(const std::string& value, int64_t& nsec) {
+    // An age: 30s, 15m, 12h, 7d or 2w ago
+    static const std::pair<char, int64_t> units[] = {
+        {'s', 1}, {'m', 60}, {'h', 3600}, {'d', 86400}, {'w', 7 * 86400}
+    };
+    for (const auto& [suffix, seconds] : units) {
+        int64_t count;
+        if (value.size() > 1 && value.back() == suffix &&
+            parseNumber(value.substr(0, value.size() - 1), 10, count)) {
+            // Ages that do not fit in nanoseconds are rejected rather than wrapped
+            if (count > INT64_MAX / (seconds * 1000000000LL)) {
+                return false;
+            }
+            nsec = nowNanoseconds() - count * seconds * 1000000000LL;
+            return true;
+        }
+    }
+
+    // A local date and time: YYYY-MM-DD, optionally followed by [T ]HH:MM[:SS]
+    struct tm parts{};
+    for (const char* format : {"%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M",
+                               "%Y-%m-%d %H:%M", "%Y-%m-%d"}) {
+        parts = {};
+        const char* end = strptime(value.c_str(), format, &parts);
+        if (end && *end == '\0') {
+            parts.tm_isdst = -1;
+            time_t seconds = mktime(&parts);
+            if (seconds > INT64_MAX / 1000000000LL || seconds < INT64_MIN / 1000000000LL) {
+                return false;
+            }
+            nsec = static_cast<int64_t>(seconds) * 1000000000LL;
+            return true;
+        }
+    }
+
+    // Otherwise the modification time of a reference file, as find -newer
+    struct stat st;
+    if (stat(value.c_str(), &st) == 0) {
+        nsec = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        return true;
+    }
+    return false;
+}
+
+bool EntryFilter::parseSize(const std::string& value, int64_t& bytes) {
+    // N, or N followed by K, M, G or T (powers of 1024), as --block-size
+    std::string digits = value;
+    int shift = 0;
+    if (!digits.empty()) {
+        switch (digits.back()) {
+            case 'K': case 'k': shift = 10; break;
+            case 'M': shift = 20; break;
+            case 'G': shift = 30; break;
+            case 'T': shift = 40; break;
+        }
+        if (shift) {
+            digits.pop_back();
+        }
+    }
+    int64_t count;
+    if (!parseNumber(digits, 10, count) || count > (INT64_MAX >> shift)) {
+        return false;
+    }
+    bytes = count << shift;
+    return true;
+}
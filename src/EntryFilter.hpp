@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Forward declaration to avoid circular dependency
+struct FileInfo;
+
+// Metadata predicates (--newer, --older, --min-size, --max-size, --type,
+// --owner, --perm, --empty), compiled once from the command line into a
+// short program that every entry runs through before it is sorted or
+// formatted. All predicates must hold. Instructions are kept ordered by
+// cost, so the cheap field comparisons reject most entries before --empty
+// has to open a directory, and needs() tells a caller which fields it has
+// to fetch at all.
+class EntryFilter {
+public:
+    enum Field : unsigned {
+        TYPE = 1 << 0,          // available from readdir's d_type
+        SIZE = 1 << 1,
+        MTIME = 1 << 2,
+        OWNER = 1 << 3,
+        PERMISSIONS = 1 << 4,
+        CONTENTS = 1 << 5       // reads the directory itself
+    };
+
+    // The fields predicates look at; only those in needs() must be filled in
+    struct Subject {
+        mode_t mode = 0;
+        off_t size = 0;
+        int64_t mtime_nsec = 0;
+        uid_t uid = 0;
+        const char* path = nullptr;
+    };
+
+    static bool isFilterOption(const std::string& option);
+
+    // Compiles --option=value into the program; returns false with a
+    // message in error if the value is not valid
+    bool add(const std::string& option, const std::string& value, std::string& error);
+
+    bool empty() const { return m_program.empty(); }
+    unsigned needs() const { return m_needs; }
+
+    bool matches(const Subject& subject) const;
+    bool matches(const FileInfo& file) const;
+    // An entry not yet made into a FileInfo: its lstat and full path
+    bool matches(const struct stat& st, const char* path) const;
+
+    // N, or N followed by K, M, G or T (powers of 1024); false if invalid
+    static bool parseSize(const std::string& value, int64_t& bytes);
+
+private:
+    enum class Op : uint8_t {
+        TYPE_IN,        // a: bit set of S_IFMT >> 12 values
+        SIZE_AT_LEAST,
+        SIZE_AT_MOST,
+        NEWER_THAN,     // a: nanoseconds since the epoch
+        OLDER_THAN,
+        OWNED_BY,
+        PERM_EXACT,     // a: permission bits
+        PERM_ALL,
+        PERM_ANY,
+        EMPTY
+    };
+
+    struct Instruction {
+        Op op;
+        int64_t a;
+    };
+
+    std::vector<Instruction> m_program;
+    unsigned m_needs = 0;
+
+    void append(Op op, int64_t a);
+    static unsigned fieldOf(Op op);
+
+    static bool parseTime(const std::string& value, int64_t& nsec);
+    static bool isEmpty(const Subject& subject);
+};
@@ -0,0 +1,415 @@
+#include "EntryTable.hpp"
+#include "FileOperations.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char TABLE_MAGIC[8] = {'L', 'S', 'P', 'P', 'E', 'N', 'T', '\0'};
+constexpr uint32_t TABLE_VERSION = 2;
+
+static_assert(sizeof(EntryTable::Header) == 96, "entry table header layout changed");
+static_assert(sizeof(EntryTable::Record) == 128, "entry table record layout changed");
+
+void splitTime(std::chrono::system_clock::time_point time, int64_t& sec, int64_t& nsec) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    sec = ns / 1000000000;
+    nsec = ns % 1000000000;
+    if (nsec < 0) {
+        sec -= 1;
+        nsec += 1000000000;
+    }
+}
+
+} // namespace
+
+EntryTable::EntryTable()
+    : m_mapping(nullptr), m_mapping_size(0), m_header(nullptr), m_records(nullptr), m_strings(nullptr) {
+}
+
+EntryTable::~EntryTable() {
+    close();
+}
+
+bool EntryTable::open(const fs::path& file, Kind kind) {
+    close();
+
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+        ::close(fd);
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    const auto* header = static_cast<const Header*>(mapping);
+    uint64_t expected = sizeof(Header) + header->count * sizeof(Record) + header->strings_size;
+    if (std::memcmp(header->magic, TABLE_MAGIC, sizeof(TABLE_MAGIC)) != 0 ||
+        header->version != TABLE_VERSION || header->kind != static_cast<uint32_t>(kind) ||
+        header->count > size / sizeof(Record) || expected != size) {
+        munmap(mapping, size);
+        return false;
+    }
+
+    m_mapping = mapping;
+    m_mapping_size = size;
+    m_header = header;
+    m_records = reinterpret_cast<const Record*>(header + 1);
+    m_strings = reinterpret_cast<const char*>(m_records + header->count);
+    return true;
+}
+
+void EntryTable::close() {
+    if (m_mapping) {
+        munmap(m_mapping, m_mapping_size);
+    }
+    m_mapping = nullptr;
+    m_mapping_size = 0;
+    m_header = nullptr;
+    m_records = nullptr;
+    m_strings = nullptr;
+}
+
+bool EntryTable::isOpen() const {
+    return m_header != nullptr;
+}
+
+const EntryTable::Header& EntryTable::header() const {
+    return *m_header;
+}
+
+size_t EntryTable::size() const {
+    return m_header ? static_cast<size_t>(m_header->count) : 0;
+}
+
+const EntryTable::Record& EntryTable::record(size_t index) const {
+    return m_records[index];
+}
+
+std::string_view EntryTable::stringAt(uint32_t offset, uint32_t length) const {
+    // Offsets come from the file, so check them on every access
+    if (static_cast<uint64_t>(offset) + length > m_header->strings_size) {
+        return {};
+    }
+    return std::string_view(m_strings + offset, length);
+}
+
+std::string_view EntryTable::keyString(size_t offset_key, size_t length_key) const {
+    uint64_t offset = m_header->key[offset_key];
+    uint64_t length = m_header->key[length_key];
+    if (offset > UINT32_MAX || length > UINT32_MAX) {
+        return {};
+    }
+    return stringAt(static_cast<uint32_t>(offset), static_cast<uint32_t>(length));
+}
+
+std::string_view EntryTable::name(size_t index) const {
+    return stringAt(m_records[index].name_offset, m_records[index].name_length);
+}
+
+std::string_view EntryTable::target(size_t index) const {
+    return stringAt(m_records[index].target_offset, m_records[index].target_length);
+}
+
+std::string_view EntryTable::owner(size_t index) const {
+    return stringAt(m_records[index].owner_offset, m_records[index].owner_length);
+}
+
+std::string_view EntryTable::group(size_t index) const {
+    return stringAt(m_records[index].group_offset, m_records[index].group_length);
+}
+
+FileInfo EntryTable::toFileInfo(size_t index, const fs::path& base) const {
+    return FileInfo(base / name(index), toStat(m_records[index]), std::string(target(index)),
+                    std::string(owner(index)), std::string(group(index)));
+}
+
+EntryTable::Record EntryTable::toRecord(const FileInfo& file) {
+    Record record{};
+    record.inode = file.inode;
+    record.device = file.device;
+    record.size = static_cast<uint64_t>(file.size);
+    record.blocks = static_cast<uint64_t>(file.blocks);
+    splitTime(file.mtime, record.mtime_sec, record.mtime_nsec);
+    splitTime(file.atime, record.atime_sec, record.atime_nsec);
+    splitTime(file.ctime, record.ctime_sec, record.ctime_nsec);
+    record.mode = file.mode;
+    record.hard_links = static_cast<uint32_t>(file.hard_links);
+    record.uid = file.uid;
+    record.gid = file.gid;
+    return record;
+}
+
+struct stat EntryTable::toStat(const Record& record) {
+    struct stat st{};
+    st.st_ino = record.inode;
+    st.st_dev = record.device;
+    st.st_size = static_cast<off_t>(record.size);
+    st.st_blocks = static_cast<blkcnt_t>(record.blocks);
+    st.st_mtim.tv_sec = record.mtime_sec;
+    st.st_mtim.tv_nsec = record.mtime_nsec;
+    st.st_atim.tv_sec = record.atime_sec;
+    st.st_atim.tv_nsec = record.atime_nsec;
+    st.st_ctim.tv_sec = record.ctime_sec;
+    st.st_ctim.tv_nsec = record.ctime_nsec;
+    st.st_mode = record.mode;
+    st.st_nlink = record.hard_links;
+    st.st_uid = record.uid;
+    st.st_gid = record.gid;
+    return st;
+}
+
+EntryTableWriter::EntryTableWriter(EntryTable::Kind kind) : m_header{} {
+    std::memcpy(m_header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+    m_header.version = TABLE_VERSION;
+    m_header.kind = static_cast<uint32_t>(kind);
+}
+
+void EntryTableWriter::setKey(size_t index, uint64_t value) {
+    m_header.key[index] = value;
+}
+
+bool EntryTableWriter::setKeyString(size_t offset_key, size_t length_key, std::string_view text) {
+    if (!fits(text.size())) {
+        return false;
+    }
+    m_header.key[offset_key] = m_strings.size();
+    m_header.key[length_key] = text.size();
+    m_strings += text;
+    return true;
+}
+
+bool EntryTableWriter::add(const FileInfo& file, std::string_view name) {
+    if (!fits(name.size() + file.symlink_target.size() + file.owner.size() + file.group.size())) {
+        return false;
+    }
+
+    EntryTable::Record record = EntryTable::toRecord(file);
+
+    record.name_offset = static_cast<uint32_t>(m_strings.size());
+    record.name_length = static_cast<uint32_t>(name.size());
+    m_strings += name;
+
+    record.target_offset = static_cast<uint32_t>(m_strings.size());
+    record.target_length = static_cast<uint32_t>(file.symlink_target.size());
+    m_strings += file.symlink_target;
+
+    record.owner_offset = intern(file.owner);
+    record.owner_length = static_cast<uint32_t>(file.owner.size());
+    record.group_offset = intern(file.group);
+    record.group_length = static_cast<uint32_t>(file.group.size());
+
+    m_records.push_back(record);
+    return true;
+}
+
+bool EntryTableWriter::fits(uint64_t needed) {
+    if (m_strings.size() + needed > UINT32_MAX) {
+        m_overflowed = true;
+    }
+    return !m_overflowed;
+}
+
+uint32_t EntryTableWriter::intern(const std::string& text) {
+    // A listing has few distinct owners, so each name is stored once
+    auto [it, inserted] = m_interned.try_emplace(text, static_cast<uint32_t>(m_strings.size()));
+    if (inserted) {
+        m_strings += text;
+    }
+    return it->second;
+}
+
+size_t EntryTableWriter::size() const {
+    return m_records.size();
+}
+
+bool EntryTableWriter::writeTo(const fs::path& file) const {
+    if (m_overflowed) {
+        return false;
+    }
+    EntryTable::Header header = m_header;
+    header.count = m_records.size();
+    header.strings_size = m_strings.size();
+
+    fs::path tmp_path = file;
+    tmp_path += ".tmp." + std::to_string(getpid());
+
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(m_records.data()),
+                  static_cast<std::streamsize>(m_records.size() * sizeof(EntryTable::Record)));
+        out.write(m_strings.data(), static_cast<std::streamsize>(m_strings.size()));
+        if (!out) {
+            out.close();
+            unlink(tmp_path.c_str());
+            return false;
+        }
+    }
+
+    if (rename(tmp_path.c_str(), file.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+} // namespace
+
+EntryTableStream::EntryTableStream(EntryTable::Kind kind) : m_header{} {
+    std::memcpy(m_header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+    m_header.version = TABLE_VERSION;
+    m_header.kind = static_cast<uint32_t>(kind);
+}
+
+EntryTableStream::~EntryTableStream() {
+    closeFiles();
+}
+
+bool EntryTableStream::open(const fs::path& file) {
+    closeFiles();
+    m_records.clear();
+    m_strings.clear();
+    m_count = 0;
+    m_strings_size = 0;
+    m_failed = false;
+    m_interned.clear();
+
+    m_fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    fs::path pool = file;
+    pool += ".pool";
+    m_strings_fd = m_fd < 0 ? -1 : ::open(pool.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (m_strings_fd < 0) {
+        closeFiles();
+        return false;
+    }
+    unlink(pool.c_str());
+
+    // The header is written last, once the counts are known
+    EntryTable::Header placeholder{};
+    return writeAll(m_fd, reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+}
+
+bool EntryTableStream::add(const FileInfo& file, std::string_view name) {
+    uint64_t needed = name.size() + file.symlink_target.size() + file.owner.size() + file.group.size();
+    if (m_strings_size + needed > UINT32_MAX) {
+        return false;
+    }
+
+    EntryTable::Record record = EntryTable::toRecord(file);
+    record.name_offset = append(name);
+    record.name_length = static_cast<uint32_t>(name.size());
+    record.target_offset = append(file.symlink_target);
+    record.target_length = static_cast<uint32_t>(file.symlink_target.size());
+    record.owner_offset = intern(file.owner);
+    record.owner_length = static_cast<uint32_t>(file.owner.size());
+    record.group_offset = intern(file.group);
+    record.group_length = static_cast<uint32_t>(file.group.size());
+
+    m_records.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    ++m_count;
+    if (m_records.size() >= FLUSH_BYTES || m_strings.size() >= FLUSH_BYTES) {
+        flush();
+    }
+    return true;
+}
+
+uint32_t EntryTableStream::append(std::string_view text) {
+    auto offset = static_cast<uint32_t>(m_strings_size);
+    m_strings += text;
+    m_strings_size += text.size();
+    return offset;
+}
+
+uint32_t EntryTableStream::intern(const std::string& text) {
+    auto [it, inserted] = m_interned.try_emplace(text, static_cast<uint32_t>(m_strings_size));
+    if (inserted) {
+        append(text);
+    }
+    return it->second;
+}
+
+void EntryTableStream::flush() {
+    if (!m_failed && (!writeAll(m_fd, m_records.data(), m_records.size()) ||
+                      !writeAll(m_strings_fd, m_strings.data(), m_strings.size()))) {
+        m_failed = true;
+    }
+    m_records.clear();
+    m_strings.clear();
+}
+
+bool EntryTableStream::finish() {
+    if (m_fd < 0) {
+        return false;
+    }
+    flush();
+
+    // The pool follows the records
+    char buffer[FLUSH_BYTES];
+    bool ok = !m_failed && lseek(m_strings_fd, 0, SEEK_SET) == 0;
+    while (ok) {
+        ssize_t length = read(m_strings_fd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            ok = length == 0;
+            break;
+        }
+        ok = writeAll(m_fd, buffer, static_cast<size_t>(length));
+    }
+
+    EntryTable::Header header = m_header;
+    header.count = m_count;
+    header.strings_size = m_strings_size;
+    ok = ok && pwrite(m_fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+    ok = close(m_fd) == 0 && ok;
+    m_fd = -1;
+    closeFiles();
+    return ok;
+}
+
+void EntryTableStream::closeFiles() {
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    if (m_strings_fd >= 0) {
+        close(m_strings_fd);
+        m_strings_fd = -1;
+    }
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+// Forward declaration to avoid circular dependency
+struct FileInfo;
+
+// Compact binary form of a listing: a header, fixed-size records and one
+// string pool holding names and symlink targets. Tables are written once and
+// read back through mmap, so reusing one costs a page-in rather than a parse.
+class EntryTable {
+public:
+    static constexpr size_t KEY_WORDS = 8;
+
+    enum class Kind : uint32_t {
+        LISTING = 1,    // one directory, keyed by its stamp (listing cache)
+        SNAPSHOT = 2,   // a whole listing saved with --snapshot, names are full paths
+        SPILL_RUN = 3   // sorted part of one directory listed under --max-memory
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t kind;
+        uint64_t count;
+        uint64_t strings_size;
+        uint64_t key[KEY_WORDS];    // meaning depends on kind
+    };
+
+    struct Record {
+        uint64_t inode;
+        uint64_t device;
+        uint64_t size;
+        uint64_t blocks;
+        int64_t mtime_sec;
+        int64_t mtime_nsec;
+        int64_t atime_sec;
+        int64_t atime_nsec;
+        int64_t ctime_sec;
+        int64_t ctime_nsec;
+        uint32_t mode;
+        uint32_t hard_links;
+        uint32_t uid;
+        uint32_t gid;
+        uint32_t name_offset;
+        uint32_t name_length;
+        uint32_t target_offset;
+        uint32_t target_length;
+        uint32_t owner_offset;      // names as resolved when the table was written
+        uint32_t owner_length;
+        uint32_t group_offset;
+        uint32_t group_length;
+    };
+
+    EntryTable();
+    ~EntryTable();
+
+    EntryTable(const EntryTable&) = delete;
+    EntryTable& operator=(const EntryTable&) = delete;
+
+    // Maps file and checks that it is a complete table of the given kind
+    bool open(const fs::path& file, Kind kind);
+    void close();
+    bool isOpen() const;
+
+    const Header& header() const;
+    size_t size() const;
+    const Record& record(size_t index) const;
+    std::string_view name(size_t index) const;
+    std::string_view target(size_t index) const;
+    std::string_view owner(size_t index) const;
+    std::string_view group(size_t index) const;
+    // A pool string whose offset and length are in two header keys
+    std::string_view keyString(size_t offset_key, size_t length_key) const;
+
+    // Rebuilds the entry as base / name without touching the filesystem or
+    // the user database
+    FileInfo toFileInfo(size_t index, const fs::path& base) const;
+
+    static Record toRecord(const FileInfo& file);
+    static struct stat toStat(const Record& record);
+
+private:
+    void* m_mapping;
+    size_t m_mapping_size;
+    const Header* m_header;
+    const Record* m_records;
+    const char* m_strings;
+
+    std::string_view stringAt(uint32_t offset, uint32_t length) const;
+};
+
+// Accumulates records and writes them out as an EntryTable file
+class EntryTableWriter {
+public:
+    explicit EntryTableWriter(EntryTable::Kind kind);
+
+    void setKey(size_t index, uint64_t value);
+    // Stores text in the pool, with its offset and length in two header keys
+    bool setKeyString(size_t offset_key, size_t length_key, std::string_view text);
+    // As EntryTableStream::add, false with nothing stored if the entry does
+    // not fit in the 32-bit offsets of the string pool
+    bool add(const FileInfo& file, std::string_view name);
+    size_t size() const;
+
+    // Writes to a temporary next to file and renames it into place, so
+    // readers never map a partial table; false, writing nothing, once any
+    // text did not fit
+    bool writeTo(const fs::path& file) const;
+
+private:
+    EntryTable::Header m_header;
+    std::vector<EntryTable::Record> m_records;
+    std::string m_strings;
+    std::unordered_map<std::string, uint32_t> m_interned;   // owner/group name -> pool offset
+    bool m_overflowed = false;
+
+    bool fits(uint64_t needed);
+
+    uint32_t intern(const std::string& text);
+};
+
+// Writes an EntryTable an entry at a time, for tables that need not fit in
+// memory (--max-memory runs): records go to the file as they come, the
+// string pool to a second, already unlinked file that finish() appends
+class EntryTableStream {
+public:
+    explicit EntryTableStream(EntryTable::Kind kind);
+    ~EntryTableStream();
+
+    EntryTableStream(const EntryTableStream&) = delete;
+    EntryTableStream& operator=(const EntryTableStream&) = delete;
+
+    // Starts the table in file, replacing what it held
+    bool open(const fs::path& file);
+    // False, with nothing written, if the entry does not fit in the 32-bit
+    // offsets of the string pool; the table can still be finished
+    bool add(const FileInfo& file, std::string_view name);
+    size_t size() const { return m_count; }
+    // Writes the header; false if any write failed
+    bool finish();
+
+private:
+    static constexpr size_t FLUSH_BYTES = 64 * 1024;
+
+    EntryTable::Header m_header;
+    int m_fd = -1;
+    int m_strings_fd = -1;
+    std::string m_records;      // not yet written
+    std::string m_strings;
+    uint64_t m_count = 0;
+    uint64_t m_strings_size = 0;
+    bool m_failed = false;
+    std::unordered_map<std::string, uint32_t> m_interned;
+
+    uint32_t append(std::string_view text);
+    uint32_t intern(const std::string& text);
+    void flush();
+    void closeFiles();
+};
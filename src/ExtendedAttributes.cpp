@@ -0,0 +1,89 @@
+#include "ExtendedAttributes.hpp"
+#include "FileOperations.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <sys/xattr.h>
+
+unsigned ExtendedAttributes::requested(const LsOptions& options) {
+    unsigned fields = 0;
+    if (options.show_context) {
+        fields |= CONTEXT;
+    }
+    // The ACL marker is shown by -l and written into records
+    if (options.show_xattrs ||
+        (options.show_acl && (options.format == ListFormat::LONG || isRecordFormat(options.format)))) {
+        fields |= NAMES;
+    }
+    return fields;
+}
+
+void ExtendedAttributes::load(std::vector<FileInfo>& files, size_t first, unsigned fields) {
+    if (fields == 0 || first >= files.size()) {
+        return;
+    }
+    size_t count = files.size() - first;
+    unsigned threads = std::min(MAX_THREADS, std::max(1u, std::thread::hardware_concurrency()));
+    if (count < PARALLEL_MIN || threads == 1) {
+        for (size_t i = first; i < files.size(); ++i) {
+            loadOne(files[i], fields);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next{first};
+    auto worker = [&] {
+        size_t start;
+        while ((start = next.fetch_add(BATCH)) < files.size()) {
+            size_t end = std::min(start + BATCH, files.size());
+            for (size_t i = start; i < end; ++i) {
+                loadOne(files[i], fields);
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+void ExtendedAttributes::loadOne(FileInfo& file, unsigned fields) {
+    // Nothing can be read from an entry that could not even be stat'ed
+    if (file.attributesUnknown()) {
+        return;
+    }
+    if (fields & CONTEXT) {
+        file.selinux_context = FileOperations::getSelinuxContext(file.path);
+    }
+    if (fields & NAMES) {
+        // Sized call first; a list that grows in between is simply read again
+        std::vector<char> buffer;
+        ssize_t length;
+        do {
+            length = llistxattr(file.path.c_str(), nullptr, 0);
+            if (length <= 0) {
+                return;
+            }
+            buffer.resize(static_cast<size_t>(length));
+            length = llistxattr(file.path.c_str(), buffer.data(), buffer.size());
+        } while (length < 0 && errno == ERANGE);
+        if (length <= 0) {
+            return;
+        }
+
+        file.xattr_names.clear();
+        for (const char* name = buffer.data(); name < buffer.data() + length; name += std::strlen(name) + 1) {
+            if (std::strcmp(name, "system.posix_acl_access") == 0 ||
+                std::strcmp(name, "system.posix_acl_default") == 0) {
+                file.has_acl = true;
+            }
+            file.xattr_names.emplace_back(name);
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Forward declarations to avoid circular dependency
+struct FileInfo;
+struct LsOptions;
+
+// Extended attribute fields of a listing, fetched only for the options that
+// show them: the SELinux context (-Z), the ACL marker (--acl) and the
+// attribute names (--xattr). A listing without these makes no xattr calls.
+// Large listings are read by a few worker threads, each taking runs of
+// entries from a shared counter; the calls are independent per entry.
+class ExtendedAttributes {
+public:
+    enum Field : unsigned {
+        CONTEXT = 1 << 0,   // security.selinux
+        NAMES = 1 << 1      // llistxattr, which also tells whether an ACL is set
+    };
+
+    // The fields options ask for, 0 when none
+    static unsigned requested(const LsOptions& options);
+
+    // Fills fields into files[first..]
+    static void load(std::vector<FileInfo>& files, size_t first, unsigned fields);
+
+private:
+    // Below this many entries the thread startup costs more than it saves
+    static constexpr size_t PARALLEL_MIN = 256;
+    static constexpr size_t BATCH = 64;
+    static constexpr unsigned MAX_THREADS = 8;
+
+    static void loadOne(FileInfo& file, unsigned fields);
+};
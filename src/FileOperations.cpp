@@ -1,65 +1,131 @@
 #include "FileOperations.hpp"
+#include "DirectorySizer.hpp"
+#include "ExtendedAttributes.hpp"
+#include "InodeOrder.hpp"
+#include "ListingSpill.hpp"
+#include "ReorderBuffer.hpp"
 #include <iostream>
+#include <cerrno>
 #include <algorithm>
 #include <fnmatch.h>
 #include <pwd.h>
 #include <grp.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/xattr.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <ctime>
 #include <locale>
 #include <iomanip>
 #include <sstream>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+namespace {
+
+// Names of user and group IDs, looked up once per process: each getpwuid
+// may read /etc/passwd or query NSS again, and a listing repeats a few IDs
+struct IdNames {
+    std::mutex mutex;
+    std::unordered_map<uid_t, std::string> users;
+    std::unordered_map<gid_t, std::string> groups;
+};
+
+IdNames& idNames() {
+    static IdNames names;
+    return names;
+}
+
+} // namespace
 
 FileInfo::FileInfo(const fs::path& p) : path(p), display_name(p.filename()) {
     loadFileStats();
     loadExtendedInfo();
 }
 
+FileInfo::FileInfo(const fs::path& p, const struct stat& st) : path(p), display_name(p.filename()) {
+    applyStats(st);
+    loadExtendedInfo();
+}
+
+FileInfo::FileInfo(const fs::path& p, const struct stat& st, std::string target)
+    : path(p), display_name(p.filename()), symlink_target(std::move(target)) {
+    applyStats(st);
+}
+
+FileInfo::FileInfo(const fs::path& p, const struct stat& st, std::string target,
+                   std::string owner_name, std::string group_name)
+    : path(p), display_name(p.filename()), owner(std::move(owner_name)), group(std::move(group_name)),
+      symlink_target(std::move(target)) {
+    applyStats(st);
+}
+
+FileInfo FileInfo::unknown(const fs::path& p, int error) {
+    struct stat st{};
+    FileInfo file(p, st, std::string(), "?", "?");
+    file.stat_error = error;
+    return file;
+}
+
 void FileInfo::loadFileStats() {
-    try {
-        struct stat st;
-        if (lstat(path.c_str(), &st) == 0) {
-            mode = st.st_mode;
-            size = st.st_size;
-            hard_links = st.st_nlink;
-            inode = st.st_ino;
-            
-            // Convert time_t to chrono time_point
-            mtime = std::chrono::system_clock::from_time_t(st.st_mtime);
-            atime = std::chrono::system_clock::from_time_t(st.st_atime);
-            ctime = std::chrono::system_clock::from_time_t(st.st_ctime);
-            
-            is_directory = S_ISDIR(mode);
-            is_symlink = S_ISLNK(mode);
-            is_executable = (mode & S_IXUSR) || (mode & S_IXGRP) || (mode & S_IXOTH);
-            is_hidden = display_name.string().length() > 0 && display_name.string()[0] == '.';
-            
-            owner = FileOperations::getFileOwner(st.st_uid);
-            group = FileOperations::getFileGroup(st.st_gid);
-        }
-    } catch (const std::exception& e) {
-        // Handle error - set default values
-        mode = 0;
-        size = 0;
-        hard_links = 0;
-        inode = 0;
-        is_directory = false;
-        is_symlink = false;
-        is_executable = false;
-        is_hidden = false;
-        owner = "unknown";
-        group = "unknown";
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0) {
+        applyStats(st);
+        return;
     }
+    // Vanished or unreadable: keep the name, show the rest as ?
+    stat_error = errno;
+    owner = "?";
+    group = "?";
+    is_hidden = !display_name.empty() && display_name.native()[0] == '.';
+}
+
+void FileInfo::applyStats(const struct stat& st) {
+    mode = st.st_mode;
+    size = st.st_size;
+    hard_links = st.st_nlink;
+    inode = st.st_ino;
+    device = st.st_dev;
+    blocks = st.st_blocks;
+    uid = st.st_uid;
+    gid = st.st_gid;
+    
+    // Keep the full nanosecond timestamps
+    auto to_time_point = [](const struct timespec& ts) {
+        return std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec)));
+    };
+    mtime = to_time_point(st.st_mtim);
+    atime = to_time_point(st.st_atim);
+    ctime = to_time_point(st.st_ctim);
+    
+    is_directory = S_ISDIR(mode);
+    is_symlink = S_ISLNK(mode);
+    is_executable = (mode & S_IXUSR) || (mode & S_IXGRP) || (mode & S_IXOTH);
+    is_hidden = display_name.string().length() > 0 && display_name.string()[0] == '.';
+    
+    if (owner.empty()) {
+        owner = FileOperations::getFileOwner(st.st_uid);
+    }
+    if (group.empty()) {
+        group = FileOperations::getFileGroup(st.st_gid);
+    }
+}
+
+void FileInfo::dereference(const struct stat& target) {
+    owner.clear();
+    group.clear();
+    applyStats(target);
 }
 
 void FileInfo::loadExtendedInfo() {
+    // The SELinux context and other xattrs are read by ExtendedAttributes, on request
     if (is_symlink) {
         symlink_target = FileOperations::getSymlinkTarget(path);
     }
-    
-    // Load SELinux context if requested
-    selinux_context = FileOperations::getSelinuxContext(path);
 }
 
 FileOperations::FileOperations() {
@@ -67,117 +133,744 @@ FileOperations::FileOperations() {
 }
 
 std::vector<FileInfo> FileOperations::listDirectory(const fs::path& path, const LsOptions& options) {
+    // Targets may have changed since the previous listing (--serve, --watch),
+    // and a mount that hung then may answer now
+    resetListing();
+    return listEntries(path, options);
+}
+
+std::vector<FileInfo> FileOperations::listEntries(const fs::path& path, const LsOptions& options,
+                                                 const DirectoryScan* scan, ListingGroup* group) {
     std::vector<FileInfo> files;
+    bool descend = group && options.recursive && !options.show_directory_entries;
+    const EntryFilter* filter = options.show_directory_entries ? nullptr : earlyFilter(options);
     
-    try {
-        if (options.show_directory_entries) {
-            // Just show the directory itself, not its contents
-            files.emplace_back(path);
-        } else {
-            for (const auto& entry : fs::directory_iterator(path)) {
-                files.emplace_back(entry.path());
+    if (options.show_directory_entries) {
+        // Just show the directory itself, not its contents
+        files.push_back(entryInfo(path, options));
+    } else {
+        if (!m_memory_cache || !m_memory_cache->load(path, files)) {
+            bool watched = m_memory_cache && m_memory_cache->watch(path);
+            // A directory that cannot be read is not cached, so it is retried next time
+            std::vector<FileInfo> dropped;
+            if (readDirectory(path, options, files, scan, filter, descend ? &dropped : nullptr) && watched) {
+                m_memory_cache->store(path, files);
             }
-            
-            // Add . and .. if showing all
-            if (options.show_all || options.show_almost_all) {
-                if (options.show_all) {
-                    files.emplace_back(path / ".");
-                }
-                files.emplace_back(path / "..");
+            if (descend) {
+                addSubdirectories(dropped, options, group->subdirectories);
             }
         }
         
-        files = filterFiles(files, options);
-        sortFiles(files, options);
-        
-    } catch (const fs::filesystem_error& e) {
-        std::cerr << "ls++: cannot access '" << path.string() << "': " << e.what() << "\n";
+        // Add . and .. if showing all
+        auto addEntry = [&](const fs::path& entry) {
+            FileInfo file = entryInfo(entry, options);
+            if (!filter || filter->matches(file)) {
+                files.push_back(std::move(file));
+            }
+        };
+        if (options.show_all || options.show_almost_all) {
+            if (options.show_all) {
+                addEntry(path / ".");
+            }
+            addEntry(path / "..");
+        }
     }
     
+    finishEntries(files, options, descend ? &group->subdirectories : nullptr, filter != nullptr);
+    if (descend) {
+        sortFiles(group->subdirectories, options);
+    }
+    if (group && options.flat) {
+        nameByPath(files, *group);
+    }
+    sortFiles(files, options);
+    
     return files;
 }
 
+void FileOperations::completeEntries(std::vector<FileInfo>& files, const LsOptions& options) {
+    // As listDirectory, link targets are looked up afresh
+    m_targets.clear();
+    finishEntries(files, options);
+}
+
+void FileOperations::nameByPath(std::vector<FileInfo>& files, const ListingGroup& group) {
+    fs::path prefix = group.root.empty() ? group.directory.lexically_normal()
+                                         : group.directory.lexically_relative(group.root);
+    if (prefix.empty() || prefix == ".") {
+        // Entries of the root itself are named as they are
+        return;
+    }
+    for (FileInfo& file : files) {
+        if (file.display_name != "." && file.display_name != "..") {
+            file.display_name = prefix / file.display_name;
+        }
+    }
+}
+
+void FileOperations::finishEntries(std::vector<FileInfo>& files, const LsOptions& options,
+                                   std::vector<FileInfo>* subdirectories, bool filtered) {
+    if (options.dereference_links) {
+        dereferenceLinks(files, 0, options);
+    }
+    if (subdirectories) {
+        addSubdirectories(files, options, *subdirectories);
+    }
+    std::erase_if(files, [&](const FileInfo& file) {
+        return filtered ? !shouldShowName(file, options) : !shouldShowFile(file, options);
+    });
+    loadAttributes(files, options);
+    if (options.total_size) {
+        DirectorySizer sizer(options.total_size_depth, options.one_file_system);
+        applyTotalSizes(files, sizer);
+    }
+}
+
+void FileOperations::addSubdirectories(const std::vector<FileInfo>& files, const LsOptions& options,
+                                       std::vector<FileInfo>& subdirectories) {
+    // With -L, symlinks to directories have already been replaced by their
+    // targets; the metadata filter does not stop the walk
+    for (const FileInfo& file : files) {
+        const fs::path& name = file.display_name;
+        if (file.is_directory && name != "." && name != ".." && shouldShowName(file, options)) {
+            subdirectories.push_back(file);
+        }
+    }
+}
+
+bool FileOperations::readDirectory(const fs::path& path, const LsOptions& options, std::vector<FileInfo>& files,
+                                   const DirectoryScan* scan, const EntryFilter* filter,
+                                   std::vector<FileInfo>* dropped) {
+    // Stat the directory before enumerating it, so a change made
+    // while listing leaves the stored stamp already outdated
+    struct stat dir_stat;
+    bool cacheable = options.use_cache && stat(path.c_str(), &dir_stat) == 0;
+    if (cacheable && !m_listing_cache) {
+        m_listing_cache = std::make_unique<ListingCache>(std::chrono::seconds(options.cache_ttl));
+    }
+    
+    if (cacheable && m_listing_cache->load(path, dir_stat, files)) {
+        return true;
+    }
+    
+    size_t first = files.size();
+    IoWatchdog* watchdog = ioWatchdog(options);
+    DirectoryScan local_scan;
+    if (!scan && !watchdog) {
+        scanDirectory(path, local_scan, inodeOrderMin(options), filter);
+        scan = &local_scan;
+    }
+    if (scan) {
+        // Read ahead by processTargets, or just now
+        appendEntries(path, *scan, files, filter, dropped);
+        if (scan->error != 0) {
+            std::error_code ec(scan->error, std::generic_category());
+            m_diagnostics.report(Diagnostics::MINOR, scan->names.empty() ? "cannot open directory" : "reading directory",
+                                 path.string(), ec);
+            return false;
+        }
+    } else {
+        // Whatever the worker read before the deadline is listed, the rest as ?
+        auto read = watchdog->readDirectory(path, inodeOrderMin(options));
+        struct stat no_stat{};
+        for (size_t i = 0; i < read.names.size(); ++i) {
+            fs::path entry = path / read.names[i];
+            if (filter && rejects(filter, entry, read.stats[i] ? *read.stats[i] : no_stat, read.targets[i], dropped)) {
+                continue;
+            }
+            if (read.stats[i]) {
+                files.emplace_back(entry, *read.stats[i], std::move(read.targets[i]));
+            } else {
+                files.push_back(FileInfo::unknown(entry, read.errors[i] ? read.errors[i] : ETIMEDOUT));
+            }
+        }
+        if (read.timed_out) {
+            m_diagnostics.report(Diagnostics::MINOR, path.string() + ": " +
+                                 (read.enumerated ? "reading attributes" : "reading directory") +
+                                 " timed out after " + std::to_string(watchdog->timeout().count()) + "ms");
+            return false;
+        }
+        if (read.error != 0) {
+            std::error_code ec(read.error, std::generic_category());
+            m_diagnostics.report(Diagnostics::MINOR, read.names.empty() ? "cannot open directory" : "reading directory",
+                                 path.string(), ec);
+            return false;
+        }
+    }
+    
+    // Entries that vanished or cannot be stat'ed are listed with ?
+    bool complete = true;
+    for (size_t i = first; i < files.size(); ++i) {
+        if (files[i].attributesUnknown()) {
+            m_diagnostics.report(Diagnostics::MINOR, "cannot access", files[i].path.string(),
+                                 std::error_code(files[i].stat_error, std::generic_category()));
+            complete = false;
+        }
+    }
+    if (cacheable && complete) {
+        m_listing_cache->store(dir_stat, files);
+    }
+    return complete;
+}
+
+void FileOperations::listGroup(ListingGroup& group, const LsOptions& options, const DirectoryScan* scan) {
+    // The caches and the watchdog hold or read whole directories
+    if (options.max_memory > 0 && !scan && !options.show_directory_entries && !m_memory_cache &&
+        !options.use_cache && !ioWatchdog(options)) {
+        listSpilling(group, options);
+    } else {
+        group.files = listEntries(group.directory, options, scan, &group);
+    }
+}
+
+void FileOperations::listSpilling(ListingGroup& group, const LsOptions& options) {
+    const fs::path& path = group.directory;
+    auto spill = std::make_shared<ListingSpill>(options, path);
+    std::vector<FileInfo> batch;
+    bool kept_in_memory = false;
+    // One sizer for the whole directory, so hard links are counted once across batches
+    DirectorySizer sizer(options.total_size_depth, options.one_file_system);
+    // As listEntries, a batch at a time; ExtendedAttributes are read on output
+    const EntryFilter* filter = earlyFilter(options);
+    std::vector<FileInfo> dropped;
+    auto keep = [&] {
+        if (options.dereference_links) {
+            dereferenceLinks(batch, 0, options);
+        }
+        if (options.recursive) {
+            addSubdirectories(batch, options, group.subdirectories);
+            addSubdirectories(dropped, options, group.subdirectories);
+            dropped.clear();
+        }
+        std::erase_if(batch, [&](const FileInfo& file) {
+            return filter ? !shouldShowName(file, options) : !shouldShowFile(file, options);
+        });
+        if (options.total_size) {
+            applyTotalSizes(batch, sizer);
+        }
+        if (options.flat) {
+            nameByPath(batch, group);
+        }
+        if (!spill->add(batch) && !kept_in_memory) {
+            m_diagnostics.report(Diagnostics::SERIOUS, path.string() +
+                                 ": cannot write sorted runs to the temporary directory, listing in memory");
+            kept_in_memory = true;
+        }
+    };
+    
+    auto addEntry = [&](const fs::path& entry) {
+        FileInfo file = entryInfo(entry, options);
+        if (!filter || filter->matches(file)) {
+            batch.push_back(std::move(file));
+        }
+    };
+    if (options.show_all) {
+        addEntry(path / ".");
+    }
+    if (options.show_all || options.show_almost_all) {
+        addEntry(path / "..");
+    }
+    
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        std::error_code ec(errno, std::generic_category());
+        m_diagnostics.report(Diagnostics::MINOR, "cannot open directory", path.string(), ec);
+    } else {
+        size_t inode_order_min = inodeOrderMin(options);
+        bool more = true;
+        while (more) {
+            DirectoryScan scan;
+            std::vector<ino_t> inodes;
+            more = readNames(dir, scan, inodes, READ_BATCH);
+            statEntries(dirfd(dir), scan, inodes, inode_order_min, filter);
+            size_t first = batch.size();
+            appendEntries(path, scan, batch, filter, options.recursive ? &dropped : nullptr);
+            for (size_t i = first; i < batch.size(); ++i) {
+                if (batch[i].attributesUnknown()) {
+                    m_diagnostics.report(Diagnostics::MINOR, "cannot access", batch[i].path.string(),
+                                         std::error_code(batch[i].stat_error, std::generic_category()));
+                }
+            }
+            keep();
+            if (scan.error != 0) {
+                m_diagnostics.report(Diagnostics::MINOR, "reading directory", path.string(),
+                                     std::error_code(scan.error, std::generic_category()));
+            }
+        }
+        closedir(dir);
+    }
+    keep();
+    sortFiles(group.subdirectories, options);
+    
+    if (spill->spilled()) {
+        group.spill = std::move(spill);
+    } else {
+        group.files = spill->take();
+    }
+}
+
+void FileOperations::scanDirectory(const fs::path& path, DirectoryScan& scan, size_t inode_order_min,
+                                   const EntryFilter* filter) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        scan.error = errno;
+        return;
+    }
+    
+    // Names first; entries read before a failure are still listed
+    std::vector<ino_t> inodes;
+    readNames(dir, scan, inodes, SIZE_MAX);
+    statEntries(dirfd(dir), scan, inodes, inode_order_min, filter);
+    closedir(dir);
+}
+
+bool FileOperations::readNames(DIR* dir, DirectoryScan& scan, std::vector<ino_t>& inodes, size_t limit) {
+    size_t added = 0;
+    while (added < limit) {
+        errno = 0;
+        struct dirent* entry = readdir(dir);
+        if (!entry) {
+            if (errno != 0) {
+                scan.error = errno;
+            }
+            return false;
+        }
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        scan.names.emplace_back(name);
+        inodes.push_back(entry->d_ino);
+        ++added;
+    }
+    return true;
+}
+
+void FileOperations::statEntries(int fd, DirectoryScan& scan, const std::vector<ino_t>& inodes,
+                                 size_t inode_order_min, const EntryFilter* filter) {
+    // Each result is stored at its entry's position
+    size_t count = scan.names.size();
+    scan.stats.resize(count);
+    scan.stat_errors.resize(count);
+    scan.targets.resize(count);
+    bool by_inode = count >= inode_order_min;
+    std::vector<size_t> order;
+    if (by_inode) {
+        order = inodeOrder(inodes);
+    }
+    for (size_t n = 0; n < count; ++n) {
+        size_t i = by_inode ? order[n] : n;
+        const char* name = scan.names[i].c_str();
+        struct stat& st = scan.stats[i];
+        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT) != 0) {
+            scan.stat_errors[i] = errno;
+            continue;
+        }
+        // No link text for links the filter drops; judging a link needs no path
+        if (S_ISLNK(st.st_mode) && (!filter || filter->matches(st, nullptr))) {
+            char buffer[4096];
+            ssize_t length = readlinkat(fd, name, buffer, sizeof(buffer));
+            if (length > 0) {
+                scan.targets[i].assign(buffer, static_cast<size_t>(length));
+            }
+        }
+    }
+}
+
+void FileOperations::appendEntries(const fs::path& path, const DirectoryScan& scan, std::vector<FileInfo>& files,
+                                   const EntryFilter* filter, std::vector<FileInfo>* dropped) {
+    // Entries that could not be stat'ed are filtered as ls shows them, with no attributes
+    struct stat no_stat{};
+    for (size_t i = 0; i < scan.names.size(); ++i) {
+        fs::path entry = path / scan.names[i];
+        const struct stat& st = scan.stat_errors[i] == 0 ? scan.stats[i] : no_stat;
+        if (filter && rejects(filter, entry, st, scan.targets[i], dropped)) {
+            continue;
+        }
+        if (scan.stat_errors[i] == 0) {
+            files.emplace_back(entry, scan.stats[i], scan.targets[i]);
+        } else {
+            files.push_back(FileInfo::unknown(entry, scan.stat_errors[i]));
+        }
+    }
+}
+
+bool FileOperations::rejects(const EntryFilter* filter, const fs::path& entry, const struct stat& st,
+                             const std::string& target, std::vector<FileInfo>* dropped) {
+    if (filter->matches(st, entry.c_str())) {
+        return false;
+    }
+    // Not listed, but -R still descends into it
+    if (dropped && S_ISDIR(st.st_mode)) {
+        dropped->emplace_back(entry, st, target);
+    }
+    return true;
+}
+
+const EntryFilter* FileOperations::earlyFilter(const LsOptions& options) const {
+    if (options.filter.empty() || options.dereference_links || options.use_cache || m_memory_cache) {
+        return nullptr;
+    }
+    return &options.filter;
+}
+
+size_t FileOperations::inodeOrderMin(const LsOptions& options) {
+    switch (options.stat_order) {
+        case StatOrder::INODE:
+            return 0;
+        case StatOrder::DIRECTORY:
+            return SIZE_MAX;
+        default:
+            return INODE_ORDER_MIN;
+    }
+}
+
+unsigned FileOperations::prefetchThreads() {
+    // Mostly waiting on the file system, so more threads than cores pay off
+    unsigned cores = std::thread::hardware_concurrency();
+    return std::clamp(cores * 2, 2u, 16u);
+}
+
+void FileOperations::setMemoryCache(MemoryListingCache* cache) {
+    m_memory_cache = cache;
+}
+
+void FileOperations::resetListing() {
+    m_targets.clear();
+    // A long-lived process (--serve, --watch) may get another --timeout next time
+    m_watchdog.reset();
+}
+
+IoWatchdog* FileOperations::ioWatchdog(const LsOptions& options) {
+    if (options.timeout_ms <= 0) {
+        return nullptr;
+    }
+    if (!m_watchdog) {
+        m_watchdog = std::make_unique<IoWatchdog>(std::chrono::milliseconds(options.timeout_ms));
+    }
+    return m_watchdog.get();
+}
+
+int FileOperations::statEntry(const fs::path& path, bool follow_links, const LsOptions& options, struct stat& st) {
+    if (IoWatchdog* watchdog = ioWatchdog(options)) {
+        return watchdog->stat(path, follow_links, st);
+    }
+    // Mount points are looked at, not mounted
+    int flags = AT_NO_AUTOMOUNT | (follow_links ? 0 : AT_SYMLINK_NOFOLLOW);
+    return fstatat(AT_FDCWD, path.c_str(), &st, flags) == 0 ? 0 : errno;
+}
+
+FileInfo FileOperations::entryInfo(const fs::path& path, const LsOptions& options) {
+    if (!ioWatchdog(options)) {
+        return FileInfo(path);
+    }
+    struct stat st;
+    int error = statEntry(path, false, options, st);
+    if (error != 0) {
+        m_diagnostics.report(Diagnostics::MINOR, "cannot access", path.string(),
+                             std::error_code(error, std::generic_category()));
+        return FileInfo::unknown(path, error);
+    }
+    return FileInfo(path, st, S_ISLNK(st.st_mode) ? linkTarget(path, options) : std::string());
+}
+
+std::string FileOperations::linkTarget(const fs::path& path, const LsOptions& options) {
+    IoWatchdog* watchdog = ioWatchdog(options);
+    if (!watchdog) {
+        return getSymlinkTarget(path);
+    }
+    // A link whose text is not read in time is shown without a target
+    std::string target;
+    watchdog->readLink(path, target);
+    return target;
+}
+
+void FileOperations::loadAttributes(std::vector<FileInfo>& files, const LsOptions& options) {
+    unsigned fields = ExtendedAttributes::requested(options);
+    IoWatchdog* watchdog = ioWatchdog(options);
+    if (!watchdog || fields == 0 || files.empty()) {
+        ExtendedAttributes::load(files, 0, fields);
+        return;
+    }
+    
+    // One deadline for the whole listing; the worker fills copies it owns,
+    // taken back only if it finished
+    auto copies = std::make_shared<std::vector<FileInfo>>(files);
+    if (watchdog->run([copies, fields] { ExtendedAttributes::load(*copies, 0, fields); })) {
+        files = std::move(*copies);
+        return;
+    }
+    fs::path where = files.front().path.parent_path();
+    m_diagnostics.report(Diagnostics::MINOR, "cannot read extended attributes in",
+                         where.empty() ? std::string(".") : where.string(),
+                         std::error_code(ETIMEDOUT, std::generic_category()));
+}
+
 std::vector<FileInfo> FileOperations::processTargets(const std::vector<std::string>& targets, const LsOptions& options) {
     std::vector<FileInfo> all_files;
-    std::vector<fs::path> directories;
-    std::vector<fs::path> files;
+    processTargets(targets, options, [&all_files](ListingGroup& group) {
+        if (group.spill) {
+            group.spill->mergeInto(all_files);
+            return;
+        }
+        all_files.insert(all_files.end(), std::make_move_iterator(group.files.begin()),
+                         std::make_move_iterator(group.files.end()));
+    });
+    return all_files;
+}
+
+void FileOperations::processTargets(const std::vector<std::string>& targets, const LsOptions& options,
+                                    const GroupSink& sink) {
+    resetListing();
     
-    // Separate files and directories
-    for (const auto& target : targets) {
-        fs::path p(target);
-        
-        if (fs::exists(p)) {
-            if (fs::is_directory(p) && !options.show_directory_entries) {
-                directories.push_back(p);
-            } else {
-                files.push_back(p);
+    // As ls: symlinks named on the command line are followed unless -l, -F
+    // or -p show them as links, and always with -H or -L
+    bool dereference_targets = options.dereference_links || options.follow_symlinks;
+    bool follow = dereference_targets ||
+                  !(options.format == ListFormat::LONG || options.show_file_type || options.show_indicators);
+    
+    // One lstat per target, and a stat for the symlinks that are followed.
+    // Many targets are classified on several threads; the watchdog of
+    // --timeout runs one call at a time, so it keeps them sequential
+    struct Classified {
+        int error = 0;
+        struct stat st{};
+        bool is_directory = false;
+    };
+    auto classify = [&](size_t index, Classified& result) {
+        result.error = statEntry(targets[index], false, options, result.st);
+        if (result.error != 0) {
+            return;
+        }
+        result.is_directory = S_ISDIR(result.st.st_mode);
+        struct stat target;
+        if (follow && S_ISLNK(result.st.st_mode) && statEntry(targets[index], true, options, target) == 0) {
+            result.is_directory = S_ISDIR(target.st_mode);
+        }
+    };
+    bool concurrent = targets.size() > 1 && !ioWatchdog(options);
+    std::vector<Classified> classified(targets.size());
+    if (concurrent) {
+        ReorderBuffer<Classified> buffer(targets.size(), prefetchThreads(), targets.size(), classify);
+        for (size_t i = 0; i < targets.size(); ++i) {
+            classified[i] = buffer.get(i);
+        }
+    } else {
+        for (size_t i = 0; i < targets.size(); ++i) {
+            classify(i, classified[i]);
+        }
+    }
+    
+    // Separate files and directories, keeping argument order within each.
+    // Paths read by --from-file stay in input order instead: the file
+    // operands before each directory are shown just ahead of it
+    bool input_order = !options.paths_from.empty();
+    ListingGroup file_group;
+    std::vector<fs::path> directories;
+    std::vector<size_t> files_before;
+    size_t file_operands = 0;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        fs::path p(targets[i]);
+        const Classified& target = classified[i];
+        if (target.error != 0) {
+            m_diagnostics.report(Diagnostics::SERIOUS, "cannot access", targets[i],
+                                 std::error_code(target.error, std::generic_category()));
+            if (target.error == ETIMEDOUT) {
+                file_group.files.push_back(FileInfo::unknown(p, target.error));
             }
+        } else if (target.is_directory && !options.show_directory_entries) {
+            directories.push_back(p);
+            files_before.push_back(file_group.files.size());
         } else {
-            std::cerr << "ls++: cannot access '" << target << "': No such file or directory\n";
+            // The lstat above already has everything FileInfo needs; operands
+            // are shown as given, not by their last component
+            std::string link = S_ISLNK(target.st.st_mode) ? linkTarget(p, options) : std::string();
+            file_group.files.emplace_back(p, target.st, std::move(link));
+            file_group.files.back().display_name = p;
+            ++file_operands;
         }
     }
     
     // Process files first
-    for (const auto& file : files) {
-        all_files.emplace_back(file);
+    if (dereference_targets) {
+        dereferenceLinks(file_group.files, 0, options);
+    }
+    loadAttributes(file_group.files, options);
+    size_t files_shown = 0;
+    auto showFiles = [&](size_t end) {
+        if (end <= files_shown) {
+            return;
+        }
+        ListingGroup group;
+        group.files.assign(std::make_move_iterator(file_group.files.begin() + static_cast<std::ptrdiff_t>(files_shown)),
+                           std::make_move_iterator(file_group.files.begin() + static_cast<std::ptrdiff_t>(end)));
+        files_shown = end;
+        sink(group);
+    };
+    if (!input_order) {
+        showFiles(file_group.files.size());
     }
     
     // Process directories
-    bool show_headers = (files.size() + directories.size()) > 1;
-    bool first_dir = files.empty();
-    
-    for (const auto& dir : directories) {
-        if (show_headers) {
-            if (!first_dir) {
-                std::cout << "\n";
-            }
-            std::cout << dir.string() << ":\n";
-            first_dir = false;
+    bool show_headers = (input_order || file_operands + directories.size() > 1) && printsHeaders(options);
+    // A directory named alone is where --flat paths start
+    bool single_root = targets.size() == 1 && !input_order;
+    auto listTarget = [&](size_t index, const DirectoryScan* scan) {
+        const fs::path& dir = directories[index];
+        if (input_order) {
+            showFiles(files_before[index]);
         }
-        
-        auto dir_files = listDirectory(dir, options);
+        ListingGroup group;
+        group.directory = dir;
+        group.root = single_root ? dir : fs::path();
+        group.header = show_headers;
+        listGroup(group, options, scan);
+        sink(group);
         
         if (options.recursive) {
-            processDirectoryRecursive(dir, options, dir_files);
+            processDirectoryRecursive(dir, group, options, sink);
         }
-        
-        all_files.insert(all_files.end(), dir_files.begin(), dir_files.end());
+    };
+    
+    // Read the next directories ahead while the current one is listed; the
+    // caches and the watchdog are used by this thread only, so not with them,
+    // and a whole scan held in advance would defeat --max-memory
+    bool prefetch = directories.size() > 1 && !ioWatchdog(options) && !m_memory_cache && !options.use_cache &&
+                    options.max_memory == 0;
+    if (prefetch) {
+        size_t inode_order_min = inodeOrderMin(options);
+        // listEntries filters the scans as it would its own
+        const EntryFilter* filter = options.show_directory_entries ? nullptr : earlyFilter(options);
+        ReorderBuffer<DirectoryScan> scans(directories.size(), prefetchThreads(), PREFETCH_WINDOW,
+                                           [&directories, inode_order_min, filter](size_t index, DirectoryScan& scan) {
+                                               scanDirectory(directories[index], scan, inode_order_min, filter);
+                                           });
+        for (size_t i = 0; i < directories.size(); ++i) {
+            listTarget(i, &scans.get(i));
+        }
+    } else {
+        for (size_t i = 0; i < directories.size(); ++i) {
+            listTarget(i, nullptr);
+        }
+    }
+    showFiles(file_group.files.size());
+}
+
+void FileOperations::processDirectoryRecursive(const fs::path& dir_path, const ListingGroup& group,
+                                               const LsOptions& options, const GroupSink& sink) {
+    struct stat st;
+    if (statEntry(dir_path, true, options, st) != 0) {
+        return;
     }
     
-    return all_files;
+    Traversal traversal;
+    traversal.root = group.root;
+    traversal.device = st.st_dev;
+    traversal.active.emplace(st.st_dev, st.st_ino);
+    processSubdirectories(group.subdirectories, options, sink, traversal, 0);
 }
 
-void FileOperations::processDirectoryRecursive(const fs::path& dir_path, const LsOptions& options, std::vector<FileInfo>& results) {
-    try {
-        for (const auto& entry : fs::directory_iterator(dir_path)) {
-            if (fs::is_directory(entry) && !isHidden(entry.path().filename().string())) {
-                std::cout << "\n" << entry.path().string() << ":\n";
-                
-                auto subdir_files = listDirectory(entry.path(), options);
-                results.insert(results.end(), subdir_files.begin(), subdir_files.end());
-                
-                // Recursive call
-                processDirectoryRecursive(entry.path(), options, results);
-            }
+void FileOperations::processSubdirectories(const std::vector<FileInfo>& subdirectories, const LsOptions& options,
+                                           const GroupSink& sink, Traversal& traversal, int depth) {
+    if (options.max_depth >= 0 && depth >= options.max_depth) {
+        return;
+    }
+    
+    // Each entry as it was listed, so nothing is read or stat'ed again here
+    for (const FileInfo& entry : subdirectories) {
+        if (options.one_file_system && entry.device != traversal.device) {
+            continue;
         }
-    } catch (const fs::filesystem_error& e) {
-        std::cerr << "ls++: cannot read directory '" << dir_path.string() << "': " << e.what() << "\n";
+        
+        // A directory already open further up (symlink or bind mount loop) is not entered again
+        auto identity = std::make_pair(entry.device, entry.inode);
+        if (!traversal.active.insert(identity).second) {
+            m_diagnostics.report(Diagnostics::MINOR, entry.path.string() + ": not listing already-listed directory");
+            continue;
+        }
+        
+        ListingGroup group;
+        group.directory = entry.path;
+        group.root = traversal.root;
+        group.header = printsHeaders(options);
+        listGroup(group, options);
+        sink(group);
+        
+        processSubdirectories(group.subdirectories, options, sink, traversal, depth + 1);
+        traversal.active.erase(identity);
     }
 }
 
-std::vector<FileInfo> FileOperations::filterFiles(const std::vector<FileInfo>& files, const LsOptions& options) {
-    std::vector<FileInfo> filtered;
-    
-    for (const auto& file : files) {
-        if (shouldShowFile(file, options)) {
-            filtered.push_back(file);
+void FileOperations::dereferenceLinks(std::vector<FileInfo>& files, size_t first, const LsOptions& options) {
+    for (size_t i = first; i < files.size(); ++i) {
+        FileInfo& file = files[i];
+        if (!file.is_symlink) {
+            continue;
+        }
+        if (file.symlink_target.empty()) {
+            file.symlink_target = linkTarget(file.path, options);
+        }
+        
+        // One stat per distinct target, however many links point at it
+        std::string key = TargetCache::targetPath(file.path, file.symlink_target);
+        const TargetCache::Entry* target = m_targets.find(key);
+        if (!target) {
+            TargetCache::Entry entry;
+            entry.error = statEntry(key, true, options, entry.st);
+            target = &m_targets.insert(std::move(key), entry);
+        }
+        // A dangling link is listed as the link itself
+        if (target->error == 0) {
+            file.dereference(target->st);
         }
     }
+}
+
+void FileOperations::applyTotalSizes(std::vector<FileInfo>& files, DirectorySizer& sizer) {
+    // Measure every directory of the listing in one parallel walk; everything
+    // else is shown by its allocated size too, so the column compares like with like
+    std::vector<size_t> indices;
+    std::vector<fs::path> roots;
+    for (size_t i = 0; i < files.size(); ++i) {
+        // .. is the parent, not part of this listing
+        if (files[i].is_directory && files[i].display_name != "..") {
+            indices.push_back(i);
+            roots.push_back(files[i].path);
+        } else if (!files[i].is_directory && !files[i].attributesUnknown()) {
+            files[i].size = static_cast<off_t>(files[i].blocks) * 512;
+        }
+    }
+    if (roots.empty()) {
+        return;
+    }
     
-    return filtered;
+    std::vector<DirectorySizer::Failure> failures;
+    std::vector<uint64_t> totals = sizer.measure(roots, failures);
+    for (const auto& failure : failures) {
+        m_diagnostics.report(Diagnostics::MINOR, "cannot read directory", failure.path,
+                             std::error_code(failure.error, std::generic_category()));
+    }
+    for (size_t k = 0; k < indices.size(); ++k) {
+        files[indices[k]].size = static_cast<off_t>(totals[k]);
+    }
+}
+
+bool FileOperations::printsHeaders(const LsOptions& options) {
+    // Records, snapshots and diffs carry each entry's path, so they need no headers
+    return !isRecordFormat(options.format) && options.snapshot_path.empty() && !options.diff;
+}
+
+std::vector<FileInfo> FileOperations::filterFiles(std::vector<FileInfo> files, const LsOptions& options) {
+    std::erase_if(files, [&](const FileInfo& file) { return !shouldShowFile(file, options); });
+    return files;
 }
 
 bool FileOperations::shouldShowFile(const FileInfo& file, const LsOptions& options) const {
+    // Metadata predicates, before any sorting or formatting work
+    return shouldShowName(file, options) && (options.filter.empty() || options.filter.matches(file));
+}
+
+bool FileOperations::shouldShowName(const FileInfo& file, const LsOptions& options) const {
     const std::string& name = file.display_name.string();
     
     // Handle hidden files
@@ -217,65 +910,42 @@ void FileOperations::sortFiles(std::vector<FileInfo>& files, const LsOptions& op
         return;
     }
     
-    // Primary sort
+    std::sort(files.begin(), files.end(), [&](const FileInfo& a, const FileInfo& b) {
+        return compareEntries(a, b, options);
+    });
+    
+    // Reverse if requested
+    if (options.reverse_order) {
+        std::reverse(files.begin(), files.end());
+    }
+}
+
+bool FileOperations::compareEntries(const FileInfo& a, const FileInfo& b, const LsOptions& options) {
+    // If group_directories_first is set, directories should come first
+    if (options.group_directories_first && a.is_directory != b.is_directory) {
+        return a.is_directory > b.is_directory;
+    }
+    
     switch (options.sort_order) {
         case SortOrder::NAME:
-            std::sort(files.begin(), files.end(), [&](const FileInfo& a, const FileInfo& b) {
-                // If group_directories_first is set, directories should come first
-                if (options.group_directories_first && a.is_directory != b.is_directory) {
-                    return a.is_directory > b.is_directory;
-                }
-                return compareByName(a, b, options.ignore_case);
-            });
-            break;
+            return compareByName(a, b, options.ignore_case);
         case SortOrder::TIME:
-            std::sort(files.begin(), files.end(), [&](const FileInfo& a, const FileInfo& b) {
-                // If group_directories_first is set, directories should come first
-                if (options.group_directories_first && a.is_directory != b.is_directory) {
-                    return a.is_directory > b.is_directory;
-                }
-                return compareByTime(a, b, options.time_type);
-            });
-            break;
+            return compareByTime(a, b, options.time_type);
         case SortOrder::SIZE:
-            std::sort(files.begin(), files.end(), [&](const FileInfo& a, const FileInfo& b) {
-                // If group_directories_first is set, directories should come first
-                if (options.group_directories_first && a.is_directory != b.is_directory) {
-                    return a.is_directory > b.is_directory;
-                }
-                return compareBySize(a, b);
-            });
-            break;
+            return compareBySize(a, b);
         case SortOrder::EXTENSION:
-            std::sort(files.begin(), files.end(), [&](const FileInfo& a, const FileInfo& b) {
-                // If group_directories_first is set, directories should come first
-                if (options.group_directories_first && a.is_directory != b.is_directory) {
-                    return a.is_directory > b.is_directory;
-                }
-                return compareByExtension(a, b);
-            });
-            break;
+            return compareByExtension(a, b);
         case SortOrder::VERSION:
-            std::sort(files.begin(), files.end(), [&](const FileInfo& a, const FileInfo& b) {
-                // If group_directories_first is set, directories should come first
-                if (options.group_directories_first && a.is_directory != b.is_directory) {
-                    return a.is_directory > b.is_directory;
-                }
-                return compareByVersion(a, b);
-            });
-            break;
+            return compareByVersion(a, b);
         case SortOrder::NONE:
             break;
     }
-    
-    // Reverse if requested
-    if (options.reverse_order) {
-        std::reverse(files.begin(), files.end());
-    }
+    return false;
 }
 
 bool FileOperations::compareByName(const FileInfo& a, const FileInfo& b, bool ignore_case) {
-    std::locale loc("");
+    // Building a named locale is far more expensive than a comparison
+    static const std::locale loc("");
     const std::string& an = a.display_name.string();
     const std::string& bn = b.display_name.string();
     
@@ -348,12 +1018,16 @@ std::string FileOperations::getFileOwner(uid_t uid, bool numeric) {
         return std::to_string(uid);
     }
     
-    struct passwd* pw = getpwuid(uid);
-    if (pw && pw->pw_name) {
-        return std::string(pw->pw_name);
+    IdNames& names = idNames();
+    std::lock_guard<std::mutex> lock(names.mutex);
+    auto it = names.users.find(uid);
+    if (it != names.users.end()) {
+        return it->second;
     }
     
-    return std::to_string(uid);
+    struct passwd* pw = getpwuid(uid);
+    std::string name = pw && pw->pw_name ? std::string(pw->pw_name) : std::to_string(uid);
+    return names.users.emplace(uid, std::move(name)).first->second;
 }
 
 std::string FileOperations::getFileGroup(gid_t gid, bool numeric) {
@@ -361,24 +1035,34 @@ std::string FileOperations::getFileGroup(gid_t gid, bool numeric) {
         return std::to_string(gid);
     }
     
-    struct group* gr = getgrgid(gid);
-    if (gr && gr->gr_name) {
-        return std::string(gr->gr_name);
+    IdNames& names = idNames();
+    std::lock_guard<std::mutex> lock(names.mutex);
+    auto it = names.groups.find(gid);
+    if (it != names.groups.end()) {
+        return it->second;
     }
     
-    return std::to_string(gid);
+    struct group* gr = getgrgid(gid);
+    std::string name = gr && gr->gr_name ? std::string(gr->gr_name) : std::to_string(gid);
+    return names.groups.emplace(gid, std::move(name)).first->second;
 }
 
 std::string FileOperations::getSymlinkTarget(const fs::path& path) {
-    try {
-        return fs::read_symlink(path).string();
-    } catch (const fs::filesystem_error&) {
-        return "";
-    }
+    char buffer[4096];
+    ssize_t length = readlink(path.c_str(), buffer, sizeof(buffer));
+    return length > 0 ? std::string(buffer, static_cast<size_t>(length)) : std::string();
 }
 
 std::string FileOperations::getSelinuxContext(const fs::path& path) {
-    // SELinux context retrieval would require libselinux
-    // For now, return empty string
-    return "";
+    // Read straight from the xattr, without linking libselinux
+    char buffer[256];
+    ssize_t length = lgetxattr(path.c_str(), "security.selinux", buffer, sizeof(buffer));
+    if (length <= 0) {
+        return "";
+    }
+    // The stored value usually ends in a NUL
+    while (length > 0 && buffer[length - 1] == '\0') {
+        --length;
+    }
+    return std::string(buffer, static_cast<size_t>(length));
 }
\ No newline at end of file
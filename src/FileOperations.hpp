@@ -4,46 +4,114 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <set>
+#include <utility>
+#include <dirent.h>
 #include <sys/stat.h>
 #include "ArgumentParser.hpp"
+#include "Diagnostics.hpp"
+#include "IoWatchdog.hpp"
+#include "ListingCache.hpp"
+#include "MemoryListingCache.hpp"
+#include "TargetCache.hpp"
 
 namespace fs = std::filesystem;
 
+// Forward declarations to avoid circular dependency
+class DirectorySizer;
+class ListingSpill;
+
 struct FileInfo {
     fs::path path;
     fs::path display_name;
     std::string owner;
     std::string group;
-    mode_t mode;
-    off_t size;
-    nlink_t hard_links;
-    ino_t inode;
+    mode_t mode = 0;
+    off_t size = 0;
+    nlink_t hard_links = 0;
+    ino_t inode = 0;
+    dev_t device = 0;
+    blkcnt_t blocks = 0;
+    uid_t uid = 0;
+    gid_t gid = 0;
     std::chrono::system_clock::time_point mtime;
     std::chrono::system_clock::time_point atime;
     std::chrono::system_clock::time_point ctime;
-    bool is_directory;
-    bool is_symlink;
-    bool is_executable;
-    bool is_hidden;
+    bool is_directory = false;
+    bool is_symlink = false;
+    bool is_executable = false;
+    bool is_hidden = false;
     std::string symlink_target;
-    std::string selinux_context;
+    std::string selinux_context;        // -Z
+    std::vector<std::string> xattr_names;   // --xattr
+    bool has_acl = false;               // --acl
+    int stat_error = 0;                 // errno of a failed lstat, ETIMEDOUT past --timeout
+    
+    // Icon classification memo, owned by the IconProvider that last styled this entry
+    mutable uint32_t icon_provider_id = 0;
+    mutable uint32_t icon_style = 0;
     
     FileInfo(const fs::path& p);
+    // From an already known stat; the second form also skips readlink
+    FileInfo(const fs::path& p, const struct stat& st);
+    FileInfo(const fs::path& p, const struct stat& st, std::string target);
+    // From a stored entry: owner and group names are taken as given
+    FileInfo(const fs::path& p, const struct stat& st, std::string target,
+             std::string owner_name, std::string group_name);
+    // An entry known only by name, shown with ? for every attribute
+    static FileInfo unknown(const fs::path& p, int error);
+    bool attributesUnknown() const { return stat_error != 0; }
+    // Takes the attributes of the symlink's target (-L, -H); the name and
+    // symlink_target stay those of the link
+    void dereference(const struct stat& target);
     
 private:
     void loadFileStats();
+    void applyStats(const struct stat& st);
     void loadExtendedInfo();
 };
 
+// One block of output: the file operands, or the entries of one directory
+struct ListingGroup {
+    fs::path directory;                 // empty for the file operands
+    fs::path root;                      // the target directory named alone, if directory lies below it
+    bool header = false;                // print "directory:" above the entries
+    std::vector<FileInfo> files;
+    std::shared_ptr<ListingSpill> spill;    // instead of files, for a listing past --max-memory
+    std::vector<FileInfo> subdirectories;   // -R: where to descend, in listing order, filtered out or not
+};
+
 class FileOperations {
 public:
     FileOperations();
     
     std::vector<FileInfo> listDirectory(const fs::path& path, const LsOptions& options);
     std::vector<FileInfo> processTargets(const std::vector<std::string>& targets, const LsOptions& options);
+    // As ls: the file operands first, then each directory (and with -R its
+    // subdirectories), each group handed to sink in argument order while
+    // later targets are still being read
+    using GroupSink = std::function<void(ListingGroup& group)>;
+    void processTargets(const std::vector<std::string>& targets, const LsOptions& options, const GroupSink& sink);
+    
+    // Serve directory listings from (and record them in) cache; used by --serve
+    void setMemoryCache(MemoryListingCache* cache);
+    
+    // Errors met while listing; callers flush them after printing the listing
+    Diagnostics& diagnostics() { return m_diagnostics; }
     
     void sortFiles(std::vector<FileInfo>& files, const LsOptions& options);
-    std::vector<FileInfo> filterFiles(const std::vector<FileInfo>& files, const LsOptions& options);
+    // Order used by sortFiles, before -r is applied
+    static bool compareEntries(const FileInfo& a, const FileInfo& b, const LsOptions& options);
+    std::vector<FileInfo> filterFiles(std::vector<FileInfo> files, const LsOptions& options);
+    // For entries stat'ed by the caller (--watch): -L, filters, extended
+    // attributes and --total-size as listDirectory applies them
+    void completeEntries(std::vector<FileInfo>& files, const LsOptions& options);
+    // --flat: names the entries of group by their path from group.root (or,
+    // without a root, from the directory as given); . and .. keep their names
+    static void nameByPath(std::vector<FileInfo>& files, const ListingGroup& group);
     
     static bool isHidden(const std::string& name);
     static bool isBackupFile(const std::string& name);
@@ -54,13 +122,116 @@ public:
     static std::string getSelinuxContext(const fs::path& path);
     
 private:
+    std::unique_ptr<ListingCache> m_listing_cache;  // created on first use with --cache
+    MemoryListingCache* m_memory_cache = nullptr;
+    Diagnostics m_diagnostics;
+    TargetCache m_targets;                          // -L/-H target stats, valid for one listing
+    std::unique_ptr<IoWatchdog> m_watchdog;         // created on first use with --timeout
+    
+    // State kept for one listing only, dropped when the next one starts
+    void resetListing();
+    // The watchdog for --timeout, or nullptr when calls run without a deadline
+    IoWatchdog* ioWatchdog(const LsOptions& options);
+    // lstat/stat, through the watchdog when there is one; 0 or an errno
+    // value (ETIMEDOUT when the deadline passed)
+    int statEntry(const fs::path& path, bool follow_links, const LsOptions& options, struct stat& st);
+    // FileInfo(path), readlink and ExtendedAttributes::load, through the
+    // watchdog when there is one; what it gave up on is reported and shown
+    // as unknown (no link target, no attributes)
+    FileInfo entryInfo(const fs::path& path, const LsOptions& options);
+    std::string linkTarget(const fs::path& path, const LsOptions& options);
+    void loadAttributes(std::vector<FileInfo>& files, const LsOptions& options);
+    
+    // A directory read ahead of its turn by processTargets: the names with
+    // their lstat (or its errno) and link text
+    struct DirectoryScan {
+        int error = 0;                  // errno of opening or reading the directory
+        std::vector<std::string> names;
+        std::vector<struct stat> stats;
+        std::vector<int> stat_errors;
+        std::vector<std::string> targets;
+    };
+    // With filter, the link text of entries it rejects is not read
+    static void scanDirectory(const fs::path& path, DirectoryScan& scan, size_t inode_order_min,
+                              const EntryFilter* filter = nullptr);
+    // The two halves of a scan: up to limit more names (false once the
+    // directory is exhausted), then the attributes of those names
+    static bool readNames(DIR* dir, DirectoryScan& scan, std::vector<ino_t>& inodes, size_t limit);
+    static void statEntries(int fd, DirectoryScan& scan, const std::vector<ino_t>& inodes, size_t inode_order_min,
+                            const EntryFilter* filter = nullptr);
+    // With filter, entries it rejects are left out before a FileInfo is
+    // built for them; the directories among them go to dropped, for -R
+    static void appendEntries(const fs::path& path, const DirectoryScan& scan, std::vector<FileInfo>& files,
+                              const EntryFilter* filter = nullptr, std::vector<FileInfo>* dropped = nullptr);
+    static bool rejects(const EntryFilter* filter, const fs::path& entry, const struct stat& st,
+                        const std::string& target, std::vector<FileInfo>* dropped);
+    // options.filter when it can run on the entries as they are read, before
+    // owner names are looked up: not for the caches, which hold whole
+    // listings, nor with -L, which filters the link targets
+    const EntryFilter* earlyFilter(const LsOptions& options) const;
+    
+    // Directories with at least this many entries are stat'ed in inode
+    // order; readdir order is close to random on a large ext4 or XFS
+    // directory, and sorting costs nothing next to a single disk seek
+    static constexpr size_t INODE_ORDER_MIN = 1000;
+    static size_t inodeOrderMin(const LsOptions& options);
+    
+    // Targets classified or directories read ahead by processTargets at once
+    static constexpr size_t PREFETCH_WINDOW = 64;
+    static unsigned prefetchThreads();
+    
+    // listDirectory within a listing already started (targets stay cached);
+    // scan, when given, replaces reading the directory. With group, entries
+    // are named by nameByPath for --flat before they are sorted, and with -R
+    // the group's subdirectories are set
+    std::vector<FileInfo> listEntries(const fs::path& path, const LsOptions& options,
+                                      const DirectoryScan* scan = nullptr, ListingGroup* group = nullptr);
+    // Everything listEntries does between reading and sorting; subdirectories,
+    // when given, gets the directories -R descends into. With filtered, the
+    // entries already went through the metadata filter
+    void finishEntries(std::vector<FileInfo>& files, const LsOptions& options,
+                       std::vector<FileInfo>* subdirectories = nullptr, bool filtered = false);
+    void addSubdirectories(const std::vector<FileInfo>& files, const LsOptions& options,
+                           std::vector<FileInfo>& subdirectories);
+    // Appends the entries of path; false if any of them could not be read
+    bool readDirectory(const fs::path& path, const LsOptions& options, std::vector<FileInfo>& files,
+                       const DirectoryScan* scan = nullptr, const EntryFilter* filter = nullptr,
+                       std::vector<FileInfo>* dropped = nullptr);
+    
+    // Sets group.files to the listing of path, or group.spill when it
+    // outgrows --max-memory
+    void listGroup(ListingGroup& group, const LsOptions& options, const DirectoryScan* scan = nullptr);
+    // --max-memory: reads the directory READ_BATCH names at a time into a
+    // ListingSpill instead of one vector
+    static constexpr size_t READ_BATCH = 4096;
+    void listSpilling(ListingGroup& group, const LsOptions& options);
     void processDirectory(const fs::path& dir_path, const LsOptions& options, 
                          std::vector<FileInfo>& results, bool show_header = false);
-    void processDirectoryRecursive(const fs::path& dir_path, const LsOptions& options, 
-                                  std::vector<FileInfo>& results);
+    // Descends into group.subdirectories, dir_path having just been listed as group
+    void processDirectoryRecursive(const fs::path& dir_path, const ListingGroup& group, const LsOptions& options,
+                                   const GroupSink& sink);
+    
+    // State of one -R walk: the starting file system and the directories
+    // currently open on the way down, to stop at symlink and bind mount loops
+    struct Traversal {
+        fs::path root;
+        dev_t device = 0;
+        std::set<std::pair<dev_t, ino_t>> active;
+    };
+    void processSubdirectories(const std::vector<FileInfo>& subdirectories, const LsOptions& options,
+                               const GroupSink& sink, Traversal& traversal, int depth);
     void processFile(const fs::path& file_path, std::vector<FileInfo>& results);
     
+    // Replaces symlinks in files[first..] with their targets where these exist
+    void dereferenceLinks(std::vector<FileInfo>& files, size_t first, const LsOptions& options);
     bool shouldShowFile(const FileInfo& file, const LsOptions& options) const;
+    // shouldShowFile without the metadata filter: hidden, backup, --ignore and --hide
+    bool shouldShowName(const FileInfo& file, const LsOptions& options) const;
+    static bool printsHeaders(const LsOptions& options);
+    // --total-size: replaces each directory's size with the allocated size of
+    // its contents and every other entry's with its own; hard links are
+    // counted once per sizer
+    void applyTotalSizes(std::vector<FileInfo>& files, DirectorySizer& sizer);
     
     static bool compareByName(const FileInfo& a, const FileInfo& b, bool ignore_case = false);
     static bool compareByTime(const FileInfo& a, const FileInfo& b, TimeType time_type);
@@ -0,0 +1,79 @@
+#include "FlatListing.hpp"
+#include "ListingSpill.hpp"
+#include <iterator>
+#include <queue>
+
+FlatListing::FlatListing(const LsOptions& options)
+    : m_options(options) {}
+
+void FlatListing::add(ListingGroup& group) {
+    // One listing sorted as a whole is held in memory anyway
+    if (group.spill) {
+        group.spill->mergeInto(group.files);
+        group.spill.reset();
+    }
+    // Entries arrive named by path (FileOperations::nameByPath) and sorted
+    // by it; only . and .. of each directory are left out
+    std::vector<FileInfo> run;
+    run.reserve(group.files.size());
+    for (FileInfo& file : group.files) {
+        if (!group.directory.empty() && (file.display_name == "." || file.display_name == "..")) {
+            continue;
+        }
+        run.push_back(std::move(file));
+    }
+    if (run.empty()) {
+        return;
+    }
+    m_entries += run.size();
+    m_runs.push_back(std::move(run));
+}
+
+std::vector<FileInfo> FlatListing::merge() {
+    std::vector<FileInfo> files;
+    files.reserve(m_entries);
+    
+    // Unsorted listings keep the traversal order
+    if (m_options.sort_order == SortOrder::NONE) {
+        for (auto& run : m_runs) {
+            files.insert(files.end(), std::make_move_iterator(run.begin()), std::make_move_iterator(run.end()));
+        }
+    } else {
+        // Head of each run; equal entries come out in traversal order
+        struct Cursor {
+            size_t run;
+            size_t next;
+        };
+        auto later = [this](const Cursor& a, const Cursor& b) {
+            const FileInfo& x = m_runs[a.run][a.next];
+            const FileInfo& y = m_runs[b.run][b.next];
+            if (before(y, x)) {
+                return true;
+            }
+            return !before(x, y) && a.run > b.run;
+        };
+        std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> heads(later);
+        for (size_t i = 0; i < m_runs.size(); ++i) {
+            heads.push({i, 0});
+        }
+        while (!heads.empty()) {
+            Cursor cursor = heads.top();
+            heads.pop();
+            std::vector<FileInfo>& run = m_runs[cursor.run];
+            files.push_back(std::move(run[cursor.next]));
+            if (++cursor.next < run.size()) {
+                heads.push(cursor);
+            }
+        }
+    }
+    
+    m_runs.clear();
+    m_entries = 0;
+    return files;
+}
+
+bool FlatListing::before(const FileInfo& a, const FileInfo& b) const {
+    // sortFiles reverses each whole run for -r
+    return m_options.reverse_order ? FileOperations::compareEntries(b, a, m_options)
+                                   : FileOperations::compareEntries(a, b, m_options);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include "FileOperations.hpp"
+
+// `ls++ --flat [-R] PATH...`: every entry of the trees in one listing, each
+// named by its path and ordered by the sort options across all directories,
+// e.g. `ls++ --flat -lS` for the largest files anywhere below. Directories
+// arrive one at a time from the traversal, each already sorted on its own;
+// merge() combines these runs with a k-way merge over a heap of run heads,
+// so n entries in k directories cost n log k comparisons instead of a sort
+// of the whole tree.
+class FlatListing {
+public:
+    explicit FlatListing(const LsOptions& options);
+
+    // A GroupSink: takes the entries of one listed directory (or the file operands)
+    void add(ListingGroup& group);
+
+    // All entries added so far, in listing order; the runs are consumed
+    std::vector<FileInfo> merge();
+
+private:
+    const LsOptions& m_options;
+    std::vector<std::vector<FileInfo>> m_runs;
+    size_t m_entries = 0;
+
+    // Whether a should be listed before b, -r included
+    bool before(const FileInfo& a, const FileInfo& b) const;
+};
@@ -1,6 +1,7 @@
 #include "IconProvider.hpp"
 #include "FileOperations.hpp"
 #include <algorithm>
+#include <atomic>
 #include <unistd.h>
 #include <unordered_set>
 
@@ -13,9 +14,13 @@ const std::string IconProvider::BLINK = "\033[5m";
 const std::string IconProvider::REVERSE = "\033[7m";
 
 IconProvider::IconProvider() : m_color_enabled(true) {
+    static std::atomic<uint32_t> next_instance_id{1};
+    m_instance_id = next_instance_id++;
+    
     initializeExtensionMap();
     initializeFilenameMap();
     initializeFiletypeMap();
+    initializeClassification();
 }
 
 void IconProvider::initializeExtensionMap() {
@@ -471,145 +476,300 @@ void IconProvider::initializeFiletypeMap() {
     };
 }
 
+bool IconProvider::findStyle(ThemeCache::Kind kind, const std::string& key, IconStyle& style) const {
+    const auto& map = kind == ThemeCache::Kind::EXTENSION ? m_extension_map
+                    : kind == ThemeCache::Kind::FILENAME ? m_filename_map
+                    : m_filetype_map;
+    auto it = map.find(key);
+    bool found = it != map.end();
+    if (found) {
+        style = it->second;
+    } else {
+        style = IconStyle();
+    }
+    
+    // The theme is looked up in its mapped table, never copied; a field it
+    // leaves empty keeps the built-in value
+    ThemeCache::Entry entry;
+    if (!m_theme.empty() && m_theme.find(kind, key, entry)) {
+        if (!entry.icon.empty()) {
+            style.first = entry.icon;
+        }
+        if (!entry.color.empty()) {
+            style.second = entry.color;
+        }
+        found = true;
+    }
+    return found;
+}
+
+void IconProvider::initializeClassification() {
+    // Names that resolveIconAndColor matches explicitly, on top of m_filename_map
+    static const char* const special_names[] = {
+        "TODO", "TODO.md", "TODO.txt",
+        "LICENSE", "LICENSE.md", "LICENSE.txt", "COPYING", "COPYRIGHT",
+        "README", "README.md", "README.txt"
+    };
+    
+    for (const auto& [name, style] : m_filename_map) {
+        m_named_overrides.insert(name);
+    }
+    m_theme.forEach(ThemeCache::Kind::FILENAME, [this](std::string_view name, const ThemeCache::Entry&) {
+        m_named_overrides.emplace(name);
+    });
+    for (const char* name : special_names) {
+        m_named_overrides.insert(name);
+    }
+    
+    // A file whose raw extension is not in this set can never hit a named
+    // override, so its style depends on the extension alone
+    for (const auto& name : m_named_overrides) {
+        m_named_override_exts.emplace(rawExtension(name));
+    }
+}
+
 std::string IconProvider::getIcon(const FileInfo& file) const {
-    auto [icon, color] = getIconAndColor(file);
-    return icon;
+    return getIconAndColor(file).first;
 }
 
 std::string IconProvider::getColorCode(const FileInfo& file) const {
-    auto [icon, color] = getIconAndColor(file);
-
+    return m_color_enabled ? getIconAndColor(file).second : "";
+}
 
-    return m_color_enabled ? color : "";
+const IconProvider::IconStyle& IconProvider::getIconAndColor(const FileInfo& file) const {
+    if (file.icon_provider_id != m_instance_id) {
+        file.icon_style = classify(file);
+        file.icon_provider_id = m_instance_id;
+    }
+    return m_styles[file.icon_style];
 }
 
-std::pair<std::string, std::string> IconProvider::getIconAndColor(const FileInfo& file) const {
-    // Check for specific file types first
+uint32_t IconProvider::classify(const FileInfo& file) const {
+    const std::string& name = file.display_name.native();
+    std::string key;
+    std::string_view ext;
+    bool by_extension = false;
+    bool by_suffix_color = false;   // LS_COLORS may color it by suffix
+    
+    // Permission bits that LS_COLORS can key on (su, sg, st, ow, tw)
+    char mode_tag = '0';
+    if (file.mode & S_ISUID) mode_tag |= 0x01;
+    if (file.mode & S_ISGID) mode_tag |= 0x02;
+    if (file.mode & S_ISVTX) mode_tag |= 0x04;
+    if (file.mode & S_IWOTH) mode_tag |= 0x08;
+    
     if (file.is_directory) {
-        // Check for special directory names
-        const std::string& dirname = file.display_name.string();
+        // Directory styles depend on the name only through its category
+        key += 'd';
+        key += mode_tag;
+        key += directoryCategory(name);
+    } else if (file.is_symlink) {
+        key = "l";
+    } else if (file.is_executable) {
+        // Without ex= in LS_COLORS executables take their suffix color
+        ext = rawExtension(name);
+        key.reserve(ext.size() + 2);
+        key += 'x';
+        key += mode_tag;
+        key += ext;
+        by_suffix_color = true;
+    } else {
+        ext = rawExtension(name);
+        char name_tag = '0';
+        if (FileOperations::isHidden(name)) name_tag |= 0x01;
+        if (FileOperations::isBackupFile(name)) name_tag |= 0x02;
         
-        // Convert dirname to lowercase for case-insensitive comparison
-        std::string lower_dirname = dirname;
-        std::transform(lower_dirname.begin(), lower_dirname.end(), lower_dirname.begin(), ::tolower);
+        char type_tag = 'f';
+        if (S_ISFIFO(file.mode)) type_tag = 'p';
+        else if (S_ISSOCK(file.mode)) type_tag = 's';
+        else if (S_ISBLK(file.mode)) type_tag = 'b';
+        else if (S_ISCHR(file.mode)) type_tag = 'c';
         
-        // Check for special system folders
-        if (dirname == "Desktop" || dirname == "desktop" || lower_dirname == "desktop") {
-            auto it = m_filename_map.find("Desktop");
-            if (it != m_filename_map.end()) {
-                return it->second;
-            }
-        } else if (dirname == "Documents" || dirname == "documents" || lower_dirname == "documents") {
-            auto it = m_filename_map.find("Documents");
-            if (it != m_filename_map.end()) {
-                return it->second;
-            }
-        } else if (dirname == "Downloads" || dirname == "downloads" || lower_dirname == "downloads") {
-            auto it = m_filename_map.find("Downloads");
-            if (it != m_filename_map.end()) {
-                return it->second;
-            }
-        } else if (dirname == "Music" || dirname == "music" || lower_dirname == "music" || 
-                   lower_dirname.find("music") != std::string::npos || lower_dirname.find("audio") != std::string::npos) {
-            // Use musical note for music folders - check if we have a better icon
-            auto it = m_filename_map.find("Music");
-            if (it != m_filename_map.end()) {
-                return it->second;
-            }
-            // Fallback to standard musical note
-            return {"\ufb2c", "\033[38;2;255;100;150m"};
-        } else if (dirname == "Pictures" || dirname == "pictures" || lower_dirname == "pictures" ||
-                   lower_dirname.find("picture") != std::string::npos || lower_dirname.find("photo") != std::string::npos) {
-            auto it = m_filename_map.find("Pictures");
-            if (it != m_filename_map.end()) {
-                return it->second;
-            }
-        } else if (dirname == "Videos" || dirname == "videos" || lower_dirname == "videos" ||
-                   lower_dirname.find("video") != std::string::npos || lower_dirname.find("movie") != std::string::npos) {
-            auto it = m_filename_map.find("Videos");
-            if (it != m_filename_map.end()) {
-                return it->second;
-            }
-        } else if (dirname == "Public" || dirname == "public" || lower_dirname == "public") {
-            auto it = m_filename_map.find("Public");
-            if (it != m_filename_map.end()) {
-                return it->second;
-            }
-        } else if (dirname == "Templates" || dirname == "templates" || lower_dirname == "templates") {
-            auto it = m_filename_map.find("Templates");
-            if (it != m_filename_map.end()) {
-                return it->second;
-            }
-        } else if (dirname == ".git" || dirname == ".github" || dirname == ".gitlab" || dirname == ".svn" || dirname == ".hg") {
-            auto it = m_filetype_map.find("git");
-            if (it != m_filetype_map.end()) {
-                return it->second;
-            }
-        } else if (dirname == ".ssh" || dirname == ".gnupg" || dirname == ".config" || dirname == ".cache" || dirname == ".local") {
-            auto it = m_filetype_map.find("hidden");
-            if (it != m_filetype_map.end()) {
-                return it->second;
-            }
+        key.reserve(ext.size() + 3);
+        key += type_tag;
+        key += mode_tag;
+        key += name_tag;
+        key += ext;
+        by_extension = true;
+        by_suffix_color = true;
+    }
+    
+    auto it = m_class_cache.find(key);
+    if (it == m_class_cache.end()) {
+        bool named_overrides = by_extension && m_named_override_exts.count(std::string(ext)) > 0;
+        if (named_overrides && m_named_overrides.count(name) > 0) {
+            // An override's style is its own; the class is resolved from a plain name
+            return internStyle(resolveIconAndColor(file));
+        }
+        StyleClass style_class{
+            internStyle(resolveIconAndColor(file)),
+            named_overrides,
+            by_suffix_color && m_ls_colors.dependsOnName(ext)
+        };
+        it = m_class_cache.emplace(std::move(key), style_class).first;
+        if (style_class.colors_by_name) {
+            return style_class.style;
+        }
+    } else if ((it->second.named_overrides && m_named_overrides.count(name) > 0) ||
+               it->second.colors_by_name) {
+        return internStyle(resolveIconAndColor(file));
+    }
+    
+    return it->second.style;
+}
+
+uint32_t IconProvider::internStyle(const IconStyle& style) const {
+    std::string key;
+    key.reserve(style.first.size() + style.second.size() + 1);
+    key += style.first;
+    key += '\0';
+    key += style.second;
+    
+    auto [it, inserted] = m_style_index.emplace(std::move(key), static_cast<uint32_t>(m_styles.size()));
+    if (inserted) {
+        m_styles.push_back(style);
+    }
+    return it->second;
+}
+
+std::string_view IconProvider::rawExtension(std::string_view name) {
+    // Same rules as fs::path::extension(): a leading dot does not start one
+    size_t dot = name.rfind('.');
+    if (dot == std::string_view::npos || dot == 0) {
+        return {};
+    }
+    return name.substr(dot);
+}
+
+IconProvider::IconStyle IconProvider::resolveIconAndColor(const FileInfo& file) const {
+    IconStyle style = resolveBuiltinIconAndColor(file);
+    
+    // LS_COLORS only changes the color; icons always come from the built-in tables
+    if (const std::string* color = m_ls_colors.colorFor(file)) {
+        style.second = *color;
+    }
+    return style;
+}
+
+char IconProvider::directoryCategory(const std::string& dirname) {
+    // Convert dirname to lowercase for case-insensitive comparison
+    std::string lower_dirname = dirname;
+    std::transform(lower_dirname.begin(), lower_dirname.end(), lower_dirname.begin(), ::tolower);
+    
+    // Special system folders
+    if (lower_dirname == "desktop") {
+        return 'D';
+    } else if (lower_dirname == "documents") {
+        return 'o';
+    } else if (lower_dirname == "downloads") {
+        return 'w';
+    } else if (lower_dirname.find("music") != std::string::npos || lower_dirname.find("audio") != std::string::npos) {
+        return 'm';
+    } else if (lower_dirname.find("picture") != std::string::npos || lower_dirname.find("photo") != std::string::npos) {
+        return 'p';
+    } else if (lower_dirname.find("video") != std::string::npos || lower_dirname.find("movie") != std::string::npos) {
+        return 'v';
+    } else if (lower_dirname == "public") {
+        return 'P';
+    } else if (lower_dirname == "templates") {
+        return 't';
+    } else if (dirname == ".git" || dirname == ".github" || dirname == ".gitlab" || dirname == ".svn" || dirname == ".hg") {
+        return 'g';
+    } else if (dirname == ".ssh" || dirname == ".gnupg" || dirname == ".config" || dirname == ".cache" || dirname == ".local") {
+        return 'h';
+    }
+    return '-';
+}
+
+IconProvider::IconStyle IconProvider::resolveBuiltinIconAndColor(const FileInfo& file) const {
+    IconStyle style;
+    
+    // Check for specific file types first
+    if (file.is_directory) {
+        switch (directoryCategory(file.display_name.string())) {
+            case 'D':
+                if (findStyle(ThemeCache::Kind::FILENAME, "Desktop", style)) return style;
+                break;
+            case 'o':
+                if (findStyle(ThemeCache::Kind::FILENAME, "Documents", style)) return style;
+                break;
+            case 'w':
+                if (findStyle(ThemeCache::Kind::FILENAME, "Downloads", style)) return style;
+                break;
+            case 'm':
+                // Use musical note for music folders - check if we have a better icon
+                if (findStyle(ThemeCache::Kind::FILENAME, "Music", style)) return style;
+                // Fallback to standard musical note
+                return {"\ufb2c", "\033[38;2;255;100;150m"};
+            case 'p':
+                if (findStyle(ThemeCache::Kind::FILENAME, "Pictures", style)) return style;
+                break;
+            case 'v':
+                if (findStyle(ThemeCache::Kind::FILENAME, "Videos", style)) return style;
+                break;
+            case 'P':
+                if (findStyle(ThemeCache::Kind::FILENAME, "Public", style)) return style;
+                break;
+            case 't':
+                if (findStyle(ThemeCache::Kind::FILENAME, "Templates", style)) return style;
+                break;
+            case 'g':
+                if (findStyle(ThemeCache::Kind::TYPE, "git", style)) return style;
+                break;
+            case 'h':
+                if (findStyle(ThemeCache::Kind::TYPE, "hidden", style)) return style;
+                break;
         }
         
-        auto it = m_filetype_map.find("directory");
-        if (it != m_filetype_map.end()) {
-            return it->second;
+        if (findStyle(ThemeCache::Kind::TYPE, "directory", style)) {
+            return style;
         }
     }
     
     if (file.is_symlink) {
-        auto it = m_filetype_map.find("symlink");
-        if (it != m_filetype_map.end()) {
-            return it->second;
+        if (findStyle(ThemeCache::Kind::TYPE, "symlink", style)) {
+            return style;
         }
     }
     
     if (file.is_executable && !file.is_directory) {
-        auto it = m_filetype_map.find("executable");
-        if (it != m_filetype_map.end()) {
-            return it->second;
+        if (findStyle(ThemeCache::Kind::TYPE, "executable", style)) {
+            return style;
         }
     }
     
     // Check for special file categories
     const std::string& filename = file.display_name.string();
     if (filename == "TODO" || filename == "TODO.md" || filename == "TODO.txt") {
-        auto it = m_filename_map.find("TODO");
-        if (it != m_filename_map.end()) {
-            return it->second;
+        if (findStyle(ThemeCache::Kind::FILENAME, "TODO", style)) {
+            return style;
         }
     } else if (filename == "LICENSE" || filename == "LICENSE.md" || filename == "LICENSE.txt" || 
                filename == "COPYING" || filename == "COPYRIGHT") {
-        auto it = m_filename_map.find("LICENSE");
-        if (it != m_filename_map.end()) {
-            return it->second;
+        if (findStyle(ThemeCache::Kind::FILENAME, "LICENSE", style)) {
+            return style;
         }
     } else if (filename == "README" || filename == "README.md" || filename == "README.txt") {
-        auto it = m_filename_map.find("README.md");
-        if (it != m_filename_map.end()) {
-            return it->second;
+        if (findStyle(ThemeCache::Kind::FILENAME, "README.md", style)) {
+            return style;
         }
     }
     
     // Check filename mappings
-    auto filename_it = m_filename_map.find(filename);
-    if (filename_it != m_filename_map.end()) {
-        return filename_it->second;
+    if (findStyle(ThemeCache::Kind::FILENAME, filename, style)) {
+        return style;
     }
     
     // Check for hidden or backup files
     if (FileOperations::isHidden(filename)) {
-        auto it = m_filetype_map.find("hidden");
-        if (it != m_filetype_map.end()) {
-            return it->second;
+        if (findStyle(ThemeCache::Kind::TYPE, "hidden", style)) {
+            return style;
         }
     }
     
     if (FileOperations::isBackupFile(filename)) {
-        auto it = m_filetype_map.find("backup");
-        if (it != m_filetype_map.end()) {
-            return it->second;
+        if (findStyle(ThemeCache::Kind::TYPE, "backup", style)) {
+            return style;
         }
     }
     
@@ -617,16 +777,14 @@ std::pair<std::string, std::string> IconProvider::getIconAndColor(const FileInfo
     std::string extension = file.path.extension().string();
     if (!extension.empty()) {
         std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
-        auto ext_it = m_extension_map.find(extension);
-        if (ext_it != m_extension_map.end()) {
-            return ext_it->second;
+        if (findStyle(ThemeCache::Kind::EXTENSION, extension, style)) {
+            return style;
         }
     }
     
     // Default fallback
-    auto it = m_filetype_map.find("unknown");
-    if (it != m_filetype_map.end()) {
-        return it->second;
+    if (findStyle(ThemeCache::Kind::TYPE, "unknown", style)) {
+        return style;
     }
     
     return {"\uf723", ""};
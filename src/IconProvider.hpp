@@ -1,10 +1,16 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <cstdint>
 #include <tuple>
 #include <filesystem>
 #include <utility>
+#include "LsColors.hpp"
+#include "ThemeCache.hpp"
 
 // Forward declaration to avoid circular dependency
 struct FileInfo;
@@ -13,9 +19,11 @@ class IconProvider {
 public:
     IconProvider();
     
+    using IconStyle = std::pair<std::string, std::string>;
+    
     std::string getIcon(const FileInfo& file) const;
     std::string getColorCode(const FileInfo& file) const;
-    std::pair<std::string, std::string> getIconAndColor(const FileInfo& file) const;
+    const IconStyle& getIconAndColor(const FileInfo& file) const;
     
     void setColorEnabled(bool enabled);
     bool isColorEnabled() const;
@@ -31,6 +39,9 @@ public:
 private:
     bool m_color_enabled;
     
+    // User overrides, mapped from the compiled theme
+    ThemeCache m_theme;
+    
     // Extension-based mappings
     std::unordered_map<std::string, std::pair<std::string, std::string>> m_extension_map;
     
@@ -43,6 +54,36 @@ private:
     void initializeExtensionMap();
     void initializeFilenameMap();
     void initializeFiletypeMap();
+    // Built-in style for key with the theme's override on top; false if neither has one
+    bool findStyle(ThemeCache::Kind kind, const std::string& key, IconStyle& style) const;
+    void initializeClassification();
+    
+    // Classification memo. Every entry resolves to an index into m_styles;
+    // the index is remembered per classification key (type bits plus raw
+    // extension, or the special folder category for directories) and on the
+    // FileInfo itself, so the lookup chain below runs once per distinct key
+    // rather than once per file.
+    struct StyleClass {
+        uint32_t style;
+        bool named_overrides;  // some names with this key have their own mapping
+        bool colors_by_name;   // LS_COLORS suffixes or globs need the full name
+    };
+    
+    uint32_t m_instance_id;
+    LsColors m_ls_colors;
+    mutable std::deque<IconStyle> m_styles;
+    mutable std::unordered_map<std::string, uint32_t> m_style_index;
+    mutable std::unordered_map<std::string, StyleClass> m_class_cache;
+    std::unordered_set<std::string> m_named_overrides;
+    std::unordered_set<std::string> m_named_override_exts;
+    
+    uint32_t classify(const FileInfo& file) const;
+    uint32_t internStyle(const IconStyle& style) const;
+    IconStyle resolveIconAndColor(const FileInfo& file) const;
+    IconStyle resolveBuiltinIconAndColor(const FileInfo& file) const;
+    static std::string_view rawExtension(std::string_view name);
+    // Special folder a directory name falls in ('-' for none); its style depends on nothing else
+    static char directoryCategory(const std::string& dirname);
     
     std::string getFileTypeKey(const FileInfo& file) const;
     std::string normalizeExtension(const std::string& ext) const;
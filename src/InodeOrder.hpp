@@ -0,0 +1,20 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <sys/types.h>
+#include <vector>
+
+// Positions of a directory's entries in ascending inode number (d_ino), the
+// order in which to stat them. On ext4 and XFS inodes are laid out by number,
+// so a cold listing then reads the inode table front to back instead of
+// seeking for every entry; results are stored back at their own positions.
+inline std::vector<size_t> inodeOrder(const std::vector<ino_t>& inodes) {
+    std::vector<size_t> order(inodes.size());
+    std::iota(order.begin(), order.end(), size_t{0});
+    std::stable_sort(order.begin(), order.end(), [&inodes](size_t a, size_t b) {
+        return inodes[a] < inodes[b];
+    });
+    return order;
+}
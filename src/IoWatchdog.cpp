@@ -0,0 +1,234 @@
+#include "IoWatchdog.hpp"
+#include "InodeOrder.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+
+IoWatchdog::IoWatchdog(std::chrono::milliseconds timeout)
+    : m_timeout(timeout) {}
+
+IoWatchdog::~IoWatchdog() {
+    abandonWorker();
+}
+
+void IoWatchdog::serve(std::shared_ptr<Worker> worker) {
+    std::unique_lock<std::mutex> lock(worker->mutex);
+    while (true) {
+        worker->ready.wait(lock, [&] { return worker->abandoned || !worker->calls.empty(); });
+        if (worker->calls.empty()) {
+            return;
+        }
+        auto call = std::move(worker->calls.front());
+        worker->calls.pop_front();
+        lock.unlock();
+        call();
+        lock.lock();
+    }
+}
+
+void IoWatchdog::abandonWorker() {
+    if (!m_worker) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_worker->mutex);
+        m_worker->abandoned = true;
+    }
+    m_worker->ready.notify_one();
+    m_worker.reset();
+}
+
+bool IoWatchdog::run(std::function<void()> call) {
+    struct Completion {
+        std::mutex mutex;
+        std::condition_variable finished;
+        bool done = false;
+    };
+    auto completion = std::make_shared<Completion>();
+
+    if (!m_worker) {
+        m_worker = std::make_shared<Worker>();
+        std::thread(serve, m_worker).detach();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_worker->mutex);
+        m_worker->calls.push_back([call = std::move(call), completion] {
+            call();
+            std::lock_guard<std::mutex> done_lock(completion->mutex);
+            completion->done = true;
+            completion->finished.notify_one();
+        });
+    }
+    m_worker->ready.notify_one();
+
+    std::unique_lock<std::mutex> lock(completion->mutex);
+    if (completion->finished.wait_for(lock, m_timeout, [&] { return completion->done; })) {
+        return true;
+    }
+    lock.unlock();
+    // The worker is stuck in the call; leave it behind and start a new one next time
+    abandonWorker();
+    return false;
+}
+
+IoWatchdog::DirectoryRead IoWatchdog::readDirectory(const fs::path& dir, size_t inode_order_min) {
+    struct Shared {
+        std::mutex mutex;
+        DirectoryRead read;
+    };
+    auto shared = std::make_shared<Shared>();
+    std::string path = dir.string();
+
+    bool finished = run([shared, path, inode_order_min] {
+        DIR* handle = opendir(path.c_str());
+        if (!handle) {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->read.error = errno;
+            return;
+        }
+
+        // Names first, so a slow entry still leaves the rest listed by name
+        std::vector<std::string> names;
+        std::vector<ino_t> inodes;
+        errno = 0;
+        while (struct dirent* entry = readdir(handle)) {
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            inodes.push_back(entry->d_ino);
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->read.names.emplace_back(name);
+            shared->read.stats.emplace_back();
+            shared->read.targets.emplace_back();
+            shared->read.errors.push_back(0);
+        }
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (errno != 0) {
+                shared->read.error = errno;
+            } else {
+                shared->read.enumerated = true;
+            }
+            names = shared->read.names;
+        }
+
+        // Then attributes, without triggering automounts on the way
+        int fd = dirfd(handle);
+        bool by_inode = names.size() >= inode_order_min;
+        std::vector<size_t> order;
+        if (by_inode) {
+            order = inodeOrder(inodes);
+        }
+        for (size_t n = 0; n < names.size(); ++n) {
+            size_t i = by_inode ? order[n] : n;
+            struct stat st;
+            if (fstatat(fd, names[i].c_str(), &st, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT) != 0) {
+                int error = errno;
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                shared->read.errors[i] = error;
+                continue;
+            }
+            std::string target;
+            if (S_ISLNK(st.st_mode)) {
+                char buffer[4096];
+                ssize_t length = readlinkat(fd, names[i].c_str(), buffer, sizeof(buffer));
+                if (length > 0) {
+                    target.assign(buffer, static_cast<size_t>(length));
+                }
+            }
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->read.stats[i] = st;
+            shared->read.targets[i] = std::move(target);
+        }
+        closedir(handle);
+    });
+
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    DirectoryRead read = shared->read;
+    read.timed_out = !finished;
+    return read;
+}
+
+int IoWatchdog::stat(const fs::path& path, bool follow_links, struct stat& result) {
+    struct Shared {
+        std::mutex mutex;
+        struct stat st;
+        int error = 0;
+    };
+    auto shared = std::make_shared<Shared>();
+    std::string name = path.string();
+
+    bool finished = run([shared, name, follow_links] {
+        struct stat st;
+        int flags = AT_NO_AUTOMOUNT | (follow_links ? 0 : AT_SYMLINK_NOFOLLOW);
+        int error = fstatat(AT_FDCWD, name.c_str(), &st, flags) == 0 ? 0 : errno;
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        shared->st = st;
+        shared->error = error;
+    });
+    if (!finished) {
+        return ETIMEDOUT;
+    }
+
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    if (shared->error == 0) {
+        result = shared->st;
+    }
+    return shared->error;
+}
+
+int IoWatchdog::readLink(const fs::path& path, std::string& target) {
+    struct Shared {
+        std::mutex mutex;
+        std::string target;
+        int error = 0;
+    };
+    auto shared = std::make_shared<Shared>();
+    std::string name = path.string();
+
+    bool finished = run([shared, name] {
+        char buffer[4096];
+        ssize_t length = readlink(name.c_str(), buffer, sizeof(buffer));
+        int error = length < 0 ? errno : 0;
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        if (length > 0) {
+            shared->target.assign(buffer, static_cast<size_t>(length));
+        }
+        shared->error = error;
+    });
+    if (!finished) {
+        return ETIMEDOUT;
+    }
+
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    target = std::move(shared->target);
+    return shared->error;
+}
+
+bool IoWatchdog::parseTimeout(const std::string& value, std::chrono::milliseconds& timeout) {
+    std::string number = value;
+    double scale = 1000.0;
+    if (number.size() > 2 && number.compare(number.size() - 2, 2, "ms") == 0) {
+        number.resize(number.size() - 2);
+        scale = 1.0;
+    } else if (number.size() > 1 && number.back() == 's') {
+        number.pop_back();
+    }
+    if (number.empty() || number[0] == '-' || number[0] == '+') {
+        return false;
+    }
+
+    char* end = nullptr;
+    errno = 0;
+    double parsed = std::strtod(number.c_str(), &end);
+    if (errno != 0 || *end != '\0' || !(parsed > 0) || parsed * scale > 86400000.0) {
+        return false;
+    }
+    // Round up so that a tiny timeout never becomes no wait at all
+    timeout = std::chrono::milliseconds(static_cast<long long>(parsed * scale + 0.999));
+    return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+// Runs file system calls for --timeout on a worker thread and gives up on
+// them after a deadline. A call stuck on a dead NFS or FUSE mount cannot be
+// interrupted, so the worker running it is abandoned (it exits whenever the
+// call returns, or with the process) and a fresh one takes the next call.
+// Calls must therefore own everything they touch: anything they share with
+// the caller goes through a shared_ptr.
+class IoWatchdog {
+public:
+    explicit IoWatchdog(std::chrono::milliseconds timeout);
+    ~IoWatchdog();
+
+    IoWatchdog(const IoWatchdog&) = delete;
+    IoWatchdog& operator=(const IoWatchdog&) = delete;
+
+    std::chrono::milliseconds timeout() const { return m_timeout; }
+
+    // Runs call; false if it did not return within the timeout
+    bool run(std::function<void()> call);
+
+    // One directory read under a single deadline: names, then the lstat
+    // (and link target) of each, in inode order once there are at least
+    // inode_order_min entries. On expiry whatever was read so far is
+    // returned; entries without attributes have no value in stats and the
+    // errno of their stat in errors, or 0 if the deadline came first.
+    struct DirectoryRead {
+        bool timed_out = false;
+        bool enumerated = false;    // all names were read (stats may still be missing)
+        int error = 0;              // errno of opening or reading the directory
+        std::vector<std::string> names;
+        std::vector<std::optional<struct stat>> stats;
+        std::vector<int> errors;
+        std::vector<std::string> targets;
+    };
+    DirectoryRead readDirectory(const fs::path& dir, size_t inode_order_min);
+
+    // lstat (or stat) under the deadline, without triggering automounts;
+    // 0, the errno of the call, or ETIMEDOUT if it expired
+    int stat(const fs::path& path, bool follow_links, struct stat& st);
+
+    // readlink under the deadline; 0, the errno of the call, or ETIMEDOUT
+    int readLink(const fs::path& path, std::string& target);
+
+    // Parses "500ms", "2s" or "1.5" (seconds); returns false if invalid
+    static bool parseTimeout(const std::string& value, std::chrono::milliseconds& timeout);
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<std::function<void()>> calls;
+        bool abandoned = false;
+    };
+
+    std::chrono::milliseconds m_timeout;
+    std::shared_ptr<Worker> m_worker;
+
+    static void serve(std::shared_ptr<Worker> worker);
+    void abandonWorker();
+};
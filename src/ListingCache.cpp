@@ -0,0 +1,164 @@
+#include "ListingCache.hpp"
+#include "EntryTable.hpp"
+#include "FileOperations.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+namespace {
+
+// Key words of a LISTING table
+enum KeyWord : size_t {
+    KEY_DEVICE,
+    KEY_INODE,
+    KEY_MTIME_SEC,
+    KEY_MTIME_NSEC,
+    KEY_CTIME_SEC,
+    KEY_CTIME_NSEC,
+    KEY_WRITTEN_SEC,
+    KEY_WRITTEN_NSEC
+};
+
+// Coarsest timestamp granularity we expect (FAT, some NFS servers)
+constexpr int64_t RACY_WINDOW_NSEC = 2000000000LL;
+
+int64_t toNanoseconds(int64_t sec, int64_t nsec) {
+    return sec * 1000000000LL + nsec;
+}
+
+int64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int64_t lastChange(const struct stat& st) {
+    return std::max(toNanoseconds(st.st_mtim.tv_sec, st.st_mtim.tv_nsec),
+                    toNanoseconds(st.st_ctim.tv_sec, st.st_ctim.tv_nsec));
+}
+
+} // namespace
+
+ListingCache::ListingCache(std::chrono::seconds trust_window)
+    : m_directory(defaultDirectory()), m_trust_window(trust_window) {
+}
+
+fs::path ListingCache::defaultDirectory() {
+    if (const char* cache = std::getenv("XDG_CACHE_HOME"); cache && *cache) {
+        return fs::path(cache) / "lspp" / "listings";
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        return fs::path(home) / ".cache" / "lspp" / "listings";
+    }
+    return {};
+}
+
+fs::path ListingCache::tablePath(const struct stat& dir_stat) const {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%llx-%llx",
+                  static_cast<unsigned long long>(dir_stat.st_dev),
+                  static_cast<unsigned long long>(dir_stat.st_ino));
+    return m_directory / name;
+}
+
+bool ListingCache::load(const fs::path& dir, const struct stat& dir_stat, std::vector<FileInfo>& files) const {
+    if (m_directory.empty()) {
+        return false;
+    }
+
+    EntryTable table;
+    if (!table.open(tablePath(dir_stat), EntryTable::Kind::LISTING)) {
+        return false;
+    }
+
+    const uint64_t* key = table.header().key;
+    if (key[KEY_DEVICE] != static_cast<uint64_t>(dir_stat.st_dev) ||
+        key[KEY_INODE] != static_cast<uint64_t>(dir_stat.st_ino) ||
+        static_cast<int64_t>(key[KEY_MTIME_SEC]) != dir_stat.st_mtim.tv_sec ||
+        static_cast<int64_t>(key[KEY_MTIME_NSEC]) != dir_stat.st_mtim.tv_nsec ||
+        static_cast<int64_t>(key[KEY_CTIME_SEC]) != dir_stat.st_ctim.tv_sec ||
+        static_cast<int64_t>(key[KEY_CTIME_NSEC]) != dir_stat.st_ctim.tv_nsec) {
+        return false;
+    }
+
+    int64_t written = toNanoseconds(static_cast<int64_t>(key[KEY_WRITTEN_SEC]),
+                                    static_cast<int64_t>(key[KEY_WRITTEN_NSEC]));
+    if (lastChange(dir_stat) >= written - RACY_WINDOW_NSEC) {
+        // The directory may have changed again within the same timestamp tick
+        return false;
+    }
+
+    int64_t trust_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(m_trust_window).count();
+    bool trusted = nowNanoseconds() - written <= trust_nsec;
+    bool refreshed = false;
+
+    files.clear();
+    files.reserve(table.size());
+
+    for (size_t i = 0; i < table.size(); ++i) {
+        const EntryTable::Record& record = table.record(i);
+        std::string_view name = table.name(i);
+        if (name.empty()) {
+            files.clear();
+            return false;
+        }
+
+        int64_t entry_change = toNanoseconds(record.ctime_sec, record.ctime_nsec);
+        if (trusted && entry_change < written - RACY_WINDOW_NSEC) {
+            files.push_back(table.toFileInfo(i, dir));
+            continue;
+        }
+
+        // Names are still valid (the directory stamp matched), attributes may not be
+        fs::path entry_path = dir / name;
+        struct stat st;
+        if (lstat(entry_path.c_str(), &st) != 0) {
+            files.clear();
+            return false;
+        }
+        files.emplace_back(entry_path, st);
+        refreshed = true;
+    }
+
+    if (refreshed) {
+        store(dir_stat, files);
+    }
+    return true;
+}
+
+void ListingCache::store(const struct stat& dir_stat, const std::vector<FileInfo>& files) const {
+    if (m_directory.empty()) {
+        return;
+    }
+
+    int64_t now = nowNanoseconds();
+    if (lastChange(dir_stat) >= now - RACY_WINDOW_NSEC) {
+        // load() would reject this table anyway
+        return;
+    }
+
+    std::error_code ec;
+    fs::create_directories(m_directory, ec);
+    if (ec) {
+        return;
+    }
+
+    EntryTableWriter writer(EntryTable::Kind::LISTING);
+    writer.setKey(KEY_DEVICE, static_cast<uint64_t>(dir_stat.st_dev));
+    writer.setKey(KEY_INODE, static_cast<uint64_t>(dir_stat.st_ino));
+    writer.setKey(KEY_MTIME_SEC, static_cast<uint64_t>(dir_stat.st_mtim.tv_sec));
+    writer.setKey(KEY_MTIME_NSEC, static_cast<uint64_t>(dir_stat.st_mtim.tv_nsec));
+    writer.setKey(KEY_CTIME_SEC, static_cast<uint64_t>(dir_stat.st_ctim.tv_sec));
+    writer.setKey(KEY_CTIME_NSEC, static_cast<uint64_t>(dir_stat.st_ctim.tv_nsec));
+    writer.setKey(KEY_WRITTEN_SEC, static_cast<uint64_t>(now / 1000000000LL));
+    writer.setKey(KEY_WRITTEN_NSEC, static_cast<uint64_t>(now % 1000000000LL));
+
+    for (const auto& file : files) {
+        if (!writer.add(file, file.display_name.native())) {
+            // Too many names to address; the directory is just not cached
+            return;
+        }
+    }
+
+    // Failing to write (read-only or full cache directory) only costs the next run
+    writer.writeTo(tablePath(dir_stat));
+}
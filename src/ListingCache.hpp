@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <vector>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+// Forward declaration to avoid circular dependency
+struct FileInfo;
+
+// Opt-in (--cache) on-disk cache of directory listings for slow network
+// filesystems. Each directory's entries are stored as an EntryTable under
+// $XDG_CACHE_HOME/lspp/listings, named after the directory's (st_dev, st_ino)
+// and stamped with its mtime and ctime, so one stat of the directory decides
+// whether the cached table can be mapped instead of enumerating it again.
+//
+// Creating, removing or renaming entries changes the directory's mtime, but
+// chmod, writes and truncation of an entry only change the entry's own
+// ctime. Cached entry attributes are therefore trusted for a limited window
+// after they were captured; past it the names are reused and each entry is
+// re-statted. A table written within the filesystem's timestamp granularity
+// of a change to the directory or an entry ("racy", as in git's index) is
+// never trusted for that directory or entry.
+class ListingCache {
+public:
+    explicit ListingCache(std::chrono::seconds trust_window);
+
+    // Fills files with the entries of dir (without . and ..) from the cache;
+    // false if there is no usable table and dir must be listed normally
+    bool load(const fs::path& dir, const struct stat& dir_stat, std::vector<FileInfo>& files) const;
+    void store(const struct stat& dir_stat, const std::vector<FileInfo>& files) const;
+
+    static fs::path defaultDirectory();
+
+private:
+    fs::path m_directory;
+    std::chrono::seconds m_trust_window;
+
+    fs::path tablePath(const struct stat& dir_stat) const;
+};
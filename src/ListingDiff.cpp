@@ -0,0 +1,207 @@
+#include "ListingDiff.hpp"
+#include "ListingSnapshot.hpp"
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+struct Identity {
+    uint64_t device;
+    uint64_t inode;
+
+    bool operator==(const Identity& other) const {
+        return device == other.device && inode == other.inode;
+    }
+};
+
+struct IdentityHash {
+    size_t operator()(const Identity& id) const {
+        return std::hash<uint64_t>()(id.inode * 0x9E3779B97F4A7C15ULL ^ id.device);
+    }
+};
+
+struct Change {
+    char kind;                  // 'A', 'D', 'M' or 'R'
+    std::string_view path;      // sort key: the new path, or the old one for D
+    std::string_view old_path;  // R only
+    std::string fields;         // M and R: what changed
+};
+
+// The part of path below root ("" when root is the path itself)
+std::string_view relativeKey(std::string_view path, std::string_view root) {
+    if (root.empty() || path.substr(0, root.size()) != root) {
+        return path;
+    }
+    std::string_view rest = path.substr(root.size());
+    if (!rest.empty() && rest.front() == '/') {
+        rest.remove_prefix(1);
+    } else if (!rest.empty() && root.back() != '/') {
+        // A sibling sharing the prefix ("dir2" under "dir"), not a child
+        return path;
+    }
+    return rest;
+}
+
+} // namespace
+
+ListingDiff::ListingDiff(const LsOptions& options, FileOperations& file_operations)
+    : m_options(options), m_file_operations(file_operations) {
+}
+
+bool ListingDiff::load(const std::string& target, Side& side, const LsOptions& options) {
+    std::error_code ec;
+    auto status = fs::status(target, ec);
+    std::string root;
+
+    if (!ec && fs::is_directory(status)) {
+        side.files = m_file_operations.processTargets({target}, options);
+        m_file_operations.diagnostics().flush(std::cout, std::cerr);
+        root = target;
+    } else if (!ec && fs::is_regular_file(status)) {
+        ListingSnapshot snapshot;
+        if (!snapshot.open(target)) {
+            std::cerr << "ls++: '" << target << "' is not a directory or an ls++ snapshot\n";
+            return false;
+        }
+        snapshot.entries(side.files);
+        // Snapshots keep the listed paths; older ones without a recorded
+        // root have the listed directory's entries first
+        root = snapshot.root();
+        if (root.empty() && !side.files.empty()) {
+            root = side.files.front().path.parent_path().native();
+        }
+    } else {
+        std::cerr << "ls++: cannot access '" << target << "': No such file or directory\n";
+        return false;
+    }
+
+    // Keys point into side.files, which is not modified from here on
+    side.keys.reserve(side.files.size());
+    for (const auto& file : side.files) {
+        side.keys.push_back(relativeKey(file.path.native(), root));
+    }
+    return true;
+}
+
+bool ListingDiff::sameObject(const FileInfo& a, const FileInfo& b) {
+    // Freed inodes are handed out again, so a file that was deleted and a new
+    // one can share an identity; rename() keeps the type and, for anything but
+    // a directory, the mtime, which a newly created file almost never has
+    if ((a.mode & S_IFMT) != (b.mode & S_IFMT)) {
+        return false;
+    }
+    return a.is_directory || a.mtime == b.mtime;
+}
+
+std::string ListingDiff::changedFields(const FileInfo& a, const FileInfo& b) {
+    std::string fields;
+    auto note = [&fields](const char* field) {
+        fields += fields.empty() ? "" : ", ";
+        fields += field;
+    };
+
+    // A directory's size and mtime follow its children, which are compared themselves
+    if (!(a.is_directory && b.is_directory)) {
+        if (a.size != b.size) {
+            note("size");
+        }
+        if (a.mtime != b.mtime) {
+            note("mtime");
+        }
+    }
+    if (a.mode != b.mode) {
+        note("mode");
+    }
+    if (a.symlink_target != b.symlink_target) {
+        note("target");
+    }
+    return fields;
+}
+
+int ListingDiff::run(const std::string& a, const std::string& b) {
+    // Directories are listed with the recursion of a snapshot they are compared with
+    LsOptions options = m_options;
+    for (const std::string* target : {&a, &b}) {
+        ListingSnapshot snapshot;
+        if (snapshot.open(*target) && !snapshot.root().empty()) {
+            options.recursive = snapshot.recursive();
+        }
+    }
+
+    Side old_side;
+    Side new_side;
+    if (!load(a, old_side, options) || !load(b, new_side, options)) {
+        return 2;
+    }
+
+    std::vector<Change> changes;
+
+    // Build on the old side, probe with the new one
+    std::unordered_map<std::string_view, size_t> by_path;
+    by_path.reserve(old_side.keys.size());
+    for (size_t i = 0; i < old_side.keys.size(); ++i) {
+        by_path.emplace(old_side.keys[i], i);
+    }
+
+    std::vector<bool> matched(old_side.files.size(), false);
+    std::vector<size_t> added;
+    for (size_t i = 0; i < new_side.keys.size(); ++i) {
+        auto it = by_path.find(new_side.keys[i]);
+        if (it == by_path.end()) {
+            added.push_back(i);
+            continue;
+        }
+        matched[it->second] = true;
+        std::string fields = changedFields(old_side.files[it->second], new_side.files[i]);
+        if (!fields.empty()) {
+            changes.push_back({'M', new_side.keys[i], {}, std::move(fields)});
+        }
+    }
+
+    // Leftovers on both sides with the same identity are renames
+    std::unordered_map<Identity, size_t, IdentityHash> by_identity;
+    for (size_t i = 0; i < old_side.files.size(); ++i) {
+        if (!matched[i]) {
+            const FileInfo& file = old_side.files[i];
+            by_identity.emplace(Identity{static_cast<uint64_t>(file.device), static_cast<uint64_t>(file.inode)}, i);
+        }
+    }
+
+    for (size_t i : added) {
+        const FileInfo& file = new_side.files[i];
+        auto it = by_identity.find(Identity{static_cast<uint64_t>(file.device), static_cast<uint64_t>(file.inode)});
+        if (it == by_identity.end() || matched[it->second] || !sameObject(old_side.files[it->second], file)) {
+            changes.push_back({'A', new_side.keys[i], {}, {}});
+            continue;
+        }
+        matched[it->second] = true;
+        changes.push_back({'R', new_side.keys[i], old_side.keys[it->second],
+                           changedFields(old_side.files[it->second], file)});
+    }
+
+    for (size_t i = 0; i < old_side.files.size(); ++i) {
+        if (!matched[i]) {
+            changes.push_back({'D', old_side.keys[i], {}, {}});
+        }
+    }
+
+    std::sort(changes.begin(), changes.end(), [](const Change& x, const Change& y) {
+        return x.path < y.path;
+    });
+
+    for (const auto& change : changes) {
+        std::cout << change.kind << "  ";
+        if (change.kind == 'R') {
+            std::cout << change.old_path << " -> ";
+        }
+        std::cout << change.path;
+        if (!change.fields.empty()) {
+            std::cout << " (" << change.fields << ")";
+        }
+        std::cout << "\n";
+    }
+
+    return changes.empty() ? 0 : 1;
+}
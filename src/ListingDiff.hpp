@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ArgumentParser.hpp"
+#include "FileOperations.hpp"
+
+// `ls++ --diff A B`: compares two listings, each either a live directory
+// (listed with the usual options, -R included) or a --snapshot file. A
+// directory compared with a snapshot is listed with or without -R as the
+// snapshot was taken, so one side never lacks the other's subdirectories.
+// Entries are matched by their path below the listing's root with one hash
+// join; entries left over on both sides are then joined on (device, inode)
+// to find renames (same type, and an unchanged mtime for anything but a
+// directory, since inode numbers are reused). Prints one line per
+// difference, sorted by path:
+//
+//   A path            added
+//   D path            removed
+//   M path (fields)   size, mtime, mode or link target changed
+//   R old -> new      renamed (and changed fields, if any)
+class ListingDiff {
+public:
+    ListingDiff(const LsOptions& options, FileOperations& file_operations);
+
+    // Returns 0 when the listings match, 1 when they differ, 2 on errors
+    int run(const std::string& a, const std::string& b);
+
+private:
+    struct Side {
+        std::vector<FileInfo> files;
+        std::vector<std::string_view> keys;     // path of files[i] below the root
+    };
+
+    const LsOptions& m_options;
+    FileOperations& m_file_operations;
+
+    bool load(const std::string& target, Side& side, const LsOptions& options);
+    static bool sameObject(const FileInfo& a, const FileInfo& b);
+    static std::string changedFields(const FileInfo& a, const FileInfo& b);
+};
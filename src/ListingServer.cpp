@@ -0,0 +1,498 @@
+#include "ListingServer.hpp"
+#include "lspp.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <streambuf>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr const char* PROTOCOL_VERSION = "1";
+constexpr uint32_t MAX_REQUEST_SIZE = 1 << 20;
+
+// Fixed request fields, followed by argv
+enum RequestField : size_t {
+    FIELD_VERSION,
+    FIELD_CWD,
+    FIELD_TERMINAL,
+    FIELD_WIDTH,
+    FIELD_LS_COLORS,
+    FIELD_COLORTERM,
+    FIELD_TERM,
+    FIELD_ARGV
+};
+
+volatile sig_atomic_t g_stop_requested = 0;
+
+void requestStop(int) {
+    g_stop_requested = 1;
+}
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+// Buffered std::streambuf writing straight to a file descriptor
+class FdStreamBuf : public std::streambuf {
+public:
+    explicit FdStreamBuf(int fd) : m_fd(fd) {
+        setp(m_buffer, m_buffer + sizeof(m_buffer));
+    }
+
+    ~FdStreamBuf() override {
+        flush();
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (!flush()) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        return flush() ? 0 : -1;
+    }
+
+private:
+    int m_fd;
+    char m_buffer[64 * 1024];
+
+    bool flush() {
+        const char* data = pbase();
+        size_t remaining = static_cast<size_t>(pptr() - pbase());
+        bool ok = writeAll(m_fd, data, remaining);
+        setp(m_buffer, m_buffer + sizeof(m_buffer));
+        return ok;
+    }
+};
+
+bool readAll(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t got = read(fd, data, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        data += got;
+        size -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+// Copies a rendered memfd to one of our own descriptors
+void copyOutput(int from_fd, int to_fd) {
+    struct stat st;
+    if (fstat(from_fd, &st) != 0) {
+        return;
+    }
+
+    off_t offset = 0;
+    while (offset < st.st_size) {
+        ssize_t sent = sendfile(to_fd, from_fd, &offset, static_cast<size_t>(st.st_size - offset));
+        if (sent > 0) {
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            // Destination does not support sendfile (e.g. opened with O_APPEND)
+            char buffer[64 * 1024];
+            ssize_t got;
+            while ((got = pread(from_fd, buffer, sizeof(buffer), offset)) > 0) {
+                if (!writeAll(to_fd, buffer, static_cast<size_t>(got))) {
+                    return;
+                }
+                offset += got;
+            }
+        }
+        return;
+    }
+}
+
+bool socketAddress(const fs::path& path, struct sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.native().size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.native().size());
+    return true;
+}
+
+int connectTo(const fs::path& path) {
+    struct sockaddr_un address;
+    if (!socketAddress(path, address)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void setEnvironment(const char* name, const std::string& value) {
+    if (value.empty()) {
+        unsetenv(name);
+    } else {
+        setenv(name, value.c_str(), 1);
+    }
+}
+
+} // namespace
+
+ListingServer::ListingServer(Lspp& app, const fs::path& socket_path)
+    : m_app(app), m_socket_path(socket_path), m_listen_fd(-1), m_home_fd(-1) {
+}
+
+ListingServer::~ListingServer() {
+    if (m_home_fd >= 0) {
+        close(m_home_fd);
+    }
+    if (m_listen_fd >= 0) {
+        close(m_listen_fd);
+        unlink(m_socket_path.c_str());
+    }
+}
+
+fs::path ListingServer::defaultSocketPath() {
+    if (const char* runtime = std::getenv("XDG_RUNTIME_DIR"); runtime && *runtime) {
+        return fs::path(runtime) / "lspp.sock";
+    }
+    return fs::path("/tmp") / ("lspp-" + std::to_string(getuid()) + ".sock");
+}
+
+bool ListingServer::listen() {
+    struct sockaddr_un address;
+    if (!socketAddress(m_socket_path, address)) {
+        std::cerr << "ls++: socket path too long: '" << m_socket_path.string() << "'\n";
+        return false;
+    }
+
+    // A socket file nobody answers on is left over from a killed daemon
+    int existing = connectTo(m_socket_path);
+    if (existing >= 0) {
+        close(existing);
+        std::cerr << "ls++: a server is already listening on '" << m_socket_path.string() << "'\n";
+        return false;
+    }
+    unlink(m_socket_path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "ls++: cannot create socket: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    mode_t old_mask = umask(077);
+    int bound = bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+    umask(old_mask);
+
+    if (bound != 0 || ::listen(fd, 128) != 0) {
+        std::cerr << "ls++: cannot listen on '" << m_socket_path.string() << "': " << std::strerror(errno) << "\n";
+        close(fd);
+        return false;
+    }
+
+    m_listen_fd = fd;
+    return true;
+}
+
+int ListingServer::run() {
+    // Requests chdir into the client's directory; keep a handle on ours
+    m_home_fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (m_home_fd < 0) {
+        std::cerr << "ls++: cannot open the working directory: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    if (!listen()) {
+        return 1;
+    }
+
+    if (m_cache.available()) {
+        m_app.fileOperations().setMemoryCache(&m_cache);
+    } else {
+        std::cerr << "ls++: inotify unavailable, listings will not be cached\n";
+    }
+
+    // No SA_RESTART: poll() must return so the stop flag is seen
+    struct sigaction action{};
+    action.sa_handler = requestStop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    struct pollfd fds[2] = {
+        {m_listen_fd, POLLIN, 0},
+        {m_cache.fd(), POLLIN, 0}
+    };
+    nfds_t count = m_cache.available() ? 2 : 1;
+
+    while (!g_stop_requested) {
+        if (poll(fds, count, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "ls++: poll failed: " << std::strerror(errno) << "\n";
+            return 1;
+        }
+
+        if (count > 1 && (fds[1].revents & POLLIN)) {
+            m_cache.processEvents();
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int client_fd = accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client_fd >= 0) {
+                serveClient(client_fd);
+                close(client_fd);
+            }
+        }
+    }
+
+    m_app.fileOperations().setMemoryCache(nullptr);
+    return 0;
+}
+
+void ListingServer::serveClient(int client_fd) {
+    struct ucred peer;
+    socklen_t peer_size = sizeof(peer);
+    if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &peer, &peer_size) != 0 || peer.uid != getuid()) {
+        return;
+    }
+
+    // A stalled client must not block everyone else for long
+    struct timeval timeout{2, 0};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    uint32_t size = 0;
+    if (!readAll(client_fd, reinterpret_cast<char*>(&size), sizeof(size)) || size > MAX_REQUEST_SIZE) {
+        return;
+    }
+    std::string payload(size, '\0');
+    if (!readAll(client_fd, payload.data(), size)) {
+        return;
+    }
+
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (start < payload.size()) {
+        size_t end = payload.find('\0', start);
+        if (end == std::string::npos) {
+            end = payload.size();
+        }
+        fields.push_back(payload.substr(start, end - start));
+        start = end + 1;
+    }
+    if (fields.size() <= FIELD_ARGV || fields[FIELD_VERSION] != PROTOCOL_VERSION) {
+        return;
+    }
+
+    int out_fd = memfd_create("ls++ stdout", MFD_CLOEXEC);
+    int err_fd = memfd_create("ls++ stderr", MFD_CLOEXEC);
+    if (out_fd < 0 || err_fd < 0) {
+        if (out_fd >= 0) close(out_fd);
+        if (err_fd >= 0) close(err_fd);
+        return;
+    }
+
+    // Apply changes that happened before the request was sent
+    m_cache.processEvents();
+    int32_t status = handleRequest(fields, out_fd, err_fd);
+
+    int fds[2] = {out_fd, err_fd};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov{&status, sizeof(status)};
+    struct msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    sendmsg(client_fd, &message, MSG_NOSIGNAL);
+    close(out_fd);
+    close(err_fd);
+}
+
+int ListingServer::handleRequest(const std::vector<std::string>& fields, int out_fd, int err_fd) {
+    FdStreamBuf out_buf(out_fd);
+    FdStreamBuf err_buf(err_fd);
+    std::streambuf* saved_out = std::cout.rdbuf(&out_buf);
+    std::streambuf* saved_err = std::cerr.rdbuf(&err_buf);
+
+    int status = 0;
+    if (chdir(fields[FIELD_CWD].c_str()) != 0) {
+        std::cerr << "ls++: cannot change to '" << fields[FIELD_CWD] << "': " << std::strerror(errno) << "\n";
+        status = 2;
+    } else {
+        setEnvironment("COLORTERM", fields[FIELD_COLORTERM]);
+        setEnvironment("TERM", fields[FIELD_TERM]);
+
+        std::vector<std::string> args(fields.begin() + FIELD_ARGV, fields.end());
+        std::vector<char*> argv;
+        for (auto& arg : args) {
+            argv.push_back(arg.data());
+        }
+        argv.push_back(nullptr);
+
+        try {
+            // The client already parsed these arguments, so --help, --version
+            // and invalid options never reach the daemon
+            bool terminal = fields[FIELD_TERMINAL] == "1";
+            LsOptions options = ArgumentParser().parse(static_cast<int>(args.size()), argv.data(), terminal);
+            options.serve = false;
+            options.use_server = false;
+            if (options.width == 0) {
+                options.width = std::stoi(fields[FIELD_WIDTH]);
+            }
+            status = m_app.processAndDisplay(options, iconProviderFor(fields[FIELD_LS_COLORS]));
+        } catch (const std::exception& e) {
+            std::cerr << "ls++: " << e.what() << "\n";
+            status = 1;
+        }
+    }
+
+    // Later requests and the socket path are resolved from the daemon's own directory
+    if (fchdir(m_home_fd) != 0) {
+        std::cerr << "ls++: cannot return to the working directory: " << std::strerror(errno) << "\n";
+        status = 2;
+    }
+
+    std::cout.flush();
+    std::cerr.flush();
+    std::cout.rdbuf(saved_out);
+    std::cerr.rdbuf(saved_err);
+    std::cout.clear();
+    std::cerr.clear();
+    return status;
+}
+
+IconProvider& ListingServer::iconProviderFor(const std::string& ls_colors) {
+    auto it = m_icon_providers.find(ls_colors);
+    if (it != m_icon_providers.end()) {
+        return *it->second;
+    }
+
+    // Clients rarely differ here; keep a handful of tables at most
+    if (m_icon_providers.size() >= 8) {
+        m_icon_providers.clear();
+    }
+
+    // IconProvider reads LS_COLORS from the environment
+    setEnvironment("LS_COLORS", ls_colors);
+    auto& provider = m_icon_providers[ls_colors];
+    provider = std::make_unique<IconProvider>();
+    return *provider;
+}
+
+int ListingServer::forward(const fs::path& socket_path, int argc, char** argv) {
+    int fd = connectTo(socket_path);
+    if (fd < 0) {
+        return -1;
+    }
+
+    auto env = [](const char* name) {
+        const char* value = std::getenv(name);
+        return std::string(value ? value : "");
+    };
+
+    std::error_code ec;
+    std::string payload;
+    auto append = [&payload](const std::string& field) {
+        payload += field;
+        payload += '\0';
+    };
+    append(PROTOCOL_VERSION);
+    append(fs::current_path(ec).string());
+    append(isatty(STDOUT_FILENO) ? "1" : "0");
+    append(std::to_string(DisplayFormatter::getTerminalWidth()));
+    append(env("LS_COLORS"));
+    append(env("COLORTERM"));
+    append(env("TERM"));
+    for (int i = 0; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--client" || arg.starts_with("--client=")) {
+            continue;
+        }
+        append(argv[i]);
+    }
+
+    uint32_t size = static_cast<uint32_t>(payload.size());
+    if (!writeAll(fd, reinterpret_cast<const char*>(&size), sizeof(size)) ||
+        !writeAll(fd, payload.data(), payload.size())) {
+        close(fd);
+        return -1;
+    }
+
+    int32_t status = 0;
+    int fds[2] = {-1, -1};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov{&status, sizeof(status)};
+    struct msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t got;
+    do {
+        got = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    } while (got < 0 && errno == EINTR);
+    close(fd);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (got != sizeof(status) || !header || header->cmsg_type != SCM_RIGHTS ||
+        header->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        // The daemon went away before answering; nothing was printed yet
+        return -1;
+    }
+    std::memcpy(fds, CMSG_DATA(header), sizeof(fds));
+
+    copyOutput(fds[0], STDOUT_FILENO);
+    copyOutput(fds[1], STDERR_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    return status;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "MemoryListingCache.hpp"
+
+namespace fs = std::filesystem;
+
+// Forward declarations to avoid circular dependency
+class Lspp;
+class IconProvider;
+
+// `ls++ --serve`: a single-threaded daemon on a Unix socket that keeps the
+// process warm (locale, icon tables, classification memo) and directory
+// listings cached in memory. `ls++ --client ARGS` sends its arguments,
+// working directory, terminal width and color environment; the daemon
+// renders into two memfds and passes them back over SCM_RIGHTS together
+// with the exit status, so the client only sendfile()s them to its own
+// stdout and stderr.
+//
+// The socket is created mode 0600 and peers running as another user are
+// refused, since requests are served with the daemon's credentials.
+class ListingServer {
+public:
+    ListingServer(Lspp& app, const fs::path& socket_path);
+    ~ListingServer();
+
+    ListingServer(const ListingServer&) = delete;
+    ListingServer& operator=(const ListingServer&) = delete;
+
+    // Serves requests until SIGINT or SIGTERM; returns the exit status
+    int run();
+
+    // Client side: the request's exit status, or -1 if no daemon answered
+    static int forward(const fs::path& socket_path, int argc, char** argv);
+    static fs::path defaultSocketPath();
+
+private:
+    Lspp& m_app;
+    fs::path m_socket_path;
+    int m_listen_fd;
+    int m_home_fd;  // working directory to return to after each request (O_PATH)
+    MemoryListingCache m_cache;
+    std::unordered_map<std::string, std::unique_ptr<IconProvider>> m_icon_providers;  // by LS_COLORS
+
+    bool listen();
+    void serveClient(int client_fd);
+    int handleRequest(const std::vector<std::string>& fields, int out_fd, int err_fd);
+    IconProvider& iconProviderFor(const std::string& ls_colors);
+};
@@ -0,0 +1,78 @@
+#include "ListingSnapshot.hpp"
+#include "FileOperations.hpp"
+#include <chrono>
+
+bool ListingSnapshot::save(const fs::path& file, const std::vector<FileInfo>& files,
+                           const std::string& root, bool recursive) {
+    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    EntryTableWriter writer(EntryTable::Kind::SNAPSHOT);
+    writer.setKey(KEY_TAKEN_SEC, static_cast<uint64_t>(now / 1000000000LL));
+    writer.setKey(KEY_TAKEN_NSEC, static_cast<uint64_t>(now % 1000000000LL));
+    writer.setKey(KEY_FLAGS, recursive ? uint64_t(RECURSIVE) : uint64_t(0));
+    if (!writer.setKeyString(KEY_ROOT_OFFSET, KEY_ROOT_LENGTH, root)) {
+        return false;
+    }
+
+    // Past 4 GiB of names the table cannot address them; nothing is written
+    for (const auto& entry : files) {
+        if (!writer.add(entry, entry.path.native())) {
+            return false;
+        }
+    }
+    return writer.writeTo(file);
+}
+
+bool ListingSnapshot::open(const fs::path& file) {
+    m_runs.clear();
+    if (!m_table.open(file, EntryTable::Kind::SNAPSHOT)) {
+        return false;
+    }
+
+    // Runs are found from the stored paths alone
+    std::string_view parent;
+    for (size_t i = 0; i < m_table.size(); ++i) {
+        std::string_view current = parentOf(m_table.name(i));
+        if (i == 0 || current != parent) {
+            m_runs.push_back(i);
+            parent = current;
+        }
+    }
+    return true;
+}
+
+std::string_view ListingSnapshot::root() const {
+    return m_table.keyString(KEY_ROOT_OFFSET, KEY_ROOT_LENGTH);
+}
+
+bool ListingSnapshot::recursive() const {
+    return (m_table.header().key[KEY_FLAGS] & RECURSIVE) != 0;
+}
+
+void ListingSnapshot::entries(std::vector<FileInfo>& files) const {
+    files.clear();
+    files.reserve(m_table.size());
+    forEachRun([&files](const fs::path&, std::vector<FileInfo>& run) {
+        files.insert(files.end(), std::make_move_iterator(run.begin()), std::make_move_iterator(run.end()));
+    });
+}
+
+void ListingSnapshot::forEachRun(const RunVisitor& visit) const {
+    std::vector<FileInfo> files;
+    for (size_t run = 0; run < m_runs.size(); ++run) {
+        size_t end = run + 1 < m_runs.size() ? m_runs[run + 1] : m_table.size();
+        files.clear();
+        files.reserve(end - m_runs[run]);
+        for (size_t i = m_runs[run]; i < end; ++i) {
+            files.push_back(m_table.toFileInfo(i, fs::path()));
+        }
+        fs::path directory = files.front().path.parent_path();
+        visit(directory, files);
+    }
+}
+
+std::string_view ListingSnapshot::parentOf(std::string_view path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string_view::npos ? std::string_view() : path.substr(0, slash);
+}
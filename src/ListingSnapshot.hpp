@@ -0,0 +1,58 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "EntryTable.hpp"
+
+namespace fs = std::filesystem;
+
+// Forward declaration to avoid circular dependency
+struct FileInfo;
+
+// `--snapshot=FILE` / `--from-snapshot=FILE`: a complete listing (all
+// directories of a -R run included) saved as one EntryTable of kind SNAPSHOT.
+// Entries keep their listed path and the owner/group names of the host they
+// were captured on, so a snapshot renders the same anywhere, and reading one
+// back maps the file instead of parsing it. Entries of one directory are
+// stored together; an opened snapshot hands them out one such run at a
+// time, building FileInfos only for the run being shown.
+class ListingSnapshot {
+public:
+    enum KeyWord : size_t {
+        KEY_TAKEN_SEC = 0,      // when the snapshot was taken
+        KEY_TAKEN_NSEC,
+        KEY_ROOT_OFFSET,        // the directory listed, as a pool string
+        KEY_ROOT_LENGTH,
+        KEY_FLAGS
+    };
+
+    enum Flag : uint64_t {
+        RECURSIVE = 1 << 0      // taken with -R
+    };
+
+    // root is the single directory listed, or empty for several targets
+    static bool save(const fs::path& file, const std::vector<FileInfo>& files,
+                     const std::string& root, bool recursive);
+
+    // Maps file; false if it is not a snapshot
+    bool open(const fs::path& file);
+    // Empty when the snapshot listed several targets (or predates the key)
+    std::string_view root() const;
+    bool recursive() const;
+    // Every entry at once (--diff)
+    void entries(std::vector<FileInfo>& files) const;
+    // Directories with entries in the snapshot
+    size_t runs() const { return m_runs.size(); }
+    // Calls visit with the directory and entries of each run, in saved order
+    using RunVisitor = std::function<void(const fs::path& directory, std::vector<FileInfo>& files)>;
+    void forEachRun(const RunVisitor& visit) const;
+
+private:
+    EntryTable m_table;
+    std::vector<size_t> m_runs;     // index of the first entry of each run
+
+    static std::string_view parentOf(std::string_view path);
+};
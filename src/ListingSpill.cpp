@@ -0,0 +1,298 @@
+#include "ListingSpill.hpp"
+#include "ExtendedAttributes.hpp"
+#include "FileOperations.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace {
+
+// Writes one run to the temporary directory, in as many tables as its
+// string pool needs; each is mapped once complete and unlinked right away
+class RunWriter {
+public:
+    explicit RunWriter(std::vector<std::unique_ptr<EntryTable>>& tables)
+        : m_tables(tables), m_stream(EntryTable::Kind::SPILL_RUN) {}
+
+    ~RunWriter() {
+        if (m_open) {
+            unlink(m_path.c_str());
+        }
+    }
+
+    void add(const FileInfo& file) {
+        const std::string& name = file.display_name.native();
+        if (m_ok && !m_open) {
+            m_ok = start();
+        }
+        if (m_ok && !m_stream.add(file, name)) {
+            // This table's string pool is full: go on in the next one
+            m_ok = end() && start() && m_stream.add(file, name);
+        }
+    }
+
+    // False if any table could not be written
+    bool finish() {
+        if (m_ok && m_open) {
+            m_ok = end();
+        }
+        return m_ok;
+    }
+
+private:
+    std::vector<std::unique_ptr<EntryTable>>& m_tables;
+    EntryTableStream m_stream;
+    std::string m_path;
+    bool m_open = false;
+    bool m_ok = true;
+
+    bool start() {
+        std::error_code ec;
+        m_path = (fs::temp_directory_path(ec) / "ls++-run-XXXXXX").string();
+        int fd = ec ? -1 : mkstemp(m_path.data());
+        if (fd < 0) {
+            return false;
+        }
+        ::close(fd);
+        m_open = m_stream.open(m_path);
+        if (!m_open) {
+            unlink(m_path.c_str());
+        }
+        return m_open;
+    }
+
+    bool end() {
+        m_open = false;
+        auto table = std::make_unique<EntryTable>();
+        bool written = m_stream.finish() && table->open(m_path, EntryTable::Kind::SPILL_RUN);
+        unlink(m_path.c_str());
+        if (written) {
+            m_tables.push_back(std::move(table));
+        }
+        return written;
+    }
+};
+
+} // namespace
+
+ListingSpill::ListingSpill(const LsOptions& options, fs::path directory)
+    : m_options(options), m_directory(std::move(directory)) {}
+
+ListingSpill::~ListingSpill() = default;
+
+bool ListingSpill::add(std::vector<FileInfo>& batch) {
+    bool written = true;
+    for (FileInfo& file : batch) {
+        m_buffer_bytes += footprint(file);
+        m_buffer.push_back(std::move(file));
+        if (!m_failed && m_buffer_bytes >= m_options.max_memory / 2) {
+            written = writeRun() && written;
+        }
+    }
+    batch.clear();
+    return written;
+}
+
+std::vector<FileInfo> ListingSpill::take() {
+    sortBuffer();
+    m_buffer_bytes = 0;
+    return std::move(m_buffer);
+}
+
+size_t ListingSpill::footprint(const FileInfo& file) {
+    size_t bytes = sizeof(FileInfo) + file.path.native().capacity() + file.display_name.native().capacity() +
+                   file.owner.capacity() + file.group.capacity() + file.symlink_target.capacity();
+    for (const auto& name : file.xattr_names) {
+        bytes += sizeof(name) + name.capacity();
+    }
+    return bytes + file.selinux_context.capacity();
+}
+
+bool ListingSpill::before(const FileInfo& a, const FileInfo& b) const {
+    // As sortFiles, with -r folded in
+    return m_options.reverse_order ? FileOperations::compareEntries(b, a, m_options)
+                                   : FileOperations::compareEntries(a, b, m_options);
+}
+
+void ListingSpill::sortBuffer() {
+    if (m_options.sort_order != SortOrder::NONE) {
+        std::sort(m_buffer.begin(), m_buffer.end(), [this](const FileInfo& a, const FileInfo& b) {
+            return before(a, b);
+        });
+    }
+}
+
+bool ListingSpill::writeRun() {
+    sortBuffer();
+    Run run;
+    RunWriter writer(run.tables);
+    for (const auto& file : m_buffer) {
+        writer.add(file);
+    }
+    if (!writer.finish()) {
+        m_failed = true;
+        return false;
+    }
+
+    m_runs.push_back(std::move(run));
+    m_buffer.clear();
+    m_buffer.shrink_to_fit();
+    m_buffer_bytes = 0;
+
+    // The last MAX_FAN_IN runs share a level when they are all of the newest one
+    while (m_runs.size() >= MAX_FAN_IN && m_runs[m_runs.size() - MAX_FAN_IN].level == m_runs.back().level) {
+        if (!mergeRuns(m_runs.size() - MAX_FAN_IN)) {
+            m_failed = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ListingSpill::mergeRuns(size_t first) {
+    Run merged;
+    merged.level = m_runs[first].level + 1;
+    RunWriter writer(merged.tables);
+    forEachSorted(first, false, [&writer](FileInfo& file) { writer.add(file); });
+    if (!writer.finish()) {
+        return false;
+    }
+    m_runs.erase(m_runs.begin() + static_cast<std::ptrdiff_t>(first), m_runs.end());
+    m_runs.push_back(std::move(merged));
+    return true;
+}
+
+FileInfo ListingSpill::entry(const EntryTable& table, size_t index) const {
+    FileInfo file = table.toFileInfo(index, m_directory);
+    // Entries that could not be stat'ed were stored without a type
+    if (table.record(index).mode == 0) {
+        file.stat_error = EIO;
+    }
+    return file;
+}
+
+void ListingSpill::deliver(std::vector<FileInfo>& batch, const Visitor& visitor) const {
+    ExtendedAttributes::load(batch, 0, ExtendedAttributes::requested(m_options));
+    visitor(batch);
+    batch.clear();
+}
+
+void ListingSpill::visit(const Visitor& visitor) const {
+    std::vector<FileInfo> batch;
+    batch.reserve(OUTPUT_BATCH);
+    for (const auto& run : m_runs) {
+        for (const auto& table : run.tables) {
+            for (size_t i = 0; i < table->size(); ++i) {
+                batch.push_back(entry(*table, i));
+                if (batch.size() == OUTPUT_BATCH) {
+                    deliver(batch, visitor);
+                }
+            }
+        }
+    }
+    for (const auto& file : m_buffer) {
+        batch.push_back(file);
+        if (batch.size() == OUTPUT_BATCH) {
+            deliver(batch, visitor);
+        }
+    }
+    if (!batch.empty()) {
+        deliver(batch, visitor);
+    }
+}
+
+void ListingSpill::forEachSorted(size_t first, bool with_buffer, const Emit& emit) {
+    if (m_options.sort_order == SortOrder::NONE) {
+        // Unsorted listings keep the order of the directory
+        for (size_t source = first; source < m_runs.size(); ++source) {
+            for (const auto& table : m_runs[source].tables) {
+                for (size_t i = 0; i < table->size(); ++i) {
+                    FileInfo file = entry(*table, i);
+                    emit(file);
+                }
+            }
+        }
+        for (size_t i = 0; with_buffer && i < m_buffer.size(); ++i) {
+            emit(m_buffer[i]);
+        }
+        return;
+    }
+
+    if (with_buffer) {
+        sortBuffer();
+    }
+    // A heap of the head of each run and of the entries still in memory
+    // (source m_runs.size()); equal entries come out in the order read
+    struct Cursor {
+        size_t source;
+        size_t table;
+        size_t next;
+        FileInfo head;
+    };
+    auto later = [this](const Cursor& a, const Cursor& b) {
+        if (before(b.head, a.head)) {
+            return true;
+        }
+        return !before(a.head, b.head) && a.source > b.source;
+    };
+    std::vector<Cursor> heads;
+    heads.reserve(m_runs.size() - first + 1);
+    auto advance = [&](size_t source, size_t table, size_t next) {
+        if (source < m_runs.size()) {
+            const Run& run = m_runs[source];
+            while (table < run.tables.size() && next >= run.tables[table]->size()) {
+                ++table;
+                next = 0;
+            }
+            if (table == run.tables.size()) {
+                return;
+            }
+            heads.push_back({source, table, next, entry(*run.tables[table], next)});
+        } else {
+            if (next >= m_buffer.size()) {
+                return;
+            }
+            heads.push_back({source, 0, next, std::move(m_buffer[next])});
+        }
+        std::push_heap(heads.begin(), heads.end(), later);
+    };
+
+    for (size_t source = first; source < m_runs.size(); ++source) {
+        advance(source, 0, 0);
+    }
+    if (with_buffer) {
+        advance(m_runs.size(), 0, 0);
+    }
+    while (!heads.empty()) {
+        std::pop_heap(heads.begin(), heads.end(), later);
+        Cursor cursor = std::move(heads.back());
+        heads.pop_back();
+        emit(cursor.head);
+        advance(cursor.source, cursor.table, cursor.next + 1);
+    }
+}
+
+void ListingSpill::merge(const Visitor& visitor) {
+    std::vector<FileInfo> batch;
+    batch.reserve(OUTPUT_BATCH);
+    forEachSorted(0, true, [&](FileInfo& file) {
+        batch.push_back(std::move(file));
+        if (batch.size() == OUTPUT_BATCH) {
+            deliver(batch, visitor);
+        }
+    });
+    if (!batch.empty()) {
+        deliver(batch, visitor);
+    }
+
+    m_runs.clear();
+    m_buffer.clear();
+    m_buffer_bytes = 0;
+}
+
+void ListingSpill::mergeInto(std::vector<FileInfo>& files) {
+    merge([&files](std::vector<FileInfo>& batch) {
+        files.insert(files.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+    });
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "ArgumentParser.hpp"
+#include "EntryTable.hpp"
+
+namespace fs = std::filesystem;
+
+// Forward declaration to avoid circular dependency
+struct FileInfo;
+
+// One directory listed within --max-memory=SIZE. Entries are added in
+// batches while the directory is read; once they take up half the budget
+// they are sorted and written out as a run, an EntryTable of kind SPILL_RUN
+// in the temporary directory, and the buffer starts over. merge() combines
+// the runs with a k-way merge that rebuilds a FileInfo only for the head of
+// each run, so output needs one entry per run plus the batch being written.
+// Once MAX_FAN_IN runs of one level pile up they are merged into a single
+// run of the next level, so however large the directory, fewer than
+// MAX_FAN_IN runs per level are open (each is a mapping and a heap cursor).
+// Run files are mapped and unlinked right away: the kernel pages them in and
+// out as the merge moves along, and nothing is left behind if ls++ is killed.
+class ListingSpill {
+public:
+    ListingSpill(const LsOptions& options, fs::path directory);
+    ~ListingSpill();
+
+    ListingSpill(const ListingSpill&) = delete;
+    ListingSpill& operator=(const ListingSpill&) = delete;
+
+    // Takes the entries of batch; false if a run could not be written, in
+    // which case entries stay in memory from then on
+    bool add(std::vector<FileInfo>& batch);
+
+    // Whether any run was written; if not, take() returns the sorted listing
+    bool spilled() const { return !m_runs.empty(); }
+    std::vector<FileInfo> take();
+
+    // Every entry, OUTPUT_BATCH at a time: visit() in no particular order
+    // (to measure column widths first), merge() in listing order. merge()
+    // consumes the entries, so it comes last
+    using Visitor = std::function<void(std::vector<FileInfo>& batch)>;
+    void visit(const Visitor& visitor) const;
+    void merge(const Visitor& visitor);
+    // merge() into one vector, for callers that need the whole listing anyway
+    void mergeInto(std::vector<FileInfo>& files);
+
+    // Approximate heap bytes held by an entry
+    static size_t footprint(const FileInfo& file);
+
+    static constexpr size_t OUTPUT_BATCH = 1024;
+    static constexpr size_t MAX_FAN_IN = 64;
+
+private:
+    // Sorted entries on disk: one table, or after a merge as many as the
+    // string pool needed, whose concatenation is sorted
+    struct Run {
+        std::vector<std::unique_ptr<EntryTable>> tables;
+        size_t level = 0;       // merges its entries went through
+    };
+
+    const LsOptions& m_options;
+    fs::path m_directory;
+    std::vector<FileInfo> m_buffer;
+    size_t m_buffer_bytes = 0;
+    std::vector<Run> m_runs;    // in the order read; levels never increase along it
+    bool m_failed = false;
+
+    bool before(const FileInfo& a, const FileInfo& b) const;
+    void sortBuffer();
+    bool writeRun();
+    // Replaces the runs from first on with one run of the next level
+    bool mergeRuns(size_t first);
+    // Hands the entries of the runs from first on (and of the buffer, with
+    // with_buffer) to emit in listing order; equal entries in the order read
+    using Emit = std::function<void(FileInfo& file)>;
+    void forEachSorted(size_t first, bool with_buffer, const Emit& emit);
+    // Entry index of table, as listed (attributes of the options included)
+    FileInfo entry(const EntryTable& table, size_t index) const;
+    // Fills in what runs do not store, then hands the batch over
+    void deliver(std::vector<FileInfo>& batch, const Visitor& visitor) const;
+};
@@ -0,0 +1,473 @@
+#include "ListingSummary.hpp"
+#include "FileOperations.hpp"
+#include "RecordWriter.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+bool isDotOrDotDot(const char* name) {
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+bool before(const struct timespec& a, const struct timespec& b) {
+    return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+std::chrono::system_clock::time_point toTimePoint(const struct timespec& ts) {
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec)));
+}
+
+std::string formatLocalTime(const struct timespec& ts) {
+    char text[32];
+    std::time_t seconds = ts.tv_sec;
+    std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", std::localtime(&seconds));
+    return text;
+}
+
+} // namespace
+
+ListingSummary::ListingSummary(const LsOptions& options)
+    : m_options(options), m_aggregates(options.summary),
+      m_entries(0), m_types{}, m_bytes(0), m_largest(0), m_size_histogram{},
+      m_oldest{}, m_newest{} {
+    // Only the type breakdown (and --type) can be had from readdir alone
+    m_needs_stat = (m_aggregates & ~TYPES) != 0 || (options.filter.needs() & ~EntryFilter::TYPE) != 0;
+}
+
+unsigned ListingSummary::parseAggregates(const std::string& list) {
+    if (list.empty() || list == "all") {
+        return ALL;
+    }
+
+    unsigned mask = 0;
+    std::istringstream fields(list);
+    std::string field;
+    while (std::getline(fields, field, ',')) {
+        if (field == "types") {
+            mask |= TYPES;
+        } else if (field == "extensions") {
+            mask |= EXTENSIONS;
+        } else if (field == "sizes") {
+            mask |= SIZES;
+        } else if (field == "times") {
+            mask |= TIMES;
+        } else if (field == "owners") {
+            mask |= OWNERS;
+        } else {
+            return 0;
+        }
+    }
+    return mask;
+}
+
+int ListingSummary::run(const std::vector<std::string>& targets, std::ostream& out) {
+    for (const auto& target : targets) {
+        struct stat st;
+        if (lstat(target.c_str(), &st) != 0) {
+            m_diagnostics.report(Diagnostics::SERIOUS, "cannot access", target,
+                                 std::error_code(errno, std::generic_category()));
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode) && !m_options.show_directory_entries) {
+            walk(target);
+        } else {
+            // A target named on the command line is counted as itself, if
+            // it passes the metadata filter the walk applies to entries
+            fs::path path(target);
+            std::string dir = path.parent_path().native();
+            std::string name = path.filename().native();
+            unsigned char d_type = IFTODT(st.st_mode);
+            if (m_options.filter.empty() || passesFilter(dir.empty() ? "." : dir, name.c_str(), d_type, &st)) {
+                add(dir, name, typeOf(d_type), &st);
+            }
+        }
+    }
+
+    if (isRecordFormat(m_options.format)) {
+        printJson(out);
+    } else {
+        printTable(out);
+    }
+    int status = m_diagnostics.exitStatus();
+    m_diagnostics.flush(out, std::cerr);
+    return status;
+}
+
+void ListingSummary::walk(const std::string& root) {
+    struct stat root_stat;
+    dev_t device = stat(root.c_str(), &root_stat) == 0 ? root_stat.st_dev : 0;
+
+    // Directories still to read, with their depth; entries themselves are never kept
+    std::vector<std::pair<std::string, int>> pending{{root, 0}};
+
+    while (!pending.empty()) {
+        auto [dir, depth] = std::move(pending.back());
+        pending.pop_back();
+        bool descend = m_options.recursive && (m_options.max_depth < 0 || depth < m_options.max_depth);
+
+        int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR* stream = fd >= 0 ? fdopendir(fd) : nullptr;
+        if (!stream) {
+            // As in a listing, only a directory named on the command line is serious
+            int error = errno;
+            if (fd >= 0) {
+                close(fd);
+            }
+            m_diagnostics.report(depth == 0 ? Diagnostics::SERIOUS : Diagnostics::MINOR,
+                                 "cannot open directory", dir, std::error_code(error, std::generic_category()));
+            continue;
+        }
+
+        while (struct dirent* entry = readdir(stream)) {
+            const char* name = entry->d_name;
+            if (isDotOrDotDot(name) || !shouldCount(name)) {
+                continue;
+            }
+
+            EntryType type = typeOf(entry->d_type);
+            struct stat st;
+            const struct stat* stats = nullptr;
+            bool check_device = descend && m_options.one_file_system && entry->d_type == DT_DIR;
+            if (m_needs_stat || check_device || entry->d_type == DT_UNKNOWN) {
+                if (fstatat(dirfd(stream), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                stats = &st;
+                type = typeOf(IFTODT(st.st_mode));
+            }
+
+            if (m_options.filter.empty() || passesFilter(dir, name, entry->d_type, stats)) {
+                add(dir, name, type, stats);
+            }
+
+            // Filtered out or not, a directory can hold entries that count
+            if (descend && type == DIRECTORY_TYPE &&
+                (!m_options.one_file_system || (stats ? stats->st_dev : device) == device)) {
+                pending.emplace_back(dir + "/" + name, depth + 1);
+            }
+        }
+        closedir(stream);
+    }
+}
+
+bool ListingSummary::shouldCount(const char* name) const {
+    // The same rules FileOperations::shouldShowFile applies to listings
+    if (name[0] == '.' && !m_options.show_all && !m_options.show_almost_all) {
+        return false;
+    }
+    if (m_options.ignore_backups && name[0] != '\0' && name[std::strlen(name) - 1] == '~') {
+        return false;
+    }
+    for (const auto& pattern : m_options.ignore_patterns) {
+        if (fnmatch(pattern.c_str(), name, 0) == 0) {
+            return false;
+        }
+    }
+    for (const auto& pattern : m_options.hide_patterns) {
+        if (fnmatch(pattern.c_str(), name, 0) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ListingSummary::passesFilter(const std::string& dir, const char* name, unsigned char d_type,
+                                  const struct stat* st) const {
+    EntryFilter::Subject subject;
+    std::string path;
+    if (st) {
+        subject.mode = st->st_mode;
+        subject.size = st->st_size;
+        subject.mtime_nsec = static_cast<int64_t>(st->st_mtim.tv_sec) * 1000000000LL + st->st_mtim.tv_nsec;
+        subject.uid = st->st_uid;
+    } else {
+        subject.mode = DTTOIF(d_type);
+    }
+    if (m_options.filter.needs() & EntryFilter::CONTENTS) {
+        path = dir + "/" + name;
+        subject.path = path.c_str();
+    }
+    return m_options.filter.matches(subject);
+}
+
+void ListingSummary::add(const std::string& dir, std::string_view name, EntryType type, const struct stat* st) {
+    ++m_entries;
+    ++m_types[type];
+
+    if (!st) {
+        return;
+    }
+
+    // Sizes are those of regular files; a directory's size says nothing about its contents
+    uint64_t size = type == FILE_TYPE ? static_cast<uint64_t>(st->st_size) : 0;
+
+    if (type == FILE_TYPE && (m_aggregates & SIZES)) {
+        m_bytes += size;
+        m_largest = std::max(m_largest, size);
+        ++m_size_histogram[sizeBucket(size)];
+    }
+
+    if (type == FILE_TYPE && (m_aggregates & EXTENSIONS)) {
+        size_t dot = name.rfind('.');
+        std::string extension = (dot == std::string_view::npos || dot == 0) ? std::string()
+                                                                             : std::string(name.substr(dot));
+        auto it = m_extensions.find(extension);
+        if (it == m_extensions.end() && m_extensions.size() < MAX_KEYS) {
+            it = m_extensions.emplace(std::move(extension), Tally{}).first;
+        }
+        Tally& tally = it != m_extensions.end() ? it->second : m_other_extensions;
+        ++tally.entries;
+        tally.bytes += size;
+    }
+
+    if (m_aggregates & OWNERS) {
+        auto it = m_owners.find(st->st_uid);
+        if (it == m_owners.end() && m_owners.size() < MAX_KEYS) {
+            it = m_owners.emplace(st->st_uid, Tally{}).first;
+        }
+        Tally& tally = it != m_owners.end() ? it->second : m_other_owners;
+        ++tally.entries;
+        tally.bytes += size;
+    }
+
+    if (m_aggregates & TIMES) {
+        // Paths are only built for the (rare) entries that become the new extreme
+        bool first = m_oldest_path.empty();
+        auto path = [&dir, name] {
+            return dir.empty() ? std::string(name) : dir + "/" + std::string(name);
+        };
+        if (first || before(st->st_mtim, m_oldest)) {
+            m_oldest = st->st_mtim;
+            m_oldest_path = path();
+        }
+        if (first || before(m_newest, st->st_mtim)) {
+            m_newest = st->st_mtim;
+            m_newest_path = path();
+        }
+    }
+}
+
+size_t ListingSummary::sizeBucket(uint64_t size) {
+    if (size < 8) {
+        return static_cast<size_t>(size);
+    }
+    int exponent = 63 - __builtin_clzll(size);
+    uint64_t sub = (size >> (exponent - 3)) & 7;
+    return 8 + static_cast<size_t>(exponent - 3) * 8 + static_cast<size_t>(sub);
+}
+
+uint64_t ListingSummary::bucketLimit(size_t bucket) {
+    if (bucket < 8) {
+        return bucket;
+    }
+    int shift = static_cast<int>((bucket - 8) / 8);
+    uint64_t sub = (bucket - 8) % 8;
+    uint64_t lower = (8 + sub) << shift;
+    return lower + ((uint64_t(1) << shift) - 1);
+}
+
+uint64_t ListingSummary::percentile(double fraction) const {
+    uint64_t count = 0;
+    for (uint64_t n : m_size_histogram) {
+        count += n;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(count))));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < SIZE_BUCKETS; ++bucket) {
+        seen += m_size_histogram[bucket];
+        if (seen >= rank) {
+            return std::min(bucketLimit(bucket), m_largest);
+        }
+    }
+    return m_largest;
+}
+
+ListingSummary::EntryType ListingSummary::typeOf(unsigned char d_type) {
+    switch (d_type) {
+        case DT_REG: return FILE_TYPE;
+        case DT_DIR: return DIRECTORY_TYPE;
+        case DT_LNK: return SYMLINK_TYPE;
+        case DT_FIFO: return FIFO_TYPE;
+        case DT_SOCK: return SOCKET_TYPE;
+        case DT_BLK: return BLOCK_TYPE;
+        case DT_CHR: return CHAR_TYPE;
+        default: return OTHER_TYPE;
+    }
+}
+
+const char* ListingSummary::typeName(EntryType type) {
+    static const char* const names[TYPE_COUNT] = {
+        "file", "directory", "symlink", "fifo", "socket", "block_device", "char_device", "other"
+    };
+    return names[type];
+}
+
+std::string ListingSummary::formatSize(uint64_t bytes) const {
+    if (!m_options.human_readable) {
+        return std::to_string(bytes);
+    }
+
+    const char* suffixes = "BKMGTPE";
+    double base = m_options.si_units ? 1000.0 : 1024.0;
+    double value = static_cast<double>(bytes);
+    size_t index = 0;
+    while (value >= base && index < 6) {
+        value /= base;
+        ++index;
+    }
+
+    std::ostringstream text;
+    if (index == 0) {
+        text << bytes;
+    } else {
+        text << std::fixed << std::setprecision(value < 10.0 ? 1 : 0) << value << suffixes[index];
+    }
+    return text.str();
+}
+
+void ListingSummary::printTable(std::ostream& out) const {
+    out << std::left << std::setw(14) << "entries" << m_entries << "\n";
+
+    if (m_aggregates & TYPES) {
+        for (size_t type = 0; type < TYPE_COUNT; ++type) {
+            if (m_types[type] > 0) {
+                out << "  " << std::setw(12) << typeName(static_cast<EntryType>(type)) << m_types[type] << "\n";
+            }
+        }
+    }
+
+    if (m_aggregates & SIZES) {
+        uint64_t files = m_types[FILE_TYPE];
+        out << std::setw(14) << "bytes" << formatSize(m_bytes) << "\n";
+        out << std::setw(14) << "mean size" << formatSize(files ? m_bytes / files : 0) << "\n";
+        out << std::setw(14) << "median size" << formatSize(percentile(0.5)) << "\n";
+        out << std::setw(14) << "p90 size" << formatSize(percentile(0.9)) << "\n";
+        out << std::setw(14) << "p99 size" << formatSize(percentile(0.99)) << "\n";
+        out << std::setw(14) << "largest" << formatSize(m_largest) << "\n";
+    }
+
+    if ((m_aggregates & TIMES) && !m_oldest_path.empty()) {
+        out << std::setw(14) << "oldest" << formatLocalTime(m_oldest) << "  " << m_oldest_path << "\n";
+        out << std::setw(14) << "newest" << formatLocalTime(m_newest) << "  " << m_newest_path << "\n";
+    }
+
+    if (m_aggregates & EXTENSIONS) {
+        std::vector<std::pair<std::string, Tally>> rows(m_extensions.begin(), m_extensions.end());
+        std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+            return a.second.bytes != b.second.bytes ? a.second.bytes > b.second.bytes : a.first < b.first;
+        });
+        out << "extensions\n";
+        for (const auto& [extension, tally] : rows) {
+            out << "  " << std::setw(12) << (extension.empty() ? "(none)" : extension)
+                << std::setw(12) << tally.entries << formatSize(tally.bytes) << "\n";
+        }
+        if (m_other_extensions.entries > 0) {
+            out << "  " << std::setw(12) << "(other)" << std::setw(12) << m_other_extensions.entries
+                << formatSize(m_other_extensions.bytes) << "\n";
+        }
+    }
+
+    if (m_aggregates & OWNERS) {
+        std::vector<std::pair<uid_t, Tally>> rows(m_owners.begin(), m_owners.end());
+        std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+            return a.second.entries != b.second.entries ? a.second.entries > b.second.entries : a.first < b.first;
+        });
+        out << "owners\n";
+        for (const auto& [uid, tally] : rows) {
+            out << "  " << std::setw(12) << FileOperations::getFileOwner(uid, m_options.numeric_uid_gid)
+                << std::setw(12) << tally.entries << formatSize(tally.bytes) << "\n";
+        }
+        if (m_other_owners.entries > 0) {
+            out << "  " << std::setw(12) << "(other)" << std::setw(12) << m_other_owners.entries
+                << formatSize(m_other_owners.bytes) << "\n";
+        }
+    }
+}
+
+void ListingSummary::printJson(std::ostream& out) const {
+    RecordWriter writer(out, ListFormat::JSON);
+
+    out << "{\"entries\":" << m_entries;
+
+    if (m_aggregates & TYPES) {
+        out << ",\"types\":{";
+        for (size_t type = 0; type < TYPE_COUNT; ++type) {
+            out << (type ? "," : "") << '"' << typeName(static_cast<EntryType>(type)) << "\":" << m_types[type];
+        }
+        out << '}';
+    }
+
+    if (m_aggregates & SIZES) {
+        uint64_t files = m_types[FILE_TYPE];
+        out << ",\"sizes\":{\"bytes\":" << m_bytes
+            << ",\"mean\":" << (files ? m_bytes / files : 0)
+            << ",\"p50\":" << percentile(0.5)
+            << ",\"p90\":" << percentile(0.9)
+            << ",\"p99\":" << percentile(0.99)
+            << ",\"max\":" << m_largest << '}';
+    }
+
+    if ((m_aggregates & TIMES) && !m_oldest_path.empty()) {
+        out << ",\"oldest\":{\"mtime\":";
+        writer.timestamp(toTimePoint(m_oldest));
+        out << ",\"path\":";
+        writer.jsonString(m_oldest_path);
+        out << "},\"newest\":{\"mtime\":";
+        writer.timestamp(toTimePoint(m_newest));
+        out << ",\"path\":";
+        writer.jsonString(m_newest_path);
+        out << '}';
+    }
+
+    auto tally = [&out](const Tally& t) {
+        out << "\"entries\":" << t.entries << ",\"bytes\":" << t.bytes << '}';
+    };
+
+    if (m_aggregates & EXTENSIONS) {
+        out << ",\"extensions\":[";
+        bool first = true;
+        for (const auto& [extension, t] : m_extensions) {
+            out << (first ? "" : ",") << "{\"extension\":";
+            writer.jsonString(extension);
+            out << ',';
+            tally(t);
+            first = false;
+        }
+        // Extensions past MAX_KEYS
+        out << "],\"other_extensions\":{";
+        tally(m_other_extensions);
+    }
+
+    if (m_aggregates & OWNERS) {
+        out << ",\"owners\":[";
+        bool first = true;
+        for (const auto& [uid, t] : m_owners) {
+            out << (first ? "" : ",") << "{\"uid\":" << uid << ",\"name\":";
+            writer.jsonString(FileOperations::getFileOwner(uid));
+            out << ',';
+            tally(t);
+            first = false;
+        }
+        out << "],\"other_owners\":{";
+        tally(m_other_owners);
+    }
+
+    out << "}\n";
+}
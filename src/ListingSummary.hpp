@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include "ArgumentParser.hpp"
+#include "Diagnostics.hpp"
+
+// `ls++ --summary[=WHAT] [-R] PATH...`: aggregates over the entries that
+// would be listed, gathered in one pass over readdir() without building a
+// FileInfo or a row for any of them. Only the aggregates asked for are
+// kept, and entries are only stat()ed when one of them needs more than the
+// type readdir already reports.
+//
+// Memory does not grow with the number of entries: sizes go into a fixed
+// log-scale histogram (percentiles are accurate to 1/8 of their value) and
+// at most MAX_KEYS distinct extensions and owners are tracked, the rest
+// being counted together under "other".
+class ListingSummary {
+public:
+    enum Aggregate : unsigned {
+        TYPES = 1 << 0,         // entries by file type (readdir only)
+        EXTENSIONS = 1 << 1,    // entries and bytes by extension
+        SIZES = 1 << 2,         // total, mean, percentiles and largest size
+        TIMES = 1 << 3,         // oldest and newest modification time
+        OWNERS = 1 << 4,        // entries and bytes by owner
+        ALL = TYPES | EXTENSIONS | SIZES | TIMES | OWNERS
+    };
+
+    static constexpr size_t MAX_KEYS = 1024;
+
+    explicit ListingSummary(const LsOptions& options);
+
+    // Walks the targets and prints the summary; returns the exit status
+    int run(const std::vector<std::string>& targets, std::ostream& out = std::cout);
+
+    // Parses "types,sizes,..." into a mask of Aggregate bits (0 if invalid)
+    static unsigned parseAggregates(const std::string& list);
+
+private:
+    enum EntryType : size_t {
+        FILE_TYPE, DIRECTORY_TYPE, SYMLINK_TYPE, FIFO_TYPE, SOCKET_TYPE,
+        BLOCK_TYPE, CHAR_TYPE, OTHER_TYPE, TYPE_COUNT
+    };
+
+    struct Tally {
+        uint64_t entries = 0;
+        uint64_t bytes = 0;
+    };
+
+    // Values below 8 get a bucket each; above, 8 buckets per power of two
+    static constexpr size_t SIZE_BUCKETS = 8 + 61 * 8;
+
+    const LsOptions& m_options;
+    unsigned m_aggregates;
+    bool m_needs_stat;
+    Diagnostics m_diagnostics;
+
+    uint64_t m_entries;
+    std::array<uint64_t, TYPE_COUNT> m_types;
+    uint64_t m_bytes;
+    uint64_t m_largest;
+    std::array<uint64_t, SIZE_BUCKETS> m_size_histogram;
+    struct timespec m_oldest;
+    struct timespec m_newest;
+    std::string m_oldest_path;
+    std::string m_newest_path;
+    std::unordered_map<std::string, Tally> m_extensions;
+    std::unordered_map<uid_t, Tally> m_owners;
+    Tally m_other_extensions;
+    Tally m_other_owners;
+
+    void walk(const std::string& dir);
+    void add(const std::string& dir, std::string_view name, EntryType type, const struct stat* st);
+    bool shouldCount(const char* name) const;
+    bool passesFilter(const std::string& dir, const char* name, unsigned char d_type,
+                      const struct stat* st) const;
+
+    uint64_t percentile(double fraction) const;
+    void printTable(std::ostream& out) const;
+    void printJson(std::ostream& out) const;
+    std::string formatSize(uint64_t bytes) const;
+
+    static EntryType typeOf(unsigned char d_type);
+    static const char* typeName(EntryType type);
+    static size_t sizeBucket(uint64_t size);
+    static uint64_t bucketLimit(size_t bucket);
+};
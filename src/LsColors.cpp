@@ -0,0 +1,199 @@
+#include "LsColors.hpp"
+#include "FileOperations.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fnmatch.h>
+
+namespace {
+
+char asciiLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+std::string lowered(std::string_view text) {
+    std::string result(text);
+    std::transform(result.begin(), result.end(), result.begin(), asciiLower);
+    return result;
+}
+
+bool endsWithIgnoreCase(std::string_view text, std::string_view suffix) {
+    if (suffix.size() > text.size()) {
+        return false;
+    }
+    std::string_view tail = text.substr(text.size() - suffix.size());
+    for (size_t i = 0; i < suffix.size(); ++i) {
+        if (asciiLower(tail[i]) != asciiLower(suffix[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+LsColors::LsColors() {
+    const char* spec = std::getenv("LS_COLORS");
+    if (spec) {
+        parse(spec);
+    }
+}
+
+LsColors::LsColors(const std::string& spec) {
+    parse(spec);
+}
+
+void LsColors::parse(const std::string& spec) {
+    static const std::unordered_map<std::string, Indicator> type_keys = {
+        {"fi", Indicator::FILE},
+        {"di", Indicator::DIRECTORY},
+        {"ln", Indicator::SYMLINK},
+        {"pi", Indicator::PIPE},
+        {"so", Indicator::SOCKET},
+        {"bd", Indicator::BLOCK_DEVICE},
+        {"cd", Indicator::CHAR_DEVICE},
+        {"ex", Indicator::EXECUTABLE},
+        {"su", Indicator::SETUID},
+        {"sg", Indicator::SETGID},
+        {"tw", Indicator::STICKY_OTHER_WRITABLE},
+        {"ow", Indicator::OTHER_WRITABLE},
+        {"st", Indicator::STICKY},
+    };
+
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t end = spec.find(':', start);
+        if (end == std::string::npos) {
+            end = spec.size();
+        }
+
+        std::string item = spec.substr(start, end - start);
+        start = end + 1;
+
+        size_t eq = item.find('=');
+        if (eq == std::string::npos || eq == 0) {
+            continue;
+        }
+        std::string key = item.substr(0, eq);
+        std::string value = item.substr(eq + 1);
+
+        if (key[0] == '*') {
+            std::string pattern = key.substr(1);
+            if (pattern.find_first_of("*?[") == std::string::npos) {
+                // Later entries override earlier ones, as with dircolors
+                m_suffixes[lowered(pattern)] = toSequence(value);
+            } else {
+                m_globs.emplace_back(key, toSequence(value));
+            }
+            continue;
+        }
+
+        auto it = type_keys.find(key);
+        if (it == type_keys.end() || value == "target") {
+            // rs, lc, rc, ec, no, or, mi, ca, mh, ... and ln=target keep the built-in colors
+            continue;
+        }
+        size_t index = static_cast<size_t>(it->second);
+        m_type_colors[index] = toSequence(value);
+        m_type_set[index] = true;
+    }
+
+    for (const auto& [suffix, color] : m_suffixes) {
+        m_suffix_lengths.push_back(suffix.size());
+    }
+    std::sort(m_suffix_lengths.begin(), m_suffix_lengths.end(), std::greater<size_t>());
+    m_suffix_lengths.erase(std::unique(m_suffix_lengths.begin(), m_suffix_lengths.end()), m_suffix_lengths.end());
+}
+
+std::string LsColors::toSequence(const std::string& params) {
+    return "\033[" + params + "m";
+}
+
+bool LsColors::empty() const {
+    return m_suffixes.empty() && m_globs.empty() &&
+           std::none_of(m_type_set.begin(), m_type_set.end(), [](bool set) { return set; });
+}
+
+const std::string* LsColors::typeColor(Indicator indicator) const {
+    size_t index = static_cast<size_t>(indicator);
+    return m_type_set[index] ? &m_type_colors[index] : nullptr;
+}
+
+const std::string* LsColors::suffixColor(std::string_view name) const {
+    // One hash probe per distinct suffix length, longest first
+    std::string tail;
+    for (size_t length : m_suffix_lengths) {
+        if (length > name.size()) {
+            continue;
+        }
+        tail = lowered(name.substr(name.size() - length));
+        auto it = m_suffixes.find(tail);
+        if (it != m_suffixes.end()) {
+            return &it->second;
+        }
+    }
+
+    std::string name_str(name);
+    for (const auto& [pattern, color] : m_globs) {
+        if (fnmatch(pattern.c_str(), name_str.c_str(), 0) == 0) {
+            return &color;
+        }
+    }
+
+    return nullptr;
+}
+
+const std::string* LsColors::colorFor(const FileInfo& file) const {
+    // Same precedence as GNU ls: special types first, then permission bits,
+    // and suffixes only for files still classified as plain files
+    mode_t mode = file.mode;
+
+    if (file.is_symlink) {
+        return typeColor(Indicator::SYMLINK);
+    }
+
+    if (file.is_directory) {
+        const std::string* color = nullptr;
+        if ((mode & S_ISVTX) && (mode & S_IWOTH)) {
+            color = typeColor(Indicator::STICKY_OTHER_WRITABLE);
+        } else if (mode & S_IWOTH) {
+            color = typeColor(Indicator::OTHER_WRITABLE);
+        } else if (mode & S_ISVTX) {
+            color = typeColor(Indicator::STICKY);
+        }
+        return color ? color : typeColor(Indicator::DIRECTORY);
+    }
+
+    if (S_ISFIFO(mode)) return typeColor(Indicator::PIPE);
+    if (S_ISSOCK(mode)) return typeColor(Indicator::SOCKET);
+    if (S_ISBLK(mode)) return typeColor(Indicator::BLOCK_DEVICE);
+    if (S_ISCHR(mode)) return typeColor(Indicator::CHAR_DEVICE);
+
+    const std::string* color = nullptr;
+    if ((mode & S_ISUID) && (color = typeColor(Indicator::SETUID))) {
+        return color;
+    }
+    if ((mode & S_ISGID) && (color = typeColor(Indicator::SETGID))) {
+        return color;
+    }
+    if (file.is_executable && (color = typeColor(Indicator::EXECUTABLE))) {
+        return color;
+    }
+
+    color = suffixColor(file.display_name.native());
+    return color ? color : typeColor(Indicator::FILE);
+}
+
+bool LsColors::dependsOnName(std::string_view ext) const {
+    if (!m_globs.empty()) {
+        return true;
+    }
+
+    // Suffixes no longer than the extension are decided by the extension;
+    // a longer one that ends with it needs the rest of the name
+    for (const auto& [suffix, color] : m_suffixes) {
+        if (suffix.size() > ext.size() && endsWithIgnoreCase(suffix, ext)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Forward declaration to avoid circular dependency
+struct FileInfo;
+
+// LS_COLORS (as produced by dircolors) compiled into lookup tables: one slot
+// per type key, a hash of suffixes bucketed by length, and a short list of
+// true glob patterns. Suffixes match case-insensitively and the longest one wins.
+class LsColors {
+public:
+    enum class Indicator {
+        FILE,                   // fi
+        DIRECTORY,              // di
+        SYMLINK,                // ln
+        PIPE,                   // pi
+        SOCKET,                 // so
+        BLOCK_DEVICE,           // bd
+        CHAR_DEVICE,            // cd
+        EXECUTABLE,             // ex
+        SETUID,                 // su
+        SETGID,                 // sg
+        STICKY_OTHER_WRITABLE,  // tw
+        OTHER_WRITABLE,         // ow
+        STICKY,                 // st
+        COUNT
+    };
+
+    // Parses the LS_COLORS environment variable
+    LsColors();
+    explicit LsColors(const std::string& spec);
+
+    bool empty() const;
+
+    // Color sequence for the entry, or nullptr to keep the built-in color
+    const std::string* colorFor(const FileInfo& file) const;
+
+    const std::string* typeColor(Indicator indicator) const;
+    const std::string* suffixColor(std::string_view name) const;
+
+    // Whether files sharing the raw extension ext can still get different
+    // colors depending on the rest of their name (longer suffixes or globs)
+    bool dependsOnName(std::string_view ext) const;
+
+private:
+    std::array<std::string, static_cast<size_t>(Indicator::COUNT)> m_type_colors;
+    std::array<bool, static_cast<size_t>(Indicator::COUNT)> m_type_set{};
+
+    std::unordered_map<std::string, std::string> m_suffixes;  // lowercased suffix -> color
+    std::vector<size_t> m_suffix_lengths;                     // distinct lengths, longest first
+    std::vector<std::pair<std::string, std::string>> m_globs; // fnmatch pattern -> color
+
+    void parse(const std::string& spec);
+    static std::string toSequence(const std::string& params);
+};
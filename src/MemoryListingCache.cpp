@@ -0,0 +1,156 @@
+#include "MemoryListingCache.hpp"
+#include "FileOperations.hpp"
+#include <algorithm>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+
+// Everything that can change what a listing of the directory shows
+constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                IN_ATTRIB | IN_MODIFY | IN_DELETE_SELF | IN_MOVE_SELF;
+
+} // namespace
+
+MemoryListingCache::MemoryListingCache() {
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+MemoryListingCache::~MemoryListingCache() {
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool MemoryListingCache::available() const {
+    return m_fd >= 0;
+}
+
+int MemoryListingCache::fd() const {
+    return m_fd;
+}
+
+std::string MemoryListingCache::keyFor(const fs::path& dir) {
+    std::error_code ec;
+    fs::path absolute = fs::absolute(dir, ec);
+    return (ec ? dir : absolute).lexically_normal().native();
+}
+
+bool MemoryListingCache::load(const fs::path& dir, std::vector<FileInfo>& files) {
+    auto it = m_listings.find(keyFor(dir));
+    if (it == m_listings.end() || !it->second.complete) {
+        return false;
+    }
+
+    Listing& listing = it->second;
+    m_lru.splice(m_lru.begin(), m_lru, listing.lru);
+
+    files = listing.entries;
+    for (auto& file : files) {
+        file.path = dir / file.display_name;
+    }
+    return true;
+}
+
+bool MemoryListingCache::watch(const fs::path& dir) {
+    if (m_fd < 0) {
+        return false;
+    }
+
+    std::string key = keyFor(dir);
+    auto existing = m_listings.find(key);
+    if (existing != m_listings.end()) {
+        // A listing that was started but never stored
+        return true;
+    }
+
+    if (m_listings.size() >= MAX_DIRECTORIES) {
+        drop(std::string(m_lru.back()));
+    }
+
+    int wd = inotify_add_watch(m_fd, key.c_str(), WATCH_MASK | IN_ONLYDIR);
+    if (wd < 0) {
+        // Out of watches (fs.inotify.max_user_watches) or not a directory
+        return false;
+    }
+
+    m_lru.push_front(key);
+    Listing& listing = m_listings[key];
+    listing.wd = wd;
+    listing.lru = m_lru.begin();
+    m_watches[wd].push_back(key);
+    return true;
+}
+
+void MemoryListingCache::store(const fs::path& dir, const std::vector<FileInfo>& files) {
+    auto it = m_listings.find(keyFor(dir));
+    if (it == m_listings.end()) {
+        return;
+    }
+    it->second.entries = files;
+    it->second.complete = true;
+}
+
+void MemoryListingCache::processEvents() {
+    if (m_fd < 0) {
+        return;
+    }
+
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    for (;;) {
+        ssize_t length = read(m_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            // EAGAIN: queue drained
+            return;
+        }
+
+        for (char* ptr = buffer; ptr < buffer + length;) {
+            const auto* event = reinterpret_cast<const struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were lost; nothing cached can be trusted
+                clear();
+                continue;
+            }
+            dropWatch(event->wd);
+        }
+    }
+}
+
+void MemoryListingCache::dropWatch(int wd) {
+    auto it = m_watches.find(wd);
+    if (it == m_watches.end()) {
+        // IN_IGNORED for a watch already removed
+        return;
+    }
+
+    std::vector<std::string> keys = std::move(it->second);
+    m_watches.erase(it);
+    inotify_rm_watch(m_fd, wd);
+
+    for (const auto& key : keys) {
+        auto listing = m_listings.find(key);
+        if (listing != m_listings.end()) {
+            m_lru.erase(listing->second.lru);
+            m_listings.erase(listing);
+        }
+    }
+}
+
+void MemoryListingCache::drop(const std::string& key) {
+    auto it = m_listings.find(key);
+    if (it != m_listings.end()) {
+        // Drops every spelling sharing the watch as well
+        dropWatch(it->second.wd);
+    }
+}
+
+void MemoryListingCache::clear() {
+    for (const auto& [wd, keys] : m_watches) {
+        inotify_rm_watch(m_fd, wd);
+    }
+    m_watches.clear();
+    m_listings.clear();
+    m_lru.clear();
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <filesystem>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Forward declaration to avoid circular dependency
+struct FileInfo;
+
+// In-memory directory listings for the --serve daemon. Each cached
+// directory holds an inotify watch; any event in it (entries created,
+// removed, renamed, written or chmod'ed) drops the listing, so a hit never
+// needs to touch the filesystem. Changes made by other NFS clients are not
+// reported by inotify and are only picked up once the listing is evicted.
+class MemoryListingCache {
+public:
+    static constexpr size_t MAX_DIRECTORIES = 4096;
+
+    MemoryListingCache();
+    ~MemoryListingCache();
+
+    MemoryListingCache(const MemoryListingCache&) = delete;
+    MemoryListingCache& operator=(const MemoryListingCache&) = delete;
+
+    bool available() const;
+    int fd() const;
+
+    // Entries of dir (without . and ..), rebased onto the path as spelled
+    bool load(const fs::path& dir, std::vector<FileInfo>& files);
+
+    // Must be called before dir is enumerated, so changes made while it is
+    // being listed are already reported; false if dir cannot be watched
+    bool watch(const fs::path& dir);
+    void store(const fs::path& dir, const std::vector<FileInfo>& files);
+
+    // Drains pending inotify events and drops the listings they affect
+    void processEvents();
+
+private:
+    struct Listing {
+        int wd = -1;
+        bool complete = false;
+        std::vector<FileInfo> entries;
+        std::list<std::string>::iterator lru;
+    };
+
+    int m_fd;
+    std::unordered_map<std::string, Listing> m_listings;
+    std::unordered_map<int, std::vector<std::string>> m_watches;  // one inode may have several spellings
+    std::list<std::string> m_lru;                                  // most recently used first
+
+    static std::string keyFor(const fs::path& dir);
+    void drop(const std::string& key);
+    void dropWatch(int wd);
+    void clear();
+};
@@ -0,0 +1,309 @@
+#include "RecordWriter.hpp"
+#include "DisplayFormatter.hpp"
+#include "FileOperations.hpp"
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+namespace {
+
+// Length of the valid UTF-8 sequence starting at text[i], or 0
+size_t utf8SequenceLength(std::string_view text, size_t i) {
+    unsigned char lead = static_cast<unsigned char>(text[i]);
+    size_t length;
+    char32_t min;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        min = 0x80;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        min = 0x800;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        min = 0x10000;
+    } else {
+        return 0;
+    }
+    if (i + length > text.size()) {
+        return 0;
+    }
+
+    char32_t cp = lead & (0xFF >> (length + 1));
+    for (size_t k = 1; k < length; ++k) {
+        unsigned char c = static_cast<unsigned char>(text[i + k]);
+        if ((c & 0xC0) != 0x80) {
+            return 0;
+        }
+        cp = (cp << 6) | (c & 0x3F);
+    }
+    // Overlong forms, surrogates and values past U+10FFFF are not valid
+    if (cp < min || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) {
+        return 0;
+    }
+    return length;
+}
+
+} // namespace
+
+unsigned RecordWriter::extras(const LsOptions& options) {
+    unsigned extras = 0;
+    if (options.show_context) {
+        extras |= CONTEXT;
+    }
+    if (options.show_acl) {
+        extras |= ACL;
+    }
+    if (options.show_xattrs) {
+        extras |= XATTRS;
+    }
+    return extras;
+}
+
+RecordWriter::RecordWriter(std::ostream& out, ListFormat format, char record_end, unsigned extras)
+    : m_out(out), m_format(format), m_record_end(record_end), m_extras(extras), m_count(0) {
+}
+
+void RecordWriter::begin() {
+    if (m_format == ListFormat::JSON) {
+        m_out << '[';
+    } else if (m_format == ListFormat::CSV) {
+        m_out << "name,path,type,mode,permissions,size,blocks,links,inode,device,"
+                 "uid,gid,owner,group,mtime,atime,ctime,target,hidden,executable,error";
+        if (m_extras & CONTEXT) {
+            m_out << ",selinux_context";
+        }
+        if (m_extras & ACL) {
+            m_out << ",has_acl";
+        }
+        if (m_extras & XATTRS) {
+            m_out << ",xattr_names";
+        }
+        m_out << m_record_end;
+    }
+}
+
+void RecordWriter::write(const FileInfo& file) {
+    if (m_format == ListFormat::CSV) {
+        writeCsv(file);
+    } else {
+        if (m_format == ListFormat::JSON) {
+            m_out << (m_count > 0 ? ",\n" : "\n");
+        }
+        writeJson(file);
+        if (m_format == ListFormat::NDJSON) {
+            m_out << m_record_end;
+        }
+    }
+    ++m_count;
+}
+
+void RecordWriter::end() {
+    if (m_format == ListFormat::JSON) {
+        m_out << (m_count > 0 ? "\n]\n" : "]\n");
+    }
+}
+
+void RecordWriter::writeJson(const FileInfo& file) {
+    m_out << "{\"name\":";
+    jsonString(file.display_name.native());
+    m_out << ",\"path\":";
+    jsonString(file.path.native());
+    m_out << ",\"type\":\"" << typeName(file.mode) << '"'
+          << ",\"mode\":" << static_cast<unsigned long>(file.mode)
+          << ",\"permissions\":\"" << DisplayFormatter::formatPermissions(file.mode) << '"'
+          << ",\"size\":" << static_cast<long long>(file.size)
+          << ",\"blocks\":" << static_cast<long long>(file.blocks)
+          << ",\"links\":" << static_cast<unsigned long long>(file.hard_links)
+          << ",\"inode\":" << static_cast<unsigned long long>(file.inode)
+          << ",\"device\":" << static_cast<unsigned long long>(file.device)
+          << ",\"uid\":" << file.uid
+          << ",\"gid\":" << file.gid
+          << ",\"owner\":";
+    jsonString(file.owner);
+    m_out << ",\"group\":";
+    jsonString(file.group);
+    m_out << ",\"mtime\":";
+    timestamp(file.mtime);
+    m_out << ",\"atime\":";
+    timestamp(file.atime);
+    m_out << ",\"ctime\":";
+    timestamp(file.ctime);
+    m_out << ",\"target\":";
+    if (file.is_symlink) {
+        jsonString(file.symlink_target);
+    } else {
+        m_out << "null";
+    }
+    m_out << ",\"hidden\":" << (file.is_hidden ? "true" : "false")
+          << ",\"executable\":" << (file.is_executable ? "true" : "false")
+          << ",\"error\":";
+    // An entry that could not be stat'ed has none of the attributes above
+    if (file.attributesUnknown()) {
+        jsonString(std::strerror(file.stat_error));
+    } else {
+        m_out << "null";
+    }
+    if (m_extras & CONTEXT) {
+        // null where the file system has no SELinux label
+        m_out << ",\"selinux_context\":";
+        if (file.selinux_context.empty()) {
+            m_out << "null";
+        } else {
+            jsonString(file.selinux_context);
+        }
+    }
+    if (m_extras & ACL) {
+        m_out << ",\"has_acl\":" << (file.has_acl ? "true" : "false");
+    }
+    if (m_extras & XATTRS) {
+        m_out << ",\"xattr_names\":[";
+        for (size_t i = 0; i < file.xattr_names.size(); ++i) {
+            if (i > 0) {
+                m_out << ',';
+            }
+            jsonString(file.xattr_names[i]);
+        }
+        m_out << ']';
+    }
+    m_out << '}';
+}
+
+void RecordWriter::writeCsv(const FileInfo& file) {
+    csvField(file.display_name.native());
+    m_out << ',';
+    csvField(file.path.native());
+    m_out << ',' << typeName(file.mode)
+          << ',' << static_cast<unsigned long>(file.mode)
+          << ',' << DisplayFormatter::formatPermissions(file.mode)
+          << ',' << static_cast<long long>(file.size)
+          << ',' << static_cast<long long>(file.blocks)
+          << ',' << static_cast<unsigned long long>(file.hard_links)
+          << ',' << static_cast<unsigned long long>(file.inode)
+          << ',' << static_cast<unsigned long long>(file.device)
+          << ',' << file.uid
+          << ',' << file.gid << ',';
+    csvField(file.owner);
+    m_out << ',';
+    csvField(file.group);
+    m_out << ',';
+    timestamp(file.mtime);
+    m_out << ',';
+    timestamp(file.atime);
+    m_out << ',';
+    timestamp(file.ctime);
+    m_out << ',';
+    csvField(file.symlink_target);
+    m_out << ',' << (file.is_hidden ? "true" : "false")
+          << ',' << (file.is_executable ? "true" : "false") << ',';
+    if (file.attributesUnknown()) {
+        csvField(std::strerror(file.stat_error));
+    }
+    if (m_extras & CONTEXT) {
+        m_out << ',';
+        csvField(file.selinux_context);
+    }
+    if (m_extras & ACL) {
+        m_out << ',' << (file.has_acl ? "true" : "false");
+    }
+    if (m_extras & XATTRS) {
+        // One field, the names separated by commas as in the listing
+        std::string names;
+        for (size_t i = 0; i < file.xattr_names.size(); ++i) {
+            names += (i ? "," : "");
+            names += file.xattr_names[i];
+        }
+        m_out << ',';
+        csvField(names);
+    }
+    m_out << m_record_end;
+}
+
+void RecordWriter::jsonString(std::string_view text) {
+    m_out << '"';
+
+    // Copy runs of characters that need no escaping in one write
+    size_t run = 0;
+    auto flush = [&](size_t i) {
+        if (i > run) {
+            m_out.write(text.data() + run, static_cast<std::streamsize>(i - run));
+        }
+    };
+
+    for (size_t i = 0; i < text.size();) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            ++i;
+            continue;
+        }
+        if (c >= 0x80) {
+            size_t length = utf8SequenceLength(text, i);
+            if (length > 0) {
+                i += length;
+                continue;
+            }
+        }
+
+        flush(i);
+        switch (c) {
+            case '"': m_out << "\\\""; break;
+            case '\\': m_out << "\\\\"; break;
+            case '\n': m_out << "\\n"; break;
+            case '\t': m_out << "\\t"; break;
+            case '\r': m_out << "\\r"; break;
+            default: {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                m_out << escape;
+                break;
+            }
+        }
+        run = ++i;
+    }
+    flush(text.size());
+
+    m_out << '"';
+}
+
+void RecordWriter::csvField(std::string_view text) {
+    // RFC 4180: quote fields containing separators, quotes or line breaks
+    if (text.find_first_of(",\"\r\n") == std::string_view::npos) {
+        m_out.write(text.data(), static_cast<std::streamsize>(text.size()));
+        return;
+    }
+
+    m_out << '"';
+    size_t start = 0;
+    size_t quote;
+    while ((quote = text.find('"', start)) != std::string_view::npos) {
+        m_out.write(text.data() + start, static_cast<std::streamsize>(quote + 1 - start));
+        m_out << '"';
+        start = quote + 1;
+    }
+    m_out.write(text.data() + start, static_cast<std::streamsize>(text.size() - start));
+    m_out << '"';
+}
+
+void RecordWriter::timestamp(std::chrono::system_clock::time_point time) {
+    long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    long long sec = ns / 1000000000;
+    long long frac = ns % 1000000000;
+    if (frac < 0) {
+        sec -= 1;
+        frac += 1000000000;
+    }
+
+    char text[32];
+    std::snprintf(text, sizeof(text), "%lld.%09lld", sec, frac);
+    m_out << text;
+}
+
+const char* RecordWriter::typeName(mode_t mode) {
+    if ((mode & S_IFMT) == 0) return "unknown";
+    if (S_ISDIR(mode)) return "directory";
+    if (S_ISLNK(mode)) return "symlink";
+    if (S_ISFIFO(mode)) return "fifo";
+    if (S_ISSOCK(mode)) return "socket";
+    if (S_ISBLK(mode)) return "block_device";
+    if (S_ISCHR(mode)) return "char_device";
+    return "file";
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string_view>
+#include <sys/types.h>
+#include "ArgumentParser.hpp"
+
+// Forward declaration to avoid circular dependency
+struct FileInfo;
+
+// Structured output for --format=json|ndjson|csv: one record per entry
+// carrying every FileInfo field in raw form (numeric ids, inode, device,
+// times as seconds with nanoseconds). Records are escaped straight into the
+// stream as they are written, so nothing is built up in memory.
+//
+// JSON strings must be UTF-8; bytes of a name that are not valid UTF-8 are
+// written as \u00XX escapes of the byte value.
+class RecordWriter {
+public:
+    // Fields written only when the listing asked for them, after the others
+    enum Extra : unsigned {
+        CONTEXT = 1 << 0,   // -Z: selinux_context
+        ACL = 1 << 1,       // --acl: has_acl
+        XATTRS = 1 << 2     // --xattr: xattr_names
+    };
+    static unsigned extras(const LsOptions& options);
+
+    // record_end separates records of the line-based formats ('\0' with --zero)
+    RecordWriter(std::ostream& out, ListFormat format, char record_end = '\n', unsigned extras = 0);
+
+    void begin();
+    void write(const FileInfo& file);
+    void end();
+
+    // Single values, for callers writing their own JSON or CSV documents
+    void jsonString(std::string_view text);
+    void csvField(std::string_view text);
+    void timestamp(std::chrono::system_clock::time_point time);
+
+private:
+    std::ostream& m_out;
+    ListFormat m_format;
+    char m_record_end;
+    unsigned m_extras;
+    size_t m_count;
+
+    void writeJson(const FileInfo& file);
+    void writeCsv(const FileInfo& file);
+
+    static const char* typeName(mode_t mode);
+};
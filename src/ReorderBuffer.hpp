@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Computes count results on worker threads while the caller takes them
+// strictly in index order. get(i) waits for slot i alone, so output can
+// start as soon as the first result is in, however the rest are scheduled.
+// Workers run at most window slots ahead of the caller, which bounds the
+// memory held by results that are finished but not yet taken.
+template <typename T>
+class ReorderBuffer {
+public:
+    using Producer = std::function<void(size_t index, T& result)>;
+
+    ReorderBuffer(size_t count, unsigned threads, size_t window, Producer produce)
+        : m_slots(count), m_ready(count, false), m_produce(std::move(produce)),
+          m_window(std::max<size_t>(window, 1)) {
+        threads = static_cast<unsigned>(std::min<size_t>(std::max(threads, 1u), count));
+        for (unsigned t = 0; t < threads; ++t) {
+            m_workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ~ReorderBuffer() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_space.notify_all();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    ReorderBuffer(const ReorderBuffer&) = delete;
+    ReorderBuffer& operator=(const ReorderBuffer&) = delete;
+
+    // Waits for result index; the results before it are released.
+    // The reference stays valid until the next call
+    T& get(size_t index) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (; m_taken < index; ++m_taken) {
+            m_slots[m_taken] = T();
+        }
+        m_space.notify_all();
+        m_filled.wait(lock, [&] { return m_ready[index]; });
+        return m_slots[index];
+    }
+
+private:
+    std::vector<T> m_slots;
+    std::vector<bool> m_ready;
+    Producer m_produce;
+    size_t m_window;
+    size_t m_next = 0;      // first index no worker has claimed
+    size_t m_taken = 0;     // results before this one were released
+    bool m_stopping = false;
+
+    std::mutex m_mutex;
+    std::condition_variable m_space;    // a slot inside the window came free
+    std::condition_variable m_filled;   // a result is ready
+    std::vector<std::thread> m_workers;
+
+    void work() {
+        while (true) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_space.wait(lock, [&] {
+                    return m_stopping || m_next >= m_slots.size() || m_next < m_taken + m_window;
+                });
+                if (m_stopping || m_next >= m_slots.size()) {
+                    return;
+                }
+                index = m_next++;
+            }
+
+            T result;
+            m_produce(index, result);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_slots[index] = std::move(result);
+                m_ready[index] = true;
+            }
+            m_filled.notify_all();
+        }
+    }
+};
@@ -0,0 +1,26 @@
+#include "TargetCache.hpp"
+
+std::string TargetCache::targetPath(const fs::path& link_path, const std::string& target) {
+    if (!target.empty() && target[0] == '/') {
+        return target;
+    }
+    // ".." is kept: the link's directory may itself be reached through a symlink
+    std::string key = link_path.parent_path().native();
+    if (key.empty()) {
+        return target;
+    }
+    if (key.back() != '/') {
+        key += '/';
+    }
+    key += target;
+    return key;
+}
+
+const TargetCache::Entry* TargetCache::find(const std::string& key) const {
+    auto it = m_entries.find(key);
+    return it != m_entries.end() ? &it->second : nullptr;
+}
+
+const TargetCache::Entry& TargetCache::insert(std::string key, const Entry& entry) {
+    return m_entries.insert_or_assign(std::move(key), entry).first->second;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+// Metadata of symlink targets for -L and -H. Link farms (profiles,
+// alternatives, stow trees) hold many links to a few targets, so each
+// distinct target is stat'ed once per listing and every link to it reuses
+// the result. Targets are keyed by the path the link text names, taken
+// relative to the link's directory; resolving that to a realpath would cost
+// a stat per component and defeat the cache.
+class TargetCache {
+public:
+    struct Entry {
+        int error = 0;          // errno of the stat, 0 when st is valid
+        struct stat st{};
+    };
+
+    // Key for a link at link_path whose readlink text is target
+    static std::string targetPath(const fs::path& link_path, const std::string& target);
+
+    // nullptr until insert() has recorded key
+    const Entry* find(const std::string& key) const;
+    const Entry& insert(std::string key, const Entry& entry);
+
+    void clear() { m_entries.clear(); }
+    size_t size() const { return m_entries.size(); }
+
+private:
+    std::unordered_map<std::string, Entry> m_entries;
+};
@@ -0,0 +1,546 @@
+#include "ThemeCache.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char CACHE_MAGIC[8] = {'L', 'S', 'P', 'P', 'T', 'H', 'M', '\0'};
+constexpr uint32_t CACHE_VERSION = 1;
+constexpr uint32_t NO_ENTRY = UINT32_MAX;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t bucket_count;
+    uint32_t entry_count;
+    uint32_t reserved;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t source_size;
+    uint64_t strings_size;
+};
+
+struct CacheEntry {
+    uint64_t hash;
+    uint32_t next;
+    uint32_t kind;
+    uint32_t key_offset;
+    uint32_t key_length;
+    uint32_t icon_offset;
+    uint32_t icon_length;
+    uint32_t color_offset;
+    uint32_t color_length;
+};
+
+static_assert(sizeof(CacheHeader) == 56, "theme cache header layout changed");
+static_assert(sizeof(CacheEntry) == 40, "theme cache entry layout changed");
+
+// Cursor over one line of the theme file
+class LineParser {
+public:
+    explicit LineParser(const std::string& line) : m_line(line), m_pos(0) {}
+
+    void skipSpace() {
+        while (m_pos < m_line.size() && (m_line[m_pos] == ' ' || m_line[m_pos] == '\t')) {
+            ++m_pos;
+        }
+    }
+
+    bool atEnd() {
+        skipSpace();
+        return m_pos >= m_line.size() || m_line[m_pos] == '#';
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (m_pos < m_line.size() && m_line[m_pos] == c) {
+            ++m_pos;
+            return true;
+        }
+        return false;
+    }
+
+    bool parseKey(std::string& key) {
+        skipSpace();
+        if (m_pos < m_line.size() && m_line[m_pos] == '"') {
+            return parseString(key);
+        }
+        size_t start = m_pos;
+        while (m_pos < m_line.size() && (std::isalnum(static_cast<unsigned char>(m_line[m_pos])) ||
+               m_line[m_pos] == '_' || m_line[m_pos] == '-' || m_line[m_pos] == '.')) {
+            ++m_pos;
+        }
+        key = m_line.substr(start, m_pos - start);
+        return !key.empty();
+    }
+
+    bool parseString(std::string& value) {
+        skipSpace();
+        if (m_pos >= m_line.size() || m_line[m_pos] != '"') {
+            return false;
+        }
+        ++m_pos;
+        value.clear();
+
+        while (m_pos < m_line.size()) {
+            char c = m_line[m_pos++];
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\') {
+                value += c;
+                continue;
+            }
+            if (m_pos >= m_line.size()) {
+                return false;
+            }
+            char esc = m_line[m_pos++];
+            switch (esc) {
+                case '"': value += '"'; break;
+                case '\\': value += '\\'; break;
+                case 'n': value += '\n'; break;
+                case 't': value += '\t'; break;
+                case 'e': value += '\033'; break;
+                case 'u':
+                case 'U': {
+                    size_t digits = esc == 'u' ? 4 : 8;
+                    if (m_pos + digits > m_line.size()) {
+                        return false;
+                    }
+                    char32_t cp = static_cast<char32_t>(std::strtoul(m_line.substr(m_pos, digits).c_str(), nullptr, 16));
+                    m_pos += digits;
+                    appendUtf8(value, cp);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+private:
+    const std::string& m_line;
+    size_t m_pos;
+
+    static void appendUtf8(std::string& out, char32_t cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+};
+
+} // namespace
+
+ThemeCache::ThemeCache() : ThemeCache(defaultPath()) {
+}
+
+ThemeCache::ThemeCache(const fs::path& source)
+    : m_data(nullptr), m_size(0), m_mapping(nullptr), m_mapping_size(0) {
+    if (!source.empty()) {
+        load(source);
+    }
+}
+
+ThemeCache::~ThemeCache() {
+    if (m_mapping) {
+        munmap(m_mapping, m_mapping_size);
+    }
+}
+
+fs::path ThemeCache::defaultPath() {
+    if (const char* theme = std::getenv("LSPP_THEME")) {
+        return theme;
+    }
+    if (const char* config = std::getenv("XDG_CONFIG_HOME"); config && *config) {
+        return fs::path(config) / "lspp" / "theme.toml";
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        return fs::path(home) / ".config" / "lspp" / "theme.toml";
+    }
+    return {};
+}
+
+fs::path ThemeCache::cachePath(const fs::path& source) {
+    fs::path cache = source;
+    cache += ".cache";
+    return cache;
+}
+
+void ThemeCache::load(const fs::path& source) {
+    struct stat st;
+    if (stat(source.c_str(), &st) != 0) {
+        // No theme configured
+        return;
+    }
+    SourceStamp stamp{st.st_mtim.tv_sec, st.st_mtim.tv_nsec, static_cast<uint64_t>(st.st_size)};
+
+    fs::path cache_path = cachePath(source);
+    if (mapCache(cache_path, stamp)) {
+        return;
+    }
+
+    std::ifstream in(source, std::ios::binary);
+    if (!in) {
+        std::cerr << "ls++: cannot read theme '" << source.string() << "'\n";
+        return;
+    }
+    std::ostringstream text;
+    text << in.rdbuf();
+
+    m_owned = compile(text.str(), source, stamp);
+    m_data = m_owned.data();
+    m_size = m_owned.size();
+
+    // Best effort: a read-only config directory just means compiling every run
+    writeCache(cache_path, m_owned);
+}
+
+bool ThemeCache::mapCache(const fs::path& cache_path, const SourceStamp& stamp) {
+    int fd = open(cache_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(CacheHeader))) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    if (!validate(static_cast<const char*>(mapping), size, stamp)) {
+        munmap(mapping, size);
+        return false;
+    }
+
+    m_mapping = mapping;
+    m_mapping_size = size;
+    m_data = static_cast<const char*>(mapping);
+    m_size = size;
+    return true;
+}
+
+bool ThemeCache::validate(const char* data, size_t size, const SourceStamp& stamp) const {
+    CacheHeader header;
+    std::memcpy(&header, data, sizeof(header));
+
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        header.version != CACHE_VERSION ||
+        header.mtime_sec != stamp.mtime_sec || header.mtime_nsec != stamp.mtime_nsec ||
+        header.source_size != stamp.size || header.bucket_count == 0) {
+        return false;
+    }
+
+    uint64_t expected = sizeof(CacheHeader) +
+                        static_cast<uint64_t>(header.bucket_count) * sizeof(uint32_t) +
+                        static_cast<uint64_t>(header.entry_count) * sizeof(CacheEntry) +
+                        header.strings_size;
+    return expected == size;
+}
+
+bool ThemeCache::empty() const {
+    if (!m_data) {
+        return true;
+    }
+    const auto* header = reinterpret_cast<const CacheHeader*>(m_data);
+    return header->entry_count == 0;
+}
+
+bool ThemeCache::find(Kind kind, std::string_view key, Entry& entry) const {
+    if (!m_data) {
+        return false;
+    }
+
+    const auto* header = reinterpret_cast<const CacheHeader*>(m_data);
+    const auto* buckets = reinterpret_cast<const uint32_t*>(m_data + sizeof(CacheHeader));
+    const auto* entries = reinterpret_cast<const CacheEntry*>(buckets + header->bucket_count);
+    const char* strings = reinterpret_cast<const char*>(entries + header->entry_count);
+    uint64_t strings_size = header->strings_size;
+
+    auto view = [&](uint32_t offset, uint32_t length, std::string_view& out) {
+        if (static_cast<uint64_t>(offset) + length > strings_size) {
+            return false;
+        }
+        out = std::string_view(strings + offset, length);
+        return true;
+    };
+
+    uint64_t hash = hashKey(kind, key);
+    uint32_t index = buckets[hash % header->bucket_count];
+
+    while (index != NO_ENTRY && index < header->entry_count) {
+        const CacheEntry& candidate = entries[index];
+        std::string_view candidate_key;
+        if (candidate.hash == hash && candidate.kind == static_cast<uint32_t>(kind) &&
+            view(candidate.key_offset, candidate.key_length, candidate_key) && candidate_key == key) {
+            return view(candidate.icon_offset, candidate.icon_length, entry.icon) &&
+                   view(candidate.color_offset, candidate.color_length, entry.color);
+        }
+        index = candidate.next;
+    }
+
+    return false;
+}
+
+void ThemeCache::forEach(Kind kind, const std::function<void(std::string_view, const Entry&)>& callback) const {
+    if (!m_data) {
+        return;
+    }
+
+    const auto* header = reinterpret_cast<const CacheHeader*>(m_data);
+    const auto* buckets = reinterpret_cast<const uint32_t*>(m_data + sizeof(CacheHeader));
+    const auto* entries = reinterpret_cast<const CacheEntry*>(buckets + header->bucket_count);
+    const char* strings = reinterpret_cast<const char*>(entries + header->entry_count);
+
+    for (uint32_t i = 0; i < header->entry_count; ++i) {
+        const CacheEntry& e = entries[i];
+        if (e.kind != static_cast<uint32_t>(kind) ||
+            static_cast<uint64_t>(e.key_offset) + e.key_length > header->strings_size ||
+            static_cast<uint64_t>(e.icon_offset) + e.icon_length > header->strings_size ||
+            static_cast<uint64_t>(e.color_offset) + e.color_length > header->strings_size) {
+            continue;
+        }
+        Entry entry{std::string_view(strings + e.icon_offset, e.icon_length),
+                    std::string_view(strings + e.color_offset, e.color_length)};
+        callback(std::string_view(strings + e.key_offset, e.key_length), entry);
+    }
+}
+
+std::vector<char> ThemeCache::compile(const std::string& text, const fs::path& source, const SourceStamp& stamp) {
+    struct ParsedEntry {
+        std::string icon;
+        std::string color;
+    };
+
+    // Later definitions of the same key override earlier ones
+    std::map<std::pair<Kind, std::string>, ParsedEntry> parsed;
+    bool section_valid = false;
+    Kind section = Kind::EXTENSION;
+
+    std::istringstream lines(text);
+    std::string line;
+    size_t line_number = 0;
+
+    auto report = [&](const std::string& message) {
+        std::cerr << "ls++: " << source.string() << ":" << line_number << ": " << message << "\n";
+    };
+
+    while (std::getline(lines, line)) {
+        ++line_number;
+        LineParser parser(line);
+        if (parser.atEnd()) {
+            continue;
+        }
+
+        if (parser.consume('[')) {
+            std::string name;
+            if (!parser.parseKey(name) || !parser.consume(']')) {
+                report("malformed section header");
+                section_valid = false;
+                continue;
+            }
+            section_valid = true;
+            if (name == "extensions") {
+                section = Kind::EXTENSION;
+            } else if (name == "filenames") {
+                section = Kind::FILENAME;
+            } else if (name == "types") {
+                section = Kind::TYPE;
+            } else {
+                report("unknown section '" + name + "'");
+                section_valid = false;
+            }
+            continue;
+        }
+
+        if (!section_valid) {
+            continue;
+        }
+
+        std::string key;
+        ParsedEntry entry;
+        bool invalid_value = false;
+        bool ok = parser.parseKey(key) && parser.consume('=') && parser.consume('{');
+        while (ok && !parser.consume('}')) {
+            std::string field;
+            std::string value;
+            ok = parser.parseKey(field) && parser.consume('=') && parser.parseString(value);
+            if (!ok) {
+                break;
+            }
+            if (field == "icon") {
+                entry.icon = value;
+            } else if (field == "color") {
+                if (!parseColor(value, entry.color)) {
+                    report("invalid color '" + value + "'");
+                    invalid_value = true;
+                }
+            } else {
+                report("unknown field '" + field + "'");
+            }
+            parser.consume(',');
+        }
+        if (!ok || !parser.atEnd()) {
+            report("expected KEY = { icon = \"...\", color = \"...\" }");
+            continue;
+        }
+        if (invalid_value) {
+            continue;
+        }
+
+        if (section == Kind::EXTENSION) {
+            // Same form as the built-in table: leading dot, lower case
+            std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+            if (key.empty() || key[0] != '.') {
+                key.insert(key.begin(), '.');
+            }
+        }
+        parsed[{section, key}] = entry;
+    }
+
+    uint32_t entry_count = static_cast<uint32_t>(parsed.size());
+    uint32_t bucket_count = 1;
+    while (bucket_count < entry_count * 2) {
+        bucket_count <<= 1;
+    }
+
+    std::vector<uint32_t> buckets(bucket_count, NO_ENTRY);
+    std::vector<CacheEntry> entries;
+    std::string strings;
+    entries.reserve(entry_count);
+
+    auto intern = [&strings](const std::string& value, uint32_t& offset, uint32_t& length) {
+        offset = static_cast<uint32_t>(strings.size());
+        length = static_cast<uint32_t>(value.size());
+        strings += value;
+    };
+
+    for (const auto& [id, entry] : parsed) {
+        CacheEntry record{};
+        record.hash = hashKey(id.first, id.second);
+        record.kind = static_cast<uint32_t>(id.first);
+        intern(id.second, record.key_offset, record.key_length);
+        intern(entry.icon, record.icon_offset, record.icon_length);
+        intern(entry.color, record.color_offset, record.color_length);
+
+        uint32_t& bucket = buckets[record.hash % bucket_count];
+        record.next = bucket;
+        bucket = static_cast<uint32_t>(entries.size());
+        entries.push_back(record);
+    }
+
+    CacheHeader header{};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.bucket_count = bucket_count;
+    header.entry_count = entry_count;
+    header.mtime_sec = stamp.mtime_sec;
+    header.mtime_nsec = stamp.mtime_nsec;
+    header.source_size = stamp.size;
+    header.strings_size = strings.size();
+
+    std::vector<char> table(sizeof(header) + buckets.size() * sizeof(uint32_t) +
+                            entries.size() * sizeof(CacheEntry) + strings.size());
+    char* out = table.data();
+    std::memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    std::memcpy(out, buckets.data(), buckets.size() * sizeof(uint32_t));
+    out += buckets.size() * sizeof(uint32_t);
+    std::memcpy(out, entries.data(), entries.size() * sizeof(CacheEntry));
+    out += entries.size() * sizeof(CacheEntry);
+    std::memcpy(out, strings.data(), strings.size());
+
+    return table;
+}
+
+void ThemeCache::writeCache(const fs::path& cache_path, const std::vector<char>& table) {
+    // Write to a private temporary and rename, so concurrent runs never map a partial file
+    fs::path tmp_path = cache_path;
+    tmp_path += ".tmp." + std::to_string(getpid());
+
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return;
+        }
+        out.write(table.data(), static_cast<std::streamsize>(table.size()));
+        if (!out) {
+            out.close();
+            unlink(tmp_path.c_str());
+            return;
+        }
+    }
+
+    if (rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+    }
+}
+
+uint64_t ThemeCache::hashKey(Kind kind, std::string_view key) {
+    // FNV-1a: stable across runs and builds, unlike std::hash
+    uint64_t hash = 14695981039346656037ULL;
+    hash = (hash ^ static_cast<uint8_t>(kind)) * 1099511628211ULL;
+    for (char c : key) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool ThemeCache::parseColor(const std::string& value, std::string& escape) {
+    if (value.empty()) {
+        escape.clear();
+        return true;
+    }
+
+    if (value[0] == '#') {
+        // Exactly six hex digits; from_chars alone would stop at the first bad one
+        uint32_t rgb = 0;
+        const char* first = value.data() + 1;
+        const char* last = value.data() + value.size();
+        auto [end, error] = std::from_chars(first, last, rgb, 16);
+        if (value.size() != 7 || error != std::errc() || end != last ||
+            !std::all_of(first, last, [](char c) { return std::isxdigit(static_cast<unsigned char>(c)); })) {
+            return false;
+        }
+        escape = "\033[38;2;" + std::to_string(rgb >> 16) + ";" + std::to_string((rgb >> 8) & 0xff) + ";" +
+                 std::to_string(rgb & 0xff) + "m";
+        return true;
+    }
+
+    // Raw SGR parameters such as "01;34"
+    if (!std::all_of(value.begin(), value.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)) || c == ';'; })) {
+        return false;
+    }
+    escape = "\033[" + value + "m";
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// User icon/color overrides from a theme file (by default
+// $XDG_CONFIG_HOME/lspp/theme.toml). The first run compiles the file into a
+// binary hash table written next to it ("theme.toml.cache"); later runs
+// validate the cache against the source's mtime and size and just mmap it.
+//
+// Theme format (a small TOML subset):
+//
+//   [extensions]
+//   ".rs" = { icon = "", color = "#dea685" }
+//   [filenames]
+//   "Makefile" = { icon = "" }
+//   [types]
+//   directory = { color = "01;34" }
+//
+// Colors are "#rrggbb" or raw SGR parameters; a missing field keeps the
+// built-in value.
+class ThemeCache {
+public:
+    enum class Kind : uint8_t {
+        EXTENSION = 1,
+        FILENAME = 2,
+        TYPE = 3
+    };
+
+    struct Entry {
+        std::string_view icon;   // empty: keep the built-in icon
+        std::string_view color;  // full escape sequence, empty: keep the built-in color
+    };
+
+    ThemeCache();
+    explicit ThemeCache(const fs::path& source);
+    ~ThemeCache();
+
+    ThemeCache(const ThemeCache&) = delete;
+    ThemeCache& operator=(const ThemeCache&) = delete;
+
+    bool empty() const;
+    bool find(Kind kind, std::string_view key, Entry& entry) const;
+    void forEach(Kind kind, const std::function<void(std::string_view, const Entry&)>& callback) const;
+
+    static fs::path defaultPath();
+    static fs::path cachePath(const fs::path& source);
+
+private:
+    struct SourceStamp {
+        int64_t mtime_sec;
+        int64_t mtime_nsec;
+        uint64_t size;
+    };
+
+    const char* m_data;
+    size_t m_size;
+    void* m_mapping;
+    size_t m_mapping_size;
+    std::vector<char> m_owned;
+
+    void load(const fs::path& source);
+    bool mapCache(const fs::path& cache_path, const SourceStamp& stamp);
+    bool validate(const char* data, size_t size, const SourceStamp& stamp) const;
+
+    static std::vector<char> compile(const std::string& text, const fs::path& source, const SourceStamp& stamp);
+    static void writeCache(const fs::path& cache_path, const std::vector<char>& table);
+    static uint64_t hashKey(Kind kind, std::string_view key);
+    // "#rrggbb" or SGR parameters to an escape sequence; false if invalid
+    static bool parseColor(const std::string& value, std::string& escape);
+};
@@ -0,0 +1,324 @@
+#include "WatchView.hpp"
+#include "DisplayFormatter.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE |
+                                IN_DELETE_SELF | IN_MOVE_SELF;
+
+volatile sig_atomic_t g_stop_requested = 0;
+volatile sig_atomic_t g_resized = 0;
+
+void requestStop(int) {
+    g_stop_requested = 1;
+}
+
+void noteResize(int) {
+    g_resized = 1;
+}
+
+void writeTerminal(const std::string& data) {
+    const char* ptr = data.data();
+    size_t remaining = data.size();
+    while (remaining > 0) {
+        ssize_t written = write(STDOUT_FILENO, ptr, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        ptr += written;
+        remaining -= static_cast<size_t>(written);
+    }
+}
+
+size_t terminalRows() {
+    struct winsize w;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0 && w.ws_row > 0) {
+        return w.ws_row;
+    }
+    return 24;
+}
+
+} // namespace
+
+WatchView::WatchView(const fs::path& dir, const LsOptions& options,
+                     FileOperations& file_operations, IconProvider& icon_provider)
+    : m_dir(dir), m_options(options), m_file_operations(file_operations),
+      m_icon_provider(icon_provider), m_relist(false), m_gone(false) {
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+WatchView::~WatchView() {
+    if (m_inotify_fd >= 0) {
+        close(m_inotify_fd);
+    }
+}
+
+int WatchView::run() {
+    if (m_inotify_fd < 0 || inotify_add_watch(m_inotify_fd, m_dir.c_str(), WATCH_MASK | IN_ONLYDIR) < 0) {
+        std::cerr << "ls++: cannot watch '" << m_dir.string() << "': " << std::strerror(errno) << "\n";
+        return 2;
+    }
+
+    // Watch first, then list: nothing that happens in between is missed
+    m_files = m_file_operations.listDirectory(m_dir, m_options);
+
+    struct sigaction action{};
+    action.sa_handler = requestStop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    action.sa_handler = noteResize;
+    sigaction(SIGWINCH, &action, nullptr);
+
+    // Alternate screen, hidden cursor, no autowrap (long lines are clipped)
+    writeTerminal("\033[?1049h\033[?25l\033[?7l");
+    render(true);
+
+    using clock = std::chrono::steady_clock;
+    clock::time_point deadline{};
+    struct pollfd fds[1] = {{m_inotify_fd, POLLIN, 0}};
+
+    while (!g_stop_requested && !m_gone) {
+        bool pending = m_relist || !m_dirty.empty();
+        int timeout = -1;
+        if (pending) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now());
+            timeout = static_cast<int>(std::max<int64_t>(0, left.count()));
+        }
+
+        int ready = poll(fds, 1, timeout);
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            collectEvents();
+            if (!pending && (m_relist || !m_dirty.empty())) {
+                // First event of a batch: everything until the deadline joins it
+                deadline = clock::now() + FRAME_INTERVAL;
+            }
+        }
+
+        bool resized = g_resized;
+        g_resized = 0;
+
+        if ((m_relist || !m_dirty.empty()) && clock::now() >= deadline) {
+            applyChanges();
+            render(resized);
+        } else if (resized) {
+            render(true);
+        }
+    }
+
+    writeTerminal("\033[?7h\033[?25h\033[?1049l");
+    // Errors met while the screen was taken over are shown once it is back
+    m_file_operations.diagnostics().flush(std::cout, std::cerr);
+    if (m_gone) {
+        std::cerr << "ls++: '" << m_dir.string() << "' was removed or moved\n";
+        return 1;
+    }
+    return 0;
+}
+
+void WatchView::collectEvents() {
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    for (;;) {
+        ssize_t length = read(m_inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return;
+        }
+
+        for (char* ptr = buffer; ptr < buffer + length;) {
+            const auto* event = reinterpret_cast<const struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                m_relist = true;
+            } else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                m_gone = true;
+            } else if (event->len > 0) {
+                m_dirty.emplace(event->name);
+            } else {
+                // The directory's own attributes: only . can show them
+                m_dirty.emplace(".");
+            }
+        }
+    }
+}
+
+bool WatchView::inOrder(const FileInfo& a, const FileInfo& b) const {
+    // sortFiles reverses the whole sorted table for -r
+    return m_options.reverse_order ? FileOperations::compareEntries(b, a, m_options)
+                                   : FileOperations::compareEntries(a, b, m_options);
+}
+
+void WatchView::applyChanges() {
+    if (m_relist) {
+        m_files = m_file_operations.listDirectory(m_dir, m_options);
+        m_relist = false;
+        m_dirty.clear();
+        m_lines.clear();
+        return;
+    }
+
+    // Drop every entry the batch touched, then merge their current state back in
+    std::erase_if(m_files, [this](const FileInfo& file) {
+        return m_dirty.count(file.display_name.native()) > 0;
+    });
+
+    std::vector<FileInfo> changed;
+    changed.reserve(m_dirty.size());
+    for (const auto& name : m_dirty) {
+        m_lines.erase(name);
+        fs::path path = m_dir / name;
+        struct stat st;
+        if (lstat(path.c_str(), &st) == 0) {
+            changed.emplace_back(path, st);
+        }
+    }
+    m_dirty.clear();
+
+    m_file_operations.completeEntries(changed, m_options);
+    auto order = [this](const FileInfo& a, const FileInfo& b) { return inOrder(a, b); };
+    std::sort(changed.begin(), changed.end(), order);
+
+    size_t middle = m_files.size();
+    m_files.insert(m_files.end(), std::make_move_iterator(changed.begin()), std::make_move_iterator(changed.end()));
+    std::inplace_merge(m_files.begin(), m_files.begin() + static_cast<std::ptrdiff_t>(middle), m_files.end(), order);
+}
+
+std::vector<std::string> WatchView::splitLines(const std::string& frame) {
+    // Every sequence ColorEmitter writes fully defines the attributes that
+    // follow it, so a line drawn on its own needs only the last one before it
+    std::vector<std::string> lines;
+    std::string active;
+    std::string line;
+    bool has_text = false;
+
+    for (size_t i = 0; i < frame.size(); ++i) {
+        char c = frame[i];
+        if (c == '\n') {
+            lines.push_back(std::move(line));
+            line = active;
+            has_text = false;
+            continue;
+        }
+        if (c == '\033' && i + 1 < frame.size() && frame[i + 1] == '[') {
+            size_t end = frame.find_first_of("m", i + 2);
+            if (end != std::string::npos) {
+                std::string sequence = frame.substr(i, end - i + 1);
+                std::string params = frame.substr(i + 2, end - i - 2);
+                active = (params.empty() || params == "0") ? "" : sequence;
+                line += sequence;
+                i = end;
+                continue;
+            }
+        }
+        line += c;
+        has_text = true;
+    }
+    if (has_text) {
+        lines.push_back(std::move(line));
+    }
+    return lines;
+}
+
+std::vector<std::string> WatchView::formatBody(size_t limit, size_t& total) {
+    DisplayFormatter formatter(m_options, m_icon_provider);
+    if (m_options.format != ListFormat::LONG && m_options.format != ListFormat::ONE_PER_LINE) {
+        // Grid layouts depend on every name
+        std::ostringstream frame;
+        formatter.displayFiles(m_files, frame);
+        std::vector<std::string> body = splitLines(frame.str());
+        total = body.size();
+        return body;
+    }
+
+    formatter.beginStream();
+    if (formatter.streamNeedsMeasure()) {
+        formatter.measure(m_files);
+        if (formatter.streamWidths() != m_widths) {
+            // Every line is aligned to the new columns
+            m_lines.clear();
+            m_widths = formatter.streamWidths();
+        }
+    }
+
+    std::vector<std::string> body;
+    bool with_total = m_options.format == ListFormat::LONG && m_options.show_size && !m_files.empty();
+    if (with_total) {
+        body.push_back("total " + std::to_string(formatter.streamBlocks()));
+    }
+    total = m_files.size() + (with_total ? 1 : 0);
+
+    for (size_t i = 0; i < m_files.size() && body.size() < limit; ++i) {
+        const FileInfo& file = m_files[i];
+        auto [it, inserted] = m_lines.try_emplace(file.display_name.native());
+        if (inserted) {
+            std::ostringstream line;
+            formatter.streamEntry(file, line);
+            it->second = line.str();
+        }
+        body.push_back(it->second);
+    }
+    return body;
+}
+
+void WatchView::render(bool full) {
+    // One row for the status line; with a single row, nothing is cut off
+    size_t rows = terminalRows();
+    size_t total = 0;
+    std::vector<std::string> body = formatBody(rows > 1 ? rows - 1 : SIZE_MAX, total);
+
+    char clock_text[16];
+    std::time_t now = std::time(nullptr);
+    std::strftime(clock_text, sizeof(clock_text), "%H:%M:%S", std::localtime(&now));
+
+    std::vector<std::string> lines;
+    lines.push_back("ls++ --watch " + m_dir.string() + ": " + std::to_string(m_files.size()) +
+                    " entries, updated " + clock_text);
+
+    if (total + 1 > rows && rows > 1) {
+        size_t shown = rows - 2;
+        lines.insert(lines.end(), body.begin(), body.begin() + static_cast<std::ptrdiff_t>(shown));
+        lines.push_back("... " + std::to_string(total - shown) + " more lines");
+    } else {
+        lines.insert(lines.end(), body.begin(), body.end());
+    }
+
+    std::string update = "\033[?2026h";
+    if (full) {
+        update += "\033[H\033[2J";
+        m_screen.clear();
+    }
+    size_t count = std::max(lines.size(), m_screen.size());
+    for (size_t row = 0; row < count; ++row) {
+        const std::string* line = row < lines.size() ? &lines[row] : nullptr;
+        if (!full && row < m_screen.size() && line && *line == m_screen[row]) {
+            continue;
+        }
+        update += "\033[" + std::to_string(row + 1) + ";1H";
+        if (line) {
+            update += *line;
+        }
+        update += "\033[m\033[K";
+    }
+    update += "\033[?2026l";
+
+    writeTerminal(update);
+    m_screen = std::move(lines);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ArgumentParser.hpp"
+#include "DisplayFormatter.hpp"
+#include "FileOperations.hpp"
+#include "IconProvider.hpp"
+
+namespace fs = std::filesystem;
+
+// `ls++ --watch DIR`: keeps a listing of DIR on the terminal's alternate
+// screen and updates it from inotify events. Events are coalesced into
+// batches (one per FRAME_INTERVAL); only the names they mention are
+// re-statted, removed from the sorted table and merged back in, and only
+// the screen lines whose rendering changed are rewritten, inside a
+// synchronized-output update so the terminal never shows a half-drawn frame.
+// In the one-entry-per-line formats (-l, -1) only the entries that fit on
+// the screen are formatted, each once until it changes.
+class WatchView {
+public:
+    static constexpr std::chrono::milliseconds FRAME_INTERVAL{50};
+
+    WatchView(const fs::path& dir, const LsOptions& options,
+              FileOperations& file_operations, IconProvider& icon_provider);
+    ~WatchView();
+
+    WatchView(const WatchView&) = delete;
+    WatchView& operator=(const WatchView&) = delete;
+
+    // Runs until SIGINT/SIGTERM or until the directory goes away; returns the exit status
+    int run();
+
+private:
+    fs::path m_dir;
+    const LsOptions& m_options;
+    FileOperations& m_file_operations;
+    IconProvider& m_icon_provider;
+
+    int m_inotify_fd;
+    std::vector<FileInfo> m_files;              // in the order sortFiles produces
+    std::unordered_set<std::string> m_dirty;    // names changed since the last frame
+    bool m_relist;                              // events were lost: list everything again
+    bool m_gone;                                // the directory was removed or moved away
+    std::vector<std::string> m_screen;          // lines currently shown
+    std::unordered_map<std::string, std::string> m_lines;   // formatted line by name (-l, -1)
+    DisplayFormatter::LongFormatWidths m_widths;            // the -l columns m_lines were formatted for
+
+    void collectEvents();
+    void applyChanges();
+    void render(bool full);
+    // The first limit lines of the listing; total is set to the number of lines in all
+    std::vector<std::string> formatBody(size_t limit, size_t& total);
+    bool inOrder(const FileInfo& a, const FileInfo& b) const;
+
+    static std::vector<std::string> splitLines(const std::string& frame);
+};
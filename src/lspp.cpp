@@ -1,34 +1,241 @@
 #include "lspp.hpp"
+#include "FlatListing.hpp"
+#include "ListingSpill.hpp"
+#include "ListingDiff.hpp"
+#include "ListingServer.hpp"
+#include "ListingSnapshot.hpp"
+#include "ListingSummary.hpp"
+#include "WatchView.hpp"
+#include <unistd.h>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 
 Lspp::Lspp() {
     m_argument_parser = std::make_unique<ArgumentParser>();
-    m_file_operations = std::make_unique<FileOperations>();
+}
+
+FileOperations& Lspp::fileOperations() {
+    // Created on demand: a --client run never needs the locale setup
+    if (!m_file_operations) {
+        m_file_operations = std::make_unique<FileOperations>();
+    }
+    return *m_file_operations;
 }
 
 void Lspp::run(int argc, char** argv) {
     try {
         LsOptions options = m_argument_parser->parse(argc, argv);
-        processAndDisplay(options);
+        fs::path socket_path = options.socket_path.empty() ? ListingServer::defaultSocketPath()
+                                                           : fs::path(options.socket_path);
+        
+        if (options.diff) {
+            if (options.paths.size() != 2) {
+                std::cerr << "ls++: --diff needs exactly two directories or snapshots\n";
+                std::exit(2);
+            }
+            ListingDiff diff(options, fileOperations());
+            std::exit(diff.run(options.paths[0], options.paths[1]));
+        }
+        
+        if (options.summary) {
+            ListingSummary summary(options);
+            std::exit(summary.run(options.paths));
+        }
+        
+        // The daemon cannot read this process's stdin or --from-file, so those list locally;
+        // --watch keeps redrawing this terminal, which a one-shot reply cannot do
+        if (options.use_server && options.paths_from.empty() && !options.watch) {
+            int status = ListingServer::forward(socket_path, argc, argv);
+            if (status >= 0) {
+                std::exit(status);
+            }
+            // No daemon running: list locally
+        }
+        
+        if (options.serve) {
+            int status;
+            {
+                ListingServer server(*this, socket_path);
+                status = server.run();
+            }
+            std::exit(status);
+        }
+        
+        IconProvider icon_provider;
+        
+        if (options.watch) {
+            if (options.paths.size() != 1 || !isatty(STDOUT_FILENO)) {
+                std::cerr << "ls++: --watch needs a single directory and a terminal\n";
+                std::exit(2);
+            }
+            int status;
+            {
+                WatchView view(options.paths[0], options, fileOperations(), icon_provider);
+                status = view.run();
+            }
+            std::exit(status);
+        }
+        
+        int status = processAndDisplay(options, icon_provider);
+        if (status != 0) {
+            std::exit(status);
+        }
     } catch (const std::exception& e) {
         std::cerr << "ls++: " << e.what() << std::endl;
         std::exit(1);
     }
 }
 
-void Lspp::processAndDisplay(const LsOptions& options) {
+int Lspp::processAndDisplay(const LsOptions& options, IconProvider& icon_provider) {
+    DisplayFormatter formatter(options, icon_provider);
+    // Snapshots take the whole listing at once; records make one document,
+    // written as the groups come in
+    bool whole_listing = !options.snapshot_path.empty();
+    bool records = isRecordFormat(options.format);
+    bool streaming = false;
     std::vector<FileInfo> all_files;
     
-    if (options.paths.size() == 1 && options.paths[0] == ".") {
+    // Otherwise each group is printed as soon as it is listed, in argument order
+    bool first = true;
+    auto show = [&](ListingGroup& group) {
+        if (whole_listing) {
+            if (group.spill) {
+                group.spill->mergeInto(all_files);
+                return;
+            }
+            all_files.insert(all_files.end(), std::make_move_iterator(group.files.begin()),
+                             std::make_move_iterator(group.files.end()));
+            return;
+        }
+        if (!records && group.header) {
+            if (!first) {
+                std::cout << "\n";
+            }
+            std::cout << group.directory.string() << ":\n";
+        }
+        first = false;
+        if (records || group.spill) {
+            if (!streaming) {
+                formatter.beginStream(std::cout);
+                streaming = true;
+            }
+            if (group.spill) {
+                // A directory past --max-memory, merged from its runs
+                auto write = [&formatter](std::vector<FileInfo>& batch) { formatter.streamFiles(batch, std::cout); };
+                if (formatter.streamNeedsMeasure()) {
+                    group.spill->visit([&formatter](std::vector<FileInfo>& batch) { formatter.measure(batch); });
+                }
+                group.spill->merge(write);
+            } else {
+                formatter.streamFiles(group.files, std::cout);
+            }
+            if (!records) {
+                formatter.endStream(std::cout);
+                streaming = false;
+            }
+            return;
+        }
+        formatter.displayFiles(group.files, std::cout);
+    };
+    
+    // --flat collects every group and merges them into one listing
+    FlatListing flat(options);
+    FileOperations::GroupSink sink = show;
+    if (options.flat) {
+        sink = [&flat](ListingGroup& group) { flat.add(group); };
+    }
+    
+    if (!options.from_snapshot_path.empty()) {
+        showSnapshot(options, sink);
+    } else if (!options.paths_from.empty()) {
+        if (!listPathsFrom(options, sink)) {
+            throw std::runtime_error("cannot read '" + options.paths_from + "'");
+        }
+    } else if (options.paths.size() == 1 && options.paths[0] == "." && !options.recursive && !options.flat &&
+               options.max_memory == 0 && options.snapshot_path.empty()) {
         // Single directory case - current directory
-        all_files = m_file_operations->listDirectory(".", options);
+        all_files = fileOperations().listDirectory(".", options);
     } else {
         // Multiple targets case
-        all_files = m_file_operations->processTargets(options.paths, options);
+        fileOperations().processTargets(options.paths, options, sink);
+    }
+    if (options.flat) {
+        all_files = flat.merge();
+    }
+    
+    if (!options.snapshot_path.empty()) {
+        // The root lets --diff match a live directory against the snapshot
+        bool single_root = options.paths.size() == 1 && options.paths_from.empty() && options.from_snapshot_path.empty();
+        std::string root = single_root ? options.paths[0] : std::string();
+        if (!ListingSnapshot::save(options.snapshot_path, all_files, root, options.recursive)) {
+            throw std::runtime_error("cannot write snapshot '" + options.snapshot_path + "'");
+        }
+    } else if (streaming) {
+        formatter.endStream(std::cout);
+    } else {
+        // Whatever was not printed group by group
+        formatter.displayFiles(all_files, std::cout);
+    }
+    
+    Diagnostics& diagnostics = fileOperations().diagnostics();
+    int status = diagnostics.exitStatus();
+    diagnostics.flush(std::cout, std::cerr);
+    return status;
+}
+
+bool Lspp::listPathsFrom(const LsOptions& options, const FileOperations::GroupSink& sink) {
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (options.paths_from != "-") {
+        file.open(options.paths_from, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        in = &file;
+    }
+    
+    std::vector<std::string> chunk;
+    std::string path;
+    bool more = true;
+    while (more) {
+        chunk.clear();
+        while (chunk.size() < PATH_CHUNK && (more = static_cast<bool>(std::getline(*in, path, options.paths_separator)))) {
+            if (path.empty()) {
+                fileOperations().diagnostics().report(Diagnostics::SERIOUS, "invalid zero-length file name in '" +
+                                                      options.paths_from + "'");
+                continue;
+            }
+            chunk.push_back(std::move(path));
+        }
+        if (!chunk.empty()) {
+            fileOperations().processTargets(chunk, options, sink);
+        }
+    }
+    return !in->bad();
+}
+
+void Lspp::showSnapshot(const LsOptions& options, const FileOperations::GroupSink& sink) {
+    ListingSnapshot snapshot;
+    if (!snapshot.open(options.from_snapshot_path)) {
+        throw std::runtime_error("cannot read snapshot '" + options.from_snapshot_path + "'");
     }
     
-    // Create formatter and display results
-    DisplayFormatter formatter(options);
-    formatter.displayFiles(all_files, std::cout);
+    // A snapshot holds one run of entries per listed directory; each is
+    // filtered, sorted and shown on its own, as the directory was under -R
+    bool headers = snapshot.runs() > 1;
+    fs::path root(snapshot.root());
+    snapshot.forEachRun([&](const fs::path& directory, std::vector<FileInfo>& files) {
+        ListingGroup group;
+        group.directory = directory;
+        group.root = root;
+        group.header = headers;
+        group.files = fileOperations().filterFiles(std::move(files), options);
+        if (options.flat) {
+            FileOperations::nameByPath(group.files, group);
+        }
+        fileOperations().sortFiles(group.files, options);
+        sink(group);
+    });
 }
@@ -12,9 +12,21 @@ public:
     
     void run(int argc, char** argv);
     
+    // Lists and renders one invocation to std::cout, then its errors to
+    // std::cerr; returns the exit status. Also called per request by --serve
+    int processAndDisplay(const LsOptions& options, IconProvider& icon_provider);
+    FileOperations& fileOperations();
+    
 private:
     std::unique_ptr<ArgumentParser> m_argument_parser;
     std::unique_ptr<FileOperations> m_file_operations;
     
-    void processAndDisplay(const LsOptions& options);
+    // --from-snapshot: each directory's run of entries, filtered and sorted
+    // by the current options, handed to sink as one group
+    void showSnapshot(const LsOptions& options, const FileOperations::GroupSink& sink);
+    
+    // --from-file/--files0-from: lists the paths read from the file in
+    // chunks, so output starts before the input ends; false if it cannot be read
+    static constexpr size_t PATH_CHUNK = 1024;
+    bool listPathsFrom(const LsOptions& options, const FileOperations::GroupSink& sink);
 };
@@ -0,0 +1,32 @@
+#include "src/DisplayWidth.hpp"
+#include <iostream>
+#include <cassert>
+
+int main() {
+    // Pure ASCII goes through the vectorized prefix scan
+    assert(DisplayWidth::measure("") == 0);
+    assert(DisplayWidth::measure("main.cpp") == 8);
+    assert(DisplayWidth::measure("a-rather-long-file-name-that-spans-several-simd-blocks.txt") == 58);
+    
+    // Accented Latin and combining marks
+    assert(DisplayWidth::measure("café") == 4);
+    assert(DisplayWidth::measure("café") == 4);
+    
+    // East Asian wide characters and emoji take two cells
+    assert(DisplayWidth::measure("日本語.txt") == 10);
+    assert(DisplayWidth::measure("\U0001F600") == 2);
+    
+    // Nerd Font icons (private use area) have a defined width
+    assert(DisplayWidth::measure("") == DisplayWidth::ICON_WIDTH);
+    assert(DisplayWidth::measure("\U000F0219") == DisplayWidth::ICON_WIDTH);
+    
+    // Invalid UTF-8 counts one cell per byte
+    assert(DisplayWidth::measure("\xff\xfe") == 2);
+    
+    // Escape sequences take no cells
+    assert(DisplayWidth::measureStyled("\033[38;2;241;81;126mmain.cpp\033[m") == 8);
+    
+    std::cout << "All tests passed! Display width calculation works correctly." << std::endl;
+    
+    return 0;
+}
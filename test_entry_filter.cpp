@@ -0,0 +1,143 @@
+#include "src/EntryFilter.hpp"
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int64_t secondsAgo(int64_t seconds) {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() - seconds * 1000000000LL;
+}
+
+int main() {
+    std::string error;
+    
+    // Sizes in bytes or powers of 1024
+    int64_t bytes = 0;
+    assert(EntryFilter::parseSize("0", bytes) && bytes == 0);
+    assert(EntryFilter::parseSize("512", bytes) && bytes == 512);
+    assert(EntryFilter::parseSize("1K", bytes) && bytes == 1024);
+    assert(EntryFilter::parseSize("1k", bytes) && bytes == 1024);
+    assert(EntryFilter::parseSize("3M", bytes) && bytes == 3 * 1024 * 1024);
+    assert(EntryFilter::parseSize("2G", bytes) && bytes == 2LL << 30);
+    assert(EntryFilter::parseSize("8388607T", bytes) && bytes == 8388607LL << 40);
+    assert(!EntryFilter::parseSize("8388608T", bytes));
+    assert(!EntryFilter::parseSize("99999999999999999999", bytes));
+    assert(!EntryFilter::parseSize("", bytes));
+    assert(!EntryFilter::parseSize("K", bytes));
+    assert(!EntryFilter::parseSize("-1", bytes));
+    assert(!EntryFilter::parseSize("+1", bytes));
+    assert(!EntryFilter::parseSize("1.5K", bytes));
+    assert(!EntryFilter::parseSize("1KB", bytes));
+    
+    // Invalid values are rejected with a message
+    EntryFilter invalid;
+    assert(!invalid.add("min-size", "ten", error) && !error.empty());
+    assert(!invalid.add("newer", "", error) && error.find("requires an argument") != std::string::npos);
+    assert(!invalid.add("type", "fx", error) && !error.empty());
+    assert(!invalid.add("perm", "8", error) && !error.empty());
+    assert(!invalid.add("perm", "17777", error) && !error.empty());
+    assert(!invalid.add("owner", "no-such-user-for-ls++", error) && !error.empty());
+    assert(!invalid.add("newer", "no-such-file-for-ls++", error) && !error.empty());
+    assert(invalid.empty());
+    
+    // Ages that overflow nanoseconds are invalid, not wrapped around
+    assert(!invalid.add("newer", "9223372036854775807s", error));
+    assert(!invalid.add("older", "999999999999999w", error));
+    assert(!invalid.add("newer", "15251w", error));
+    assert(invalid.add("newer", "15250w", error));
+    
+    // Ages and dates
+    EntryFilter recent;
+    assert(recent.add("newer", "1h", error) && error.empty());
+    assert(recent.needs() == EntryFilter::MTIME);
+    EntryFilter::Subject subject;
+    subject.mode = S_IFREG | 0644;
+    subject.mtime_nsec = secondsAgo(60);
+    assert(recent.matches(subject));
+    subject.mtime_nsec = secondsAgo(2 * 3600);
+    assert(!recent.matches(subject));
+    
+    EntryFilter old;
+    assert(old.add("older", "2000-01-01", error));
+    subject.mtime_nsec = 0;
+    assert(old.matches(subject));
+    subject.mtime_nsec = secondsAgo(0);
+    assert(!old.matches(subject));
+    assert(old.add("newer", "1969-12-30 12:00", error));
+    subject.mtime_nsec = 0;
+    assert(old.matches(subject));
+    
+    // All predicates must hold
+    EntryFilter files;
+    assert(files.add("type", "f,l", error));
+    assert(files.add("min-size", "1K", error));
+    assert(files.add("max-size", "2K", error));
+    assert(files.add("owner", "0", error));
+    assert(files.add("perm", "-0600", error));
+    subject = {};
+    subject.mode = S_IFREG | 0640;
+    subject.size = 1500;
+    assert(files.matches(subject));
+    subject.mode = S_IFDIR | 0750;
+    assert(!files.matches(subject));
+    subject.mode = S_IFLNK | 0600;
+    assert(files.matches(subject));
+    subject.size = 4096;
+    assert(!files.matches(subject));
+    subject.size = 1024;
+    subject.uid = 1000;
+    assert(!files.matches(subject));
+    subject.uid = 0;
+    subject.mode = S_IFREG | 0444;
+    assert(!files.matches(subject));
+    
+    // Permission bits: exact, all of them, any of them
+    EntryFilter exact, any;
+    assert(exact.add("perm", "755", error));
+    assert(any.add("perm", "/111", error));
+    subject.mode = S_IFREG | 0755;
+    assert(exact.matches(subject) && any.matches(subject));
+    subject.mode = S_IFREG | 0644;
+    assert(!exact.matches(subject) && !any.matches(subject));
+    
+    // --empty: files of size 0 and directories without entries
+    EntryFilter empty;
+    assert(empty.add("empty", "", error));
+    assert(empty.needs() & EntryFilter::CONTENTS);
+    subject = {};
+    subject.mode = S_IFREG | 0644;
+    assert(empty.matches(subject));
+    subject.size = 1;
+    assert(!empty.matches(subject));
+    
+    char dir[] = "/tmp/ls++-filter-XXXXXX";
+    assert(mkdtemp(dir));
+    subject = {};
+    subject.mode = S_IFDIR | 0755;
+    subject.path = dir;
+    assert(empty.matches(subject));
+    std::string child = std::string(dir) + "/child";
+    assert(mkdir(child.c_str(), 0755) == 0);
+    assert(!empty.matches(subject));
+    
+    // Entries are filtered on their lstat as they are read
+    struct stat st;
+    assert(lstat(dir, &st) == 0);
+    assert(!empty.matches(st, dir));
+    rmdir(child.c_str());
+    assert(empty.matches(st, dir));
+    EntryFilter directories;
+    assert(directories.add("type", "d", error) && directories.add("newer", "1h", error));
+    assert(directories.matches(st, dir));
+    assert(!files.matches(st, dir));
+    rmdir(dir);
+    
+    std::cout << "All tests passed! Entry filters work correctly." << std::endl;
+    
+    return 0;
+}
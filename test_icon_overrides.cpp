@@ -0,0 +1,43 @@
+#include "src/IconProvider.hpp"
+#include "src/FileOperations.hpp"
+#include <iostream>
+#include <cassert>
+#include <sys/stat.h>
+
+static FileInfo regularFile(const char* name) {
+    struct stat st{};
+    st.st_mode = S_IFREG | 0644;
+    st.st_nlink = 1;
+    return FileInfo(fs::path(name), st, std::string());
+}
+
+int main() {
+    FileInfo cmake = regularFile("CMakeLists.txt");
+    FileInfo notes = regularFile("notes.txt");
+    
+    // The expected icons, each from a provider that has seen nothing else
+    std::string cmake_icon = IconProvider().getIcon(cmake);
+    std::string txt_icon = IconProvider().getIcon(notes);
+    assert(cmake_icon != txt_icon);
+    
+    // An override seen first does not become the style of its extension
+    {
+        IconProvider provider;
+        assert(provider.getIcon(regularFile("CMakeLists.txt")) == cmake_icon);
+        assert(provider.getIcon(regularFile("notes.txt")) == txt_icon);
+        assert(provider.getIcon(regularFile("zz.txt")) == txt_icon);
+        assert(provider.getIcon(regularFile("CMakeLists.txt")) == cmake_icon);
+    }
+    
+    // Nor does the extension's style hide the override seen after it
+    {
+        IconProvider provider;
+        assert(provider.getIcon(regularFile("notes.txt")) == txt_icon);
+        assert(provider.getIcon(regularFile("CMakeLists.txt")) == cmake_icon);
+        assert(provider.getIcon(regularFile("zz.txt")) == txt_icon);
+    }
+    
+    std::cout << "All tests passed! Named icon overrides keep to their own names." << std::endl;
+    
+    return 0;
+}
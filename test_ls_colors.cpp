@@ -0,0 +1,37 @@
+#include "src/LsColors.hpp"
+#include <iostream>
+#include <cassert>
+
+int main() {
+    LsColors colors("di=01;34:ln=target:ex=01;32:*.gz=01;31:*.tar.gz=01;35:*~=00;90:*README*=04:");
+    
+    // Type keys
+    assert(colors.typeColor(LsColors::Indicator::DIRECTORY) != nullptr);
+    assert(*colors.typeColor(LsColors::Indicator::DIRECTORY) == "\033[01;34m");
+    assert(colors.typeColor(LsColors::Indicator::SYMLINK) == nullptr);
+    assert(colors.typeColor(LsColors::Indicator::FILE) == nullptr);
+    
+    // Longest suffix wins, case-insensitively
+    assert(*colors.suffixColor("backup.gz") == "\033[01;31m");
+    assert(*colors.suffixColor("release.tar.gz") == "\033[01;35m");
+    assert(*colors.suffixColor("RELEASE.TAR.GZ") == "\033[01;35m");
+    assert(*colors.suffixColor("notes.txt~") == "\033[00;90m");
+    assert(colors.suffixColor("main.cpp") == nullptr);
+    
+    // Glob keys are matched against the whole name
+    assert(*colors.suffixColor("README.md") == "\033[04m");
+    
+    // With globs present every class needs the name
+    assert(colors.dependsOnName(".cpp"));
+    
+    LsColors suffixes_only("*.gz=01;31:*.tar.gz=01;35:");
+    assert(suffixes_only.dependsOnName(".gz"));
+    assert(!suffixes_only.dependsOnName(".log"));
+    assert(!suffixes_only.dependsOnName(".tgz"));
+    
+    assert(LsColors("").empty());
+    
+    std::cout << "All tests passed! LS_COLORS lookup works correctly." << std::endl;
+    
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "src/ReorderBuffer.hpp"
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+int main() {
+    // Results come back in index order however the workers finish
+    {
+        ReorderBuffer<std::string> buffer(200, 8, 16, [](size_t index, std::string& result) {
+            // Later indices finish first within each window
+            std::this_thread::sleep_for(std::chrono::microseconds((200 - index) % 17 * 50));
+            result = std::to_string(index);
+        });
+        for (size_t i = 0; i < 200; ++i) {
+            assert(buffer.get(i) == std::to_string(i));
+        }
+    }
+    
+    // Workers never run more than window slots ahead of the caller
+    {
+        std::atomic<size_t> started{0};
+        ReorderBuffer<size_t> buffer(100, 4, 5, [&started](size_t index, size_t& result) {
+            ++started;
+            result = index * index;
+        });
+        for (size_t i = 0; i < 100; ++i) {
+            assert(buffer.get(i) == i * i);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            assert(started <= i + 1 + 5);
+        }
+    }
+    
+    // One thread, and a buffer dropped before every result was taken
+    {
+        ReorderBuffer<int> buffer(10, 1, 1, [](size_t index, int& result) {
+            result = static_cast<int>(index) + 1;
+        });
+        assert(buffer.get(0) == 1);
+        assert(buffer.get(3) == 4);
+    }
+    
+    std::cout << "All tests passed! Reorder buffer keeps results in order." << std::endl;
+    
+    return 0;
+}